@@ -51,6 +51,18 @@ typedef ck_spinlock_t nx_spinlock_t;
  */
 #define atomic_add_uint32(var, val) ck_pr_add_32(var, val)
 
+/**
+ *    Function like macro for atomically adding val to the uint64 variable pointed to by var.
+ *    @param var A pointer to a uint64 variable.
+ */
+#define atomic_add_uint64(var, val) ck_pr_add_64(var, val)
+
+/**
+ *    Function like macro for atomically loading the value of the uint64 pointed to by var and return the result.
+ *    @param var A pointer to a uint64 variable to atomically load/read the value from.
+ */
+#define atomic_load_uint64(var) ck_pr_load_64(var)
+
 /**
  *    Function like macro for atomically decrementing the uint32 variable pointed to by var.
  *    @param var A pointer to a uint32 variable.
@@ -85,6 +97,43 @@ typedef ck_spinlock_t nx_spinlock_t;
  */
 #define atomic_store_int32(var, val) ck_pr_store_int(var, val)
 
+/**
+ *    Function like macro for atomically storing the value val to the the variable
+ *    var.
+ *    @param var A pointer to uint64 variable to atomically store to.
+ *    @param val The value to store in the variable var.
+ */
+#define atomic_store_uint64(var, val) ck_pr_store_64(var, val)
+
+/**
+ *    Function like macro for atomically replacing the uint64 pointed to by var
+ *    with val when it still holds old. The value found is stored in found.
+ *    @param var A pointer to uint64 variable to compare and swap.
+ *    @param old The value var must hold for the swap to happen.
+ *    @param val The value to store in the variable var.
+ *    @param found A pointer to a uint64 the value var held is stored in.
+ *    @return True when the swap happened, false otherwise.
+ */
+#define atomic_cas_uint64(var, old, val, found) ck_pr_cas_64_value(var, old, val, found)
+
+/**
+ *    Function like macro for atomically replacing the uint32 pointed to by var
+ *    with val when it still holds old.
+ *    @param var A pointer to uint32 variable to compare and swap.
+ *    @param old The value var must hold for the swap to happen.
+ *    @param val The value to store in the variable var.
+ *    @return True when the swap happened, false otherwise.
+ */
+#define atomic_cas_uint32(var, old, val) ck_pr_cas_32(var, old, val)
+
+/**
+ *    Function like macro for atomically setting bit number bit of the uint64 pointed to by var.
+ *    @param var A pointer to uint64 variable to set the bit in.
+ *    @param bit The bit to set, from 0 to 63.
+ *    @return True when the bit was already set, false otherwise.
+ */
+#define atomic_bts_uint64(var, bit) ck_pr_bts_64(var, bit)
+
 /**
  *    Function like macro for atomically loading a pointer.
  *    @param var A pointer to uint32 variable to atomically load/read from.
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2015, Harrison Bowden, Minneapolis, MN
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ **/
+
+#include "coverage.h"
+#include "io/io.h"
+#include "memory/memory.h"
+#include "concurrent/concurrent.h"
+
+#include <string.h>
+
+static struct output_writter *output;
+static struct memory_allocator *allocator;
+
+struct coverage_map
+{
+    uint64_t total_edges;
+
+    /* One bit per edge, shared by every child. */
+    uint64_t edges[NX_COVERAGE_EDGES / 64];
+};
+
+/* The trace the mock backend hands out. */
+static uint64_t *mock_pcs = NULL;
+static uint64_t mock_count = 0;
+
+/* Spread program counters over the bitmap, they mostly differ in a few middle bits. */
+static uint64_t hash_pc(uint64_t pc)
+{
+    pc ^= pc >> 33;
+    pc *= 0xff51afd7ed558ccdULL;
+    pc ^= pc >> 33;
+
+    return (pc);
+}
+
+struct coverage_map *create_coverage_map(void)
+{
+    struct coverage_map *map = NULL;
+
+    map = allocator->shared(sizeof(struct coverage_map));
+    if(map == NULL)
+    {
+        output->write(ERROR, "Failed to allocate coverage map\n");
+        return (NULL);
+    }
+
+    memset(map, 0, sizeof(struct coverage_map));
+
+    return (map);
+}
+
+uint32_t merge_coverage(struct coverage_map *map, const uint64_t *pcs, uint64_t count)
+{
+    uint64_t i;
+    uint64_t prev = 0;
+    uint32_t new_edges = 0;
+
+    for(i = 0; i < count; i++)
+    {
+        uint64_t cur = hash_pc(pcs[i]);
+        uint64_t edge = ((prev >> 1) ^ cur) & (NX_COVERAGE_EDGES - 1);
+        uint64_t *word = &map->edges[edge / 64];
+        uint64_t bit = 1ULL << (edge % 64);
+
+        prev = cur;
+
+        /* Nearly every edge is old news, check with a plain load
+           so the shared cache lines are only written for new ones. */
+        if((atomic_load_uint64(word) & bit) != 0)
+            continue;
+
+        if(atomic_bts_uint64(word, (unsigned int)(edge % 64)) == false)
+            new_edges++;
+    }
+
+    if(new_edges > 0)
+        atomic_add_uint64(&map->total_edges, new_edges);
+
+    return (new_edges);
+}
+
+uint64_t get_total_edges(struct coverage_map *map)
+{
+    return (atomic_load_uint64(&map->total_edges));
+}
+
+void set_mock_coverage(const uint64_t *pcs, uint64_t count)
+{
+    if(count > NX_COVERAGE_TRACE_SIZE)
+        count = NX_COVERAGE_TRACE_SIZE;
+
+    if(mock_pcs == NULL)
+    {
+        mock_pcs = allocator->alloc(NX_COVERAGE_TRACE_SIZE * sizeof(uint64_t));
+        if(mock_pcs == NULL)
+        {
+            output->write(ERROR, "Failed to allocate mock trace\n");
+            mock_count = 0;
+            return;
+        }
+    }
+
+    memcpy(mock_pcs, pcs, count * sizeof(uint64_t));
+    mock_count = count;
+}
+
+static int32_t mock_available(void)
+{
+    return (NX_YES);
+}
+
+static int32_t mock_open(void)
+{
+    return (0);
+}
+
+static void mock_start(void)
+{
+    return;
+}
+
+static uint64_t mock_stop(const uint64_t **pcs)
+{
+    (*pcs) = mock_pcs;
+
+    return (mock_count);
+}
+
+static void mock_close(void)
+{
+    return;
+}
+
+struct coverage_backend *get_mock_backend(void)
+{
+    struct coverage_backend *backend = NULL;
+
+    backend = allocator->alloc(sizeof(struct coverage_backend));
+    if(backend == NULL)
+    {
+        output->write(ERROR, "Mock coverage backend allocation failed\n");
+        return (NULL);
+    }
+
+    backend->name = "mock";
+    backend->available = &mock_available;
+    backend->open = &mock_open;
+    backend->start = &mock_start;
+    backend->stop = &mock_stop;
+    backend->close = &mock_close;
+
+    return (backend);
+}
+
+void inject_coverage_deps(struct dependency_context *ctx)
+{
+    uint32_t i;
+
+    inject_kcov_deps(ctx);
+
+    for(i = 0; i < ctx->count; i++)
+    {
+        switch((int32_t)ctx->array[i]->name)
+        {
+            case ALLOCATOR:
+                allocator = (struct memory_allocator *)ctx->array[i]->interface;
+                break;
+
+            case OUTPUT:
+                output = (struct output_writter *)ctx->array[i]->interface;
+                break;
+        }
+    }
+
+    return;
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2015, Harrison Bowden, Minneapolis, MN
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ **/
+
+/**
+*     @file coverage.h
+*     @brief Kernel coverage feedback for the syscall fuzzer. A coverage
+*     backend collects the program counters the kernel hit while a test ran,
+*     and merge_coverage() folds them into an edge bitmap in shared memory so
+*     every child sees what the others have found. Linux uses KCOV, tests use
+*     the deterministic mock backend.
+*/
+
+#ifndef NX_COVERAGE_H
+#define NX_COVERAGE_H
+
+#include "depend-inject/depend-inject.h"
+#include "utils/utils.h"
+
+#include <stdint.h>
+
+/* Number of edges the shared bitmap tracks, hashes of edges beyond that collide. */
+#define NX_COVERAGE_EDGES (1U << 20)
+
+/* The most program counters one trace collects. */
+#define NX_COVERAGE_TRACE_SIZE (256U * 1024U)
+
+struct coverage_backend
+{
+    const char *name;
+
+    /* Returns NX_YES when the backend can run on this system. */
+    int32_t (*available)(void);
+
+    /* Per process setup, called once in every child. */
+    int32_t (*open)(void);
+
+    /* Start a trace, right before a test executes. */
+    void (*start)(void);
+
+    /* End the trace and point pcs at the program counters hit, returns how many. */
+    uint64_t (*stop)(const uint64_t **pcs);
+
+    void (*close)(void);
+};
+
+struct coverage_map;
+
+/**
+ * @return The KCOV backend. It's only available on Linux kernels built with
+ * CONFIG_KCOV and with debugfs mounted.
+ */
+extern struct coverage_backend *get_kcov_backend(void);
+
+/**
+ * @return A backend that reports whatever set_mock_coverage() was last given.
+ */
+extern struct coverage_backend *get_mock_backend(void);
+
+/**
+ * Set the trace the mock backend reports for every test from now on.
+ * @param pcs The program counters to report, copied.
+ * @param count How many pcs there are, at most NX_COVERAGE_TRACE_SIZE.
+ */
+extern void set_mock_coverage(const uint64_t *pcs, uint64_t count);
+
+/**
+ * Create an empty edge bitmap in shared memory, so it must be created before
+ * the children are forked.
+ * @return A coverage map on success and NULL on failure.
+ */
+extern struct coverage_map *create_coverage_map(void);
+
+/**
+ * Fold a trace into the map. An edge is a pair of consecutive program counters.
+ * @param map The map to merge into.
+ * @param pcs The trace to merge.
+ * @param count How many program counters the trace has.
+ * @return The number of edges no trace had hit before.
+ */
+extern uint32_t merge_coverage(struct coverage_map *map, const uint64_t *pcs, uint64_t count);
+
+/**
+ * @param map The map to count.
+ * @return The number of different edges hit so far.
+ */
+extern uint64_t get_total_edges(struct coverage_map *map);
+
+extern void inject_kcov_deps(struct dependency_context *ctx);
+
+extern void inject_coverage_deps(struct dependency_context *ctx);
+
+#endif
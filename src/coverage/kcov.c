@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2015, Harrison Bowden, Minneapolis, MN
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ **/
+
+#include "coverage.h"
+#include "io/io.h"
+#include "memory/memory.h"
+#include "concurrent/concurrent.h"
+
+#ifdef LINUX
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/kcov.h>
+
+#endif
+
+static struct output_writter *output;
+static struct memory_allocator *allocator;
+
+#ifdef LINUX
+
+static const char *KCOV_PATH = "/sys/kernel/debug/kcov";
+
+/* The child's KCOV descriptor and the trace buffer it maps. Slot zero of
+   the buffer is the number of program counters the kernel wrote after it. */
+static int32_t kcov_fd = -1;
+static uint64_t *kcov_area = NULL;
+
+static int32_t kcov_available(void)
+{
+    if(access(KCOV_PATH, R_OK | W_OK) < 0)
+        return (NX_NO);
+
+    return (NX_YES);
+}
+
+/* Tracing is enabled once for the child's main thread and stays on, start()
+   and stop() only reset and read the count so a test costs no extra syscalls. */
+static int32_t kcov_open(void)
+{
+    kcov_fd = open(KCOV_PATH, O_RDWR);
+    if(kcov_fd < 0)
+    {
+        output->write(ERROR, "Can't open kcov: %s\n", strerror(errno));
+        return (-1);
+    }
+
+    if(ioctl(kcov_fd, KCOV_INIT_TRACE, (unsigned long)NX_COVERAGE_TRACE_SIZE) < 0)
+    {
+        output->write(ERROR, "Can't init kcov trace: %s\n", strerror(errno));
+        (void)close(kcov_fd);
+        kcov_fd = -1;
+        return (-1);
+    }
+
+    void *area = mmap(NULL, NX_COVERAGE_TRACE_SIZE * sizeof(uint64_t),
+                      PROT_READ | PROT_WRITE, MAP_SHARED, kcov_fd, 0);
+    if(area == MAP_FAILED)
+    {
+        output->write(ERROR, "Can't map kcov trace: %s\n", strerror(errno));
+        (void)close(kcov_fd);
+        kcov_fd = -1;
+        return (-1);
+    }
+
+    kcov_area = (uint64_t *)area;
+
+    if(ioctl(kcov_fd, KCOV_ENABLE, KCOV_TRACE_PC) < 0)
+    {
+        output->write(ERROR, "Can't enable kcov: %s\n", strerror(errno));
+        (void)munmap(kcov_area, NX_COVERAGE_TRACE_SIZE * sizeof(uint64_t));
+        (void)close(kcov_fd);
+        kcov_area = NULL;
+        kcov_fd = -1;
+        return (-1);
+    }
+
+    return (0);
+}
+
+static void kcov_start(void)
+{
+    atomic_store_uint64(&kcov_area[0], 0);
+}
+
+static uint64_t kcov_stop(const uint64_t **pcs)
+{
+    uint64_t count = atomic_load_uint64(&kcov_area[0]);
+
+    if(count > NX_COVERAGE_TRACE_SIZE - 1)
+        count = NX_COVERAGE_TRACE_SIZE - 1;
+
+    (*pcs) = &kcov_area[1];
+
+    return (count);
+}
+
+static void kcov_close(void)
+{
+    if(kcov_fd < 0)
+        return;
+
+    (void)ioctl(kcov_fd, KCOV_DISABLE, 0);
+    (void)munmap(kcov_area, NX_COVERAGE_TRACE_SIZE * sizeof(uint64_t));
+    (void)close(kcov_fd);
+    kcov_area = NULL;
+    kcov_fd = -1;
+}
+
+#else
+
+static int32_t kcov_available(void)
+{
+    return (NX_NO);
+}
+
+static int32_t kcov_open(void)
+{
+    output->write(ERROR, "KCOV is only supported on Linux\n");
+    return (-1);
+}
+
+static void kcov_start(void)
+{
+    return;
+}
+
+static uint64_t kcov_stop(const uint64_t **pcs)
+{
+    (*pcs) = NULL;
+
+    return (0);
+}
+
+static void kcov_close(void)
+{
+    return;
+}
+
+#endif
+
+struct coverage_backend *get_kcov_backend(void)
+{
+    struct coverage_backend *backend = NULL;
+
+    backend = allocator->alloc(sizeof(struct coverage_backend));
+    if(backend == NULL)
+    {
+        output->write(ERROR, "KCOV backend allocation failed\n");
+        return (NULL);
+    }
+
+    backend->name = "kcov";
+    backend->available = &kcov_available;
+    backend->open = &kcov_open;
+    backend->start = &kcov_start;
+    backend->stop = &kcov_stop;
+    backend->close = &kcov_close;
+
+    return (backend);
+}
+
+void inject_kcov_deps(struct dependency_context *ctx)
+{
+    uint32_t i;
+
+    for(i = 0; i < ctx->count; i++)
+    {
+        switch((int32_t)ctx->array[i]->name)
+        {
+            case ALLOCATOR:
+                allocator = (struct memory_allocator *)ctx->array[i]->interface;
+                break;
+
+            case OUTPUT:
+                output = (struct output_writter *)ctx->array[i]->interface;
+                break;
+        }
+    }
+
+    return;
+}
@@ -18,7 +18,7 @@
 
 #include <stdint.h>
 
-enum dependency_name {OUTPUT, ALLOCATOR, RANDOM_GEN, HASHER, CONTROL, RESOURCE_GEN};
+enum dependency_name {OUTPUT, ALLOCATOR, RANDOM_GEN, HASHER, CONTROL, RESOURCE_GEN, SCRATCH_ALLOCATOR};
 
 struct dependency
 {
@@ -19,6 +19,8 @@
 #include "memory/memory.h"
 #include "io/io.h"
 
+#include <stdio.h>
+
 int main(int argc, const char * argv[])
 {
     int32_t rtrn = 0;
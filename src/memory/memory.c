@@ -20,7 +20,9 @@
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sched.h>
 #include <string.h>
+#include <unistd.h>
 #include <sys/mman.h>
 
 static void *default_mem_alloc(uint64_t nbytes)
@@ -66,6 +68,12 @@ static void default_mem_free(void **ptr)
     return;
 }
 
+static void default_mem_reset(void)
+{
+    /* Nothing to reset, heap allocations are released with free(). */
+    return;
+}
+
 static void default_mem_free_shared(void **ptr, uint64_t nbytes)
 {
     if((*ptr) == NULL)
@@ -78,92 +86,178 @@ static void default_mem_free_shared(void **ptr, uint64_t nbytes)
     return;
 }
 
+/* How long get_block() waits for a block, first spinning then yielding the cpu. */
+#define POOL_SPINS 64
+#define POOL_YIELDS 256
+
+/* Shard of every pool this process works on, see set_pool_shard(). */
+static uint32_t pool_shard;
+
+/* Pid blocks taken by this process are tagged with, looked up on first use. */
+static int32_t pool_owner;
+
+static uint64_t pack_free_head(uint64_t old_head, uint32_t index)
+{
+    /* Bump the tag so a CAS against a head read before this update fails. */
+    return ((((old_head >> 32) + 1) << 32) | index);
+}
+
+static struct memory_block *pop_free_block(struct shared_pool *pool, struct pool_shard *shard)
+{
+    uint64_t head = atomic_load_uint64(&shard->free_head);
+
+    while(1)
+    {
+        uint32_t index = (uint32_t)head;
+
+        if(index == NX_POOL_NONE)
+            return (NULL);
+
+        /* The next link may be stale if another process popped the block
+           first, the tag makes the CAS fail in that case. */
+        uint32_t next = atomic_load_uint32(&pool->blocks[index].next);
+
+        if(atomic_cas_uint64(&shard->free_head, head, pack_free_head(head, next), &head))
+            return (&pool->blocks[index]);
+    }
+}
+
+static void push_free_block(struct pool_shard *shard, struct memory_block *block)
+{
+    uint64_t head = atomic_load_uint64(&shard->free_head);
+
+    while(1)
+    {
+        atomic_store_uint32(&block->next, (uint32_t)head);
+
+        if(atomic_cas_uint64(&shard->free_head, head, pack_free_head(head, block->index), &head))
+            return;
+    }
+}
+
 static struct shared_pool *default_shared_pool_allocator(uint64_t count, uint64_t size)
 {
     struct shared_pool *pool = NULL;
 
-    pool = default_mem_alloc_shared(sizeof(struct shared_pool));
-    if(pool == NULL)
+    if(count == 0 || count >= NX_POOL_NONE || size == 0)
         return (NULL);
 
-    /* Initialize the memory pool. */
-    struct shared_pool s_pool = {
-        .lock = NX_SPINLOCK_INITIALIZER,
-        .block_size = size,
-        .block_count = count,
-        .free_list = NX_SLIST_HEAD_INITIALIZER(s_pool->free_list),
-        .allocated_list = NX_SLIST_HEAD_INITIALIZER(s_pool->allocated_list)
-    };
+    /* Key table with at least twice as many slots as blocks, a power of two for masking. */
+    uint64_t slots = 1;
+    while(slots < count * 2)
+        slots <<= 1;
+
+    uint32_t shard_count = (count < NX_POOL_SHARDS) ? (uint32_t)count : NX_POOL_SHARDS;
 
-    memmove(pool, &s_pool, sizeof(struct shared_pool));
+    /* The pool, it's shards, blocks and the key table share one mapping
+       and the block data is a second one. The shards start on a cache line. */
+    uint64_t shards_offset = (sizeof(struct shared_pool) + CK_MD_CACHELINE - 1) & ~((uint64_t)CK_MD_CACHELINE - 1);
+    uint64_t blocks_offset = shards_offset + (sizeof(struct pool_shard) * shard_count);
+    uint64_t table_offset = blocks_offset + (sizeof(struct memory_block) * count);
 
-    /* Init the free and allocated block list. */
-    NX_SLIST_INIT(&pool->free_list);
-    NX_SLIST_INIT(&pool->allocated_list);
+    pool = default_mem_alloc_shared(table_offset + (sizeof(uint32_t) * slots));
+    if(pool == NULL)
+        return (NULL);
+
+    char *data = default_mem_alloc_shared(count * size);
+    if(data == NULL)
+        return (NULL);
+
+    /* Shared anonymous mappings are zero filled, so the key table starts out empty. */
+    pool->block_size = size;
+    pool->block_count = count;
+    pool->shard_count = shard_count;
+    pool->shards = (struct pool_shard *)((char *)pool + shards_offset);
+    pool->blocks = (struct memory_block *)((char *)pool + blocks_offset);
+    pool->key_table = (uint32_t *)((char *)pool + table_offset);
+    pool->key_slots = slots;
 
     uint32_t i;
 
-    /* Create blocks of the number requested by the caller of this function. */
+    for(i = 0; i < shard_count; i++)
+        pool->shards[i].free_head = NX_POOL_NONE;
+
+    /* Deal the blocks out over the shards round robin. */
     for(i = 0; i < count; i++)
     {
-        /* Declare memory block. */
-        struct memory_block *block = NULL;
-
-        /* Allocate the memory block as shared memory. */
-        block = default_mem_alloc_shared(sizeof(struct memory_block));
-        if(block == NULL)
-            return (NULL);
+        struct memory_block *block = &pool->blocks[i];
 
-        /* Allocate enough space for the user to store what they want. */
-        block->ptr = default_mem_alloc_shared(size);
-        if(block->ptr == NULL)
-            return (NULL);
+        block->ptr = data + (i * size);
+        block->index = i;
+        block->key = 0;
 
-        /* Insert the node in the free list. */
-        NX_SLIST_INSERT_HEAD(&pool->free_list, block);
+        push_free_block(&pool->shards[i % shard_count], block);
     }
 
     return (pool);
 }
 
-static struct memory_block *default_get_shared_block(struct shared_pool *pool)
+/* Take a block from the own shard, or steal one from the next shard that has one. */
+static struct memory_block *take_block(struct shared_pool *pool)
 {
-    /* Declare a memory block pointer. */
     struct memory_block *block = NULL;
+    uint32_t own = pool_shard % pool->shard_count;
+    uint32_t i;
 
-    /* Loop until we get a shared block. */
-    while(1)
-    {
-        /* Lock the spinlock for exclusive access. */
-        nx_spinlock_lock(&pool->lock);
+    block = pop_free_block(pool, &pool->shards[own]);
+    if(block != NULL)
+        return (block);
 
-        /* Get first node in list and break out of both loops. */
-        NX_SLIST_FOREACH(block, &pool->free_list)
+    for(i = 1; i < pool->shard_count; i++)
+    {
+        block = pop_free_block(pool, &pool->shards[(own + i) % pool->shard_count]);
+        if(block != NULL)
         {
-            /* Remove the block from the free_list. */
-            NX_SLIST_REMOVE(&pool->free_list, block, memory_block);
+            /* The block is returned to our shard, so blocks drift
+               towards the children that use them the most. */
+            atomic_add_uint64(&pool->steals, 1);
+            return (block);
+        }
+    }
 
-            /* Add the block to the allocated block list. */
-            NX_SLIST_INSERT_HEAD(&pool->allocated_list, block);
+    return (NULL);
+}
 
-            if(block != NULL)
-            {
-            /* Were jumping out of the loop, so unlock
-               the spin lock now, before jumping. */
-                nx_spinlock_unlock(&pool->lock);
-                goto done;
-            }
-        }
+/* Tag a block we just took, so it can be reclaimed if we die holding it. */
+static struct memory_block *claim_block(struct memory_block *block)
+{
+    if(pool_owner == 0)
+        pool_owner = (int32_t)getpid();
 
-        /* Unlock the spinlock. */
-        nx_spinlock_unlock(&pool->lock);
-    }
+    atomic_store_int32(&block->owner, pool_owner);
 
-done:
-    /* Return the empty block. */
     return (block);
 }
 
+static struct memory_block *default_get_shared_block(struct shared_pool *pool)
+{
+    struct memory_block *block = NULL;
+    uint32_t i;
+
+    block = take_block(pool);
+    if(block != NULL)
+        return (claim_block(block));
+
+    atomic_add_uint64(&pool->waits, 1);
+
+    /* Every block is out, wait a bounded time for one to come back. */
+    for(i = 0; i < POOL_SPINS + POOL_YIELDS; i++)
+    {
+        if(i < POOL_SPINS)
+            ck_pr_stall();
+        else
+            sched_yield();
+
+        block = take_block(pool);
+        if(block != NULL)
+            return (claim_block(block));
+    }
+
+    atomic_add_uint64(&pool->exhausted, 1);
+
+    return (NULL);
+}
+
 static void default_free_block(struct memory_block *block, struct shared_pool *pool)
 {
     if(block == NULL)
@@ -178,21 +272,125 @@ static void default_free_block(struct memory_block *block, struct shared_pool *p
         return;
     }
 
-    /* Lock the spinlock. */
-    nx_spinlock_lock(&pool->lock);
+    atomic_store_int32(&block->owner, 0);
 
-    /* Remove the block from the allocated_list. */
-    NX_SLIST_REMOVE(&pool->allocated_list, block, memory_block);
+    push_free_block(&pool->shards[pool_shard % pool->shard_count], block);
 
-    /* Add the block to the free block list. */
-    NX_SLIST_INSERT_HEAD(&pool->free_list, block);
+    return;
+}
 
-    /* Unlock the spinlock. */
-    nx_spinlock_unlock(&pool->lock);
+void set_pool_shard(uint32_t shard)
+{
+    pool_shard = shard;
+    pool_owner = (int32_t)getpid();
 
     return;
 }
 
+uint32_t reclaim_blocks(struct shared_pool *pool, int32_t pid)
+{
+    uint32_t reclaimed = 0;
+    uint64_t i;
+
+    if(pid <= 0)
+        return (0);
+
+    for(i = 0; i < pool->block_count; i++)
+    {
+        struct memory_block *block = &pool->blocks[i];
+
+        if(atomic_load_int32(&block->owner) != pid)
+            continue;
+
+        /* The owner may have died half way through rekeying the block. */
+        if(find_block(pool, block->key) != block)
+            (void)set_block_key(pool, block, block->key);
+
+        atomic_store_int32(&block->owner, 0);
+
+        /* Back onto the shard the block was dealt to. */
+        push_free_block(&pool->shards[block->index % pool->shard_count], block);
+        reclaimed++;
+    }
+
+    return (reclaimed);
+}
+
+static uint64_t hash_block_key(uint64_t key)
+{
+    /* Fibonacci hashing, descriptors and pointers are far from random. */
+    return ((key * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+/* A slot whose key moved to another slot, skipped by lookups and reused by inserts. */
+#define KEY_SLOT_DEAD UINT32_MAX
+
+int32_t set_block_key(struct shared_pool *pool, struct memory_block *block, uint64_t key)
+{
+    uint64_t mask = pool->key_slots - 1;
+    uint64_t slot = hash_block_key(block->key) & mask;
+    uint64_t i;
+
+    /* Retire the slot of the old key, the block is held by the caller so nobody
+       else can be looking it up or rekeying it. */
+    for(i = 0; i < pool->key_slots; i++, slot = (slot + 1) & mask)
+    {
+        uint32_t entry = atomic_load_uint32(&pool->key_table[slot]);
+
+        if(entry == 0)
+            break;
+
+        if(entry == block->index + 1)
+        {
+            atomic_store_uint32(&pool->key_table[slot], KEY_SLOT_DEAD);
+            break;
+        }
+    }
+
+    atomic_store_uint64(&block->key, key);
+
+    slot = hash_block_key(key) & mask;
+
+    for(i = 0; i < pool->key_slots; i++, slot = (slot + 1) & mask)
+    {
+        uint32_t entry = atomic_load_uint32(&pool->key_table[slot]);
+
+        if(entry != 0 && entry != KEY_SLOT_DEAD)
+            continue;
+
+        if(atomic_cas_uint32(&pool->key_table[slot], entry, block->index + 1))
+            return (0);
+    }
+
+    return (-1);
+}
+
+struct memory_block *find_block(struct shared_pool *pool, uint64_t key)
+{
+    uint64_t mask = pool->key_slots - 1;
+    uint64_t slot = hash_block_key(key) & mask;
+    uint64_t i;
+
+    for(i = 0; i < pool->key_slots; i++, slot = (slot + 1) & mask)
+    {
+        uint32_t entry = atomic_load_uint32(&pool->key_table[slot]);
+
+        /* Empty slots are never reused, so the key is not further along. */
+        if(entry == 0)
+            return (NULL);
+
+        if(entry == KEY_SLOT_DEAD)
+            continue;
+
+        struct memory_block *block = &pool->blocks[entry - 1];
+
+        if(atomic_load_uint64(&block->key) == key)
+            return (block);
+    }
+
+    return (NULL);
+}
+
 struct memory_allocator *get_default_allocator(void)
 {
     struct memory_allocator *allocator = NULL;
@@ -208,6 +406,282 @@ struct memory_allocator *get_default_allocator(void)
     allocator->shared_pool = &default_shared_pool_allocator;
     allocator->get_block = &default_get_shared_block;
     allocator->free_block = &default_free_block;
+    allocator->reset = &default_mem_reset;
 
     return (allocator);
 }
+
+/* Allocations from the arena are aligned to this many bytes. */
+#define ARENA_ALIGN 16
+
+struct arena
+{
+    char *base;
+    uint64_t size;
+    uint64_t offset;
+};
+
+static struct arena scratch_arena;
+
+static struct memory_allocator *arena_allocator;
+
+static void *arena_mem_alloc(uint64_t nbytes)
+{
+    if(nbytes == 0)
+        return (NULL);
+
+    uint64_t offset = scratch_arena.offset;
+    uint64_t aligned = (nbytes + (ARENA_ALIGN - 1)) & ~((uint64_t)ARENA_ALIGN - 1);
+
+    /* Out of scratch space, the caller has to handle this. */
+    if(aligned > scratch_arena.size - offset)
+        return (NULL);
+
+    scratch_arena.offset = offset + aligned;
+
+    return (scratch_arena.base + offset);
+}
+
+static void arena_mem_free(void **ptr)
+{
+    /* Arena memory is only released by reset(). */
+    (*ptr) = NULL;
+
+    return;
+}
+
+static void arena_mem_reset(void)
+{
+    scratch_arena.offset = 0;
+
+    return;
+}
+
+struct memory_allocator *get_arena_allocator(uint64_t nbytes)
+{
+    if(nbytes == 0)
+        return (NULL);
+
+    if(arena_allocator != NULL && nbytes <= scratch_arena.size)
+        return (arena_allocator);
+
+    /* Growing moves the region, so it's only safe while nothing is allocated. */
+    if(arena_allocator != NULL && scratch_arena.offset != 0)
+        return (NULL);
+
+    void *base = mmap(NULL, nbytes, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+    if(base == MAP_FAILED)
+        return (NULL);
+
+    if(arena_allocator != NULL)
+    {
+        munmap(scratch_arena.base, scratch_arena.size);
+        scratch_arena.base = base;
+        scratch_arena.size = nbytes;
+        return (arena_allocator);
+    }
+
+    arena_allocator = get_default_allocator();
+    if(arena_allocator == NULL)
+    {
+        munmap(base, nbytes);
+        return (NULL);
+    }
+
+    scratch_arena.base = base;
+    scratch_arena.size = nbytes;
+    scratch_arena.offset = 0;
+
+    /* Shared memory and pools still come from the default allocator. */
+    arena_allocator->alloc = &arena_mem_alloc;
+    arena_allocator->free = &arena_mem_free;
+    arena_allocator->reset = &arena_mem_reset;
+
+    return (arena_allocator);
+}
+
+/* Size classes of a buffer pool in pages. */
+#define BUFFER_CLASSES 3
+
+static const uint32_t buffer_class_pages[BUFFER_CLASSES] = {1, 4, 16};
+
+static const int32_t buffer_prot_flags[BUFFER_PROTS] = {
+    PROT_READ | PROT_WRITE,
+    PROT_READ,
+    PROT_WRITE
+};
+
+/* A region is one mapping laid out as [guard][data][guard][data]...[guard]. */
+struct buffer_region
+{
+    char *base;
+    uint64_t map_size;
+    uint64_t data_size;
+    uint32_t next;
+};
+
+struct buffer_pool
+{
+    uint64_t page_size;
+    uint32_t per_class;
+    /* Set when a call that can change the pages of it's buffers was handed some. */
+    uint32_t damaged;
+    struct buffer_region region[BUFFER_PROTS][BUFFER_CLASSES];
+};
+
+static void destroy_buffer_pool(struct buffer_pool *pool)
+{
+    uint32_t i, j;
+
+    for(i = 0; i < BUFFER_PROTS; i++)
+    {
+        for(j = 0; j < BUFFER_CLASSES; j++)
+        {
+            if(pool->region[i][j].base != NULL)
+                munmap(pool->region[i][j].base, pool->region[i][j].map_size);
+        }
+    }
+
+    free(pool);
+}
+
+/* Map the first count slots of a region as guard pages over the old
+   mapping, then open up their data pages. */
+static int32_t protect_buffer_slots(struct buffer_region *region, uint64_t page_size,
+                                    uint32_t count, int32_t prot)
+{
+    uint32_t i;
+    uint64_t slot_size = region->data_size + page_size;
+    uint64_t span = page_size + (slot_size * count);
+
+    void *base = mmap(region->base, span, PROT_NONE, MAP_ANON | MAP_PRIVATE | MAP_FIXED, -1, 0);
+    if(base == MAP_FAILED)
+        return (-1);
+
+    for(i = 0; i < count; i++)
+    {
+        char *data = region->base + page_size + (i * slot_size);
+
+        if(mprotect(data, region->data_size, prot) < 0)
+            return (-1);
+    }
+
+    return (0);
+}
+
+static int32_t map_buffer_region(struct buffer_region *region, uint64_t page_size,
+                                 uint32_t pages, uint32_t count, int32_t prot)
+{
+    uint64_t slot_size = (pages + 1) * page_size;
+
+    region->data_size = pages * page_size;
+    region->map_size = page_size + (slot_size * count);
+    region->next = 0;
+
+    /* Reserve the whole region, then lay the slots out in it. */
+    region->base = mmap(NULL, region->map_size, PROT_NONE, MAP_ANON | MAP_PRIVATE, -1, 0);
+    if(region->base == MAP_FAILED)
+    {
+        region->base = NULL;
+        return (-1);
+    }
+
+    return (protect_buffer_slots(region, page_size, count, prot));
+}
+
+struct buffer_pool *create_buffer_pool(uint32_t count)
+{
+    struct buffer_pool *pool = NULL;
+
+    if(count == 0)
+        return (NULL);
+
+    pool = default_mem_alloc(sizeof(struct buffer_pool));
+    if(pool == NULL)
+        return (NULL);
+
+    memset(pool, 0, sizeof(struct buffer_pool));
+
+    pool->page_size = (uint64_t)sysconf(_SC_PAGESIZE);
+
+    /* Buffers that fit the smallest class spill into the bigger ones
+       when it runs out, so together the classes hold count of them. */
+    pool->per_class = (count + BUFFER_CLASSES - 1) / BUFFER_CLASSES;
+
+    uint32_t i, j;
+
+    for(i = 0; i < BUFFER_PROTS; i++)
+    {
+        for(j = 0; j < BUFFER_CLASSES; j++)
+        {
+            if(map_buffer_region(&pool->region[i][j], pool->page_size, buffer_class_pages[j],
+                                 pool->per_class, buffer_prot_flags[i]) < 0)
+            {
+                destroy_buffer_pool(pool);
+                return (NULL);
+            }
+        }
+    }
+
+    return (pool);
+}
+
+void *get_pool_buffer(struct buffer_pool *pool, uint64_t nbytes, enum buffer_prot prot)
+{
+    uint32_t i;
+
+    if(nbytes == 0 || prot >= BUFFER_PROTS)
+        return (NULL);
+
+    /* Take the smallest class that fits and still has a free buffer. */
+    for(i = 0; i < BUFFER_CLASSES; i++)
+    {
+        struct buffer_region *region = &pool->region[prot][i];
+
+        if(nbytes > region->data_size || region->next == pool->per_class)
+            continue;
+
+        uint64_t slot_size = region->data_size + pool->page_size;
+        char *data = region->base + pool->page_size + (region->next * slot_size);
+
+        region->next++;
+
+        /* Butt the end of the buffer up against the guard page. */
+        return (data + region->data_size - nbytes);
+    }
+
+    return (NULL);
+}
+
+void damage_buffer_pool(struct buffer_pool *pool)
+{
+    pool->damaged = 1;
+}
+
+int32_t reset_buffer_pool(struct buffer_pool *pool)
+{
+    uint32_t i, j;
+    int32_t rtrn = 0;
+
+    for(i = 0; i < BUFFER_PROTS; i++)
+    {
+        for(j = 0; j < BUFFER_CLASSES; j++)
+        {
+            struct buffer_region *region = &pool->region[i][j];
+
+            if(region->next == 0)
+                continue;
+
+            /* A call may have locked, synced or bound these buffers, so map the used slots from scratch. */
+            if(pool->damaged == 1 && protect_buffer_slots(region, pool->page_size, region->next,
+                                                          buffer_prot_flags[i]) < 0)
+                rtrn = -1;
+
+            region->next = 0;
+        }
+    }
+
+    pool->damaged = 0;
+
+    return (rtrn);
+}
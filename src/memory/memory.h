@@ -19,11 +19,38 @@
 #include <stdint.h>
 #include "concurrent/concurrent.h"
 
+/* Index stored in a free list link or key slot when it points nowhere. */
+#define NX_POOL_NONE UINT32_MAX
+
 struct memory_block
 {
     void *ptr;
 
-    NX_SLIST_ENTRY(memory_block);
+    /* Position of the block in the pool's block array. */
+    uint32_t index;
+
+    /* Index of the next free block, only meaningful while the block is free. */
+    uint32_t next;
+
+    /* Value the owner of the pool finds the block by, see set_block_key(). */
+    uint64_t key;
+
+    /* Pid of the process holding the block, zero while the block is free. */
+    int32_t owner;
+};
+
+/* Upper bound on the number of shards a shared pool is split into. */
+#define NX_POOL_SHARDS 64
+
+/* One free list of a shared pool, padded so shards don't share a cache line. */
+struct pool_shard
+{
+    /* Head of the free list. The low 32 bits are the index of the first free
+       block and the high 32 bits a tag bumped on every update, so a CAS made
+       with a stale head fails even when the same index is back on top. */
+    uint64_t free_head;
+
+    char pad[CK_MD_CACHELINE - sizeof(uint64_t)];
 };
 
 struct shared_pool
@@ -31,14 +58,26 @@ struct shared_pool
     uint64_t block_size;
     uint64_t block_count;
 
-    /* Spin lock used to protect underlying data structures in the pool. */
-    ck_spinlock_t lock;
+    /* Free blocks are spread over shard_count free lists, each process mostly
+       takes and returns blocks on the shard picked with set_pool_shard(). */
+    uint32_t shard_count;
+    struct pool_shard *shards;
+
+    /* Number of blocks taken from a shard other than the caller's own. */
+    uint64_t steals;
+
+    /* Number of times get_block() found the pool empty and had to wait. */
+    uint64_t waits;
 
-    /* Shared memory list that represents the memory pool. */
-    NX_SLIST_HEAD(free_list, memory_block);
+    /* Number of times get_block() gave up waiting and returned NULL. */
+    uint64_t exhausted;
 
-    /* Shared memory list that represents the memory pool. */
-    NX_SLIST_HEAD(allocated_list, memory_block);
+    /* The blocks, laid out in the same shared mapping as the pool. */
+    struct memory_block *blocks;
+
+    /* Open addressing table of block index + 1 keyed by block key, zero is an empty slot. */
+    uint32_t *key_table;
+    uint64_t key_slots;
 };
 
 struct memory_allocator
@@ -50,14 +89,21 @@ struct memory_allocator
     struct shared_pool *(*shared_pool) (uint64_t, uint64_t);
     struct memory_block *(*get_block) (struct shared_pool *);
     void (*free_block) (struct memory_block *, struct shared_pool *pool);
+    void (*reset) (void);
 };
 
+/* Protection variants handed out by a buffer pool. */
+enum buffer_prot { BUFFER_RW, BUFFER_RO, BUFFER_WO, BUFFER_PROTS };
+
+struct buffer_pool;
+
 /**
  * Macro for initializing a shared memory pool.
  * @param A shared_pool pointer returned from allocator->shared_pool().
  * @param A memory block pointer.
  */
-#define init_shared_pool(pool, block) CK_SLIST_FOREACH(block, &pool->free_list, list_entry)
+#define init_shared_pool(pool, block) \
+    for((block) = &(pool)->blocks[0]; (block) < &(pool)->blocks[(pool)->block_count]; (block)++)
 
 /**
  * This function returns the default memory allocator interface.
@@ -66,4 +112,94 @@ struct memory_allocator
  */
 extern struct memory_allocator *get_default_allocator(void);
 
+/**
+ * Set the key a pool block is found by with find_block(), for example the
+ * descriptor it holds. Keys must be unique within a pool. Only the process
+ * holding the block may change it's key.
+ * @param pool The pool the block belongs to.
+ * @param block The block to key.
+ * @param key The key to find the block by.
+ * @return Zero on success and -1 when the key table is full.
+ */
+extern int32_t set_block_key(struct shared_pool *pool, struct memory_block *block, uint64_t key);
+
+/**
+ * Find the block with the key set by set_block_key() so it can be released
+ * without walking the pool.
+ * @param pool The pool to search.
+ * @param key The key of the block.
+ * @return The block on success and NULL when no block has the key.
+ */
+extern struct memory_block *find_block(struct shared_pool *pool, uint64_t key);
+
+/**
+ * Pick the shard of every shared pool this process takes blocks from and
+ * returns them to. Children call this with their slot so each mostly works
+ * on a free list nobody else touches. Blocks are only taken from other
+ * shards when the own shard is empty. This also records the pid blocks taken
+ * from now on are tagged with, so call it again after a fork.
+ * @param shard The shard number, wrapped to the shard count of each pool.
+ */
+extern void set_pool_shard(uint32_t shard);
+
+/**
+ * Return every block held by a dead process to the pool. Only call this once
+ * the process is gone, a live owner could still be using the blocks.
+ * @param pool The pool to scan.
+ * @param pid The pid of the dead process.
+ * @return The number of blocks returned.
+ */
+extern uint32_t reclaim_blocks(struct shared_pool *pool, int32_t pid);
+
+/**
+ * This function returns an arena allocator for short lived scratch memory.
+ * alloc() bumps a pointer into a private region of nbytes, free() is a no-op
+ * and reset() releases every allocation at once. The region is private so each
+ * child process forked after this call works on its own copy of the arena.
+ * There is one arena per process, calling this again returns the same arena,
+ * grown to nbytes if it was smaller. Growing fails while anything is allocated.
+ * @param nbytes The minimum size of the arena region.
+ * @return The arena allocator on success and NULL on failure.
+ */
+extern struct memory_allocator *get_arena_allocator(uint64_t nbytes);
+
+/**
+ * Create a pool of pre-mapped buffers in a few page sized size classes for
+ * each protection variant. Every buffer is followed by a guard page so an
+ * access past the end faults. Mapping is done here, handing out buffers
+ * afterwards costs no syscalls.
+ * @param count The number of single page buffers of each protection the pool
+ * must hand out between resets.
+ * @return A buffer pool on success and NULL on failure.
+ */
+extern struct buffer_pool *create_buffer_pool(uint32_t count);
+
+/**
+ * Get a buffer of nbytes with the protection prot from the pool. The buffer
+ * is placed so that it ends right at a guard page. The buffer stays valid
+ * until the pool is reset.
+ * @param pool The pool to take the buffer from.
+ * @param nbytes The size of the buffer.
+ * @param prot The protection the buffer is mapped with.
+ * @return A buffer on success and NULL when the pool is exhausted.
+ */
+extern void *get_pool_buffer(struct buffer_pool *pool, uint64_t nbytes, enum buffer_prot prot);
+
+/**
+ * Note that buffers of the pool went to a call that can change their pages,
+ * like a lock or a memory policy, so the next reset maps them again.
+ * @param pool The pool handing out the buffers.
+ */
+extern void damage_buffer_pool(struct buffer_pool *pool);
+
+/**
+ * Return every buffer handed out by the pool back to it. This costs no
+ * syscalls, unless damage_buffer_pool() was called since the last reset.
+ * Then the buffers that were handed out are mapped again first, so the
+ * damage done to them is undone.
+ * @param pool The pool to reset.
+ * @return Zero on success and -1 when a buffer couldn't be mapped again.
+ */
+extern int32_t reset_buffer_pool(struct buffer_pool *pool);
+
 #endif
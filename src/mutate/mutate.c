@@ -23,6 +23,10 @@ static struct random_generator *random_gen;
 int32_t mutate_buffer(void **ptr, uint64_t len)
 {
     char *buf = (*ptr);
+
+    if(len < 3)
+        return (-1);
+
     buf[2] = 'c';
 
 	return (0);
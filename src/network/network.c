@@ -128,6 +128,14 @@ static int32_t setup_socket_server(int32_t *sockFd4, int *sockFd6)
         return (-1);
     }
 
+    /* Listen before the accept threads start, so connections made
+       right after start_socket_server() returns aren't refused. */
+    if(listen((*sockFd4), 10000) < 0 || listen((*sockFd6), 10000) < 0)
+    {
+        printf("listen: %s\n", strerror(errno));
+        return (-1);
+    }
+
     return (0);
 }
 
@@ -31,11 +31,28 @@
 #include "runtime/platform.h"
 #include "utils/utils.h"
 #include "utils/autofree.h"
+#include "utils/autoclose.h"
 
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#ifdef LINUX
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/prctl.h>
+#endif
 
 static struct memory_allocator *allocator;
 static struct output_writter *output;
@@ -47,6 +64,73 @@ static struct shared_pool *desc_pool;
 static struct shared_pool *dirpath_pool;
 static struct shared_pool *file_pool;
 static struct shared_pool *socket_pool;
+static struct shared_pool *pid_pool;
+
+/* Number of sacrificial processes kept in the pid pool. */
+static const uint32_t PID_POOL_SIZE = 32;
+
+/* Number of blocks in the descriptor and socket pools, see size_fd_pools(). */
+static uint32_t fd_pool_size;
+
+/* How often the maintainer thread sweeps the pools, in milliseconds. */
+static const uint32_t MAINTAIN_INTERVAL = 250;
+
+/* Status flags children set on pooled descriptors that make most calls fail or return early. */
+static const int32_t BAD_DESC_FLAGS = O_NONBLOCK | O_APPEND | O_ASYNC;
+
+static pthread_t maintainer;
+static uint32_t maintainer_running;
+static uint32_t maintainer_stop;
+
+/* Resources repaired or replaced by the maintainer, per type. */
+static uint64_t replacements[RSRC_TYPES];
+
+/* Fork a process that does nothing but wait to be used as a pid argument. */
+static int32_t spawn_sacrificial_process(void)
+{
+    pid_t parent = getpid();
+
+    pid_t pid = fork();
+    if(pid == 0)
+    {
+#ifdef LINUX
+        /* Don't outlive the process that created us. If it died before
+           the death signal was set up, we were already reparented. */
+        (void)prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if(getppid() != parent)
+            _exit(0);
+#endif
+        while(1)
+            pause();
+    }
+    else if(pid < 0)
+    {
+        output->write(ERROR, "Can't create sacrificial process: %s\n", strerror(errno));
+        return (-1);
+    }
+
+    return ((int32_t)pid);
+}
+
+/* Fill a descriptor with up to 4k of junk so reads don't just hit EOF. */
+static int32_t fill_with_junk(int32_t fd)
+{
+    uint32_t size = 0;
+    char *junk auto_free = NULL;
+
+    if(random_gen->range(4095, &size) < 0)
+        return (-1);
+
+    size++;
+
+    if(random_gen->bytes(&junk, size) < 0)
+        return (-1);
+
+    if(pwrite(fd, junk, size, 0) < 0)
+        return (-1);
+
+    return (0);
+}
 
 static char *get_dirpath_nocached(void)
 {
@@ -145,6 +229,23 @@ static int32_t get_desc_nocached(void)
     return (fd);
 }
 
+static int32_t get_pid_nocached(void)
+{
+    return (spawn_sacrificial_process());
+}
+
+static int32_t free_pid_nocached(int32_t *pid)
+{
+    if(kill((pid_t)(*pid), SIGKILL) < 0)
+        return (-1);
+
+    /* Reap it if it's our child so it doesn't linger as a zombie that kill(pid, 0)
+       still finds. Anybody else's child is reaped by it's parent. */
+    (void)waitpid((pid_t)(*pid), NULL, 0);
+
+    return (0);
+}
+
 static int32_t free_filepath_nocached(char **path)
 {
     if((*path) == NULL)
@@ -206,31 +307,30 @@ static int32_t free_desc_nocached(int32_t *fd)
     return (close((*fd)));
 }
 
-static int32_t free_filepath_cached(char **path)
+/* Hand the block holding the resource keyed by key back to pool. */
+static int32_t release_resource(struct shared_pool *pool, uint64_t key)
 {
-    /* Declare a memory block pointer. */
     struct memory_block *m_blk = NULL;
 
-    /* Loop and find the resource */
-    NX_SLIST_FOREACH(m_blk, &file_pool->allocated_list)
+    /* The block is found through the pool's key table, no list walk. */
+    m_blk = find_block(pool, key);
+    if(m_blk == NULL)
     {
-        /* Get resource pointer. */
-        struct resource_ctx *resource = (struct resource_ctx *)m_blk->ptr;
-
-        /* Get the filepath pointer. */
-        char *filepath = (char *)resource->ptr;
-
-        /* If the filepaths match, free the memory block.*/
-        if(memcmp((*path), filepath, strlen(filepath)) == 0)
-        {
-            allocator->free_block(m_blk, file_pool);
-            break;
-        }
+        output->write(ERROR, "Resource is not from the pool\n");
+        return (-1);
     }
 
+    allocator->free_block(m_blk, pool);
+
     return (0);
 }
 
+static int32_t free_filepath_cached(char **path)
+{
+    /* Paths are keyed by the address of the shared copy handed out. */
+    return (release_resource(file_pool, (uint64_t)(uintptr_t)(*path)));
+}
+
 // static int32_t free_mountpath_cached(char **path)
 // {
 //     /* Declare a memory block pointer. */
@@ -258,75 +358,46 @@ static int32_t free_filepath_cached(char **path)
 
 static int32_t free_dirpath_cached(char **path)
 {
-    /* Declare a memory block pointer. */
-    struct memory_block *m_blk = NULL;
-
-    /* Loop and find the resource */
-    NX_SLIST_FOREACH(m_blk, &dirpath_pool->allocated_list)
-    {
-        /* Get resource pointer. */
-        struct resource_ctx *resource = (struct resource_ctx *)m_blk->ptr;
+    return (release_resource(dirpath_pool, (uint64_t)(uintptr_t)(*path)));
+}
 
-        /* Get the dirpath pointer. */
-        char *dirpath = (char *)resource->ptr;
+static int32_t free_socket_cached(int32_t *sock_fd)
+{
+    return (release_resource(socket_pool, (uint64_t)(*sock_fd)));
+}
 
-        /* If the dirpaths match, free the memory block.*/
-        if(strcmp((*path), dirpath) == 0)
-        {
-            allocator->free_block(m_blk, dirpath_pool);
-            break;
-        }
-    }
+static int32_t free_desc_cached(int32_t *fd)
+{
+    return (release_resource(desc_pool, (uint64_t)(*fd)));
+}
 
-    return (0);
+static int32_t free_pid_cached(int32_t *pid)
+{
+    /* The process is left running for the next user. */
+    return (release_resource(pid_pool, (uint64_t)(*pid)));
 }
 
-static int32_t free_socket_cached(int32_t *sock_fd)
+/* Path pools only generate names up front, the file or directory
+   itself is created by whoever needs it first. */
+static int32_t build_filepath(struct resource_ctx *resource)
 {
-    /* Declare a memory block pointer. */
-    struct memory_block *m_blk = NULL;
+    int32_t fd auto_close = open((char *)resource->ptr, O_RDWR | O_CREAT, 0777);
+    if(fd < 0)
+        return (-1);
 
-    /* Loop and find the resource */
-    NX_SLIST_FOREACH(m_blk, &socket_pool->allocated_list)
-    {
-        /* Get resource pointer. */
-        struct resource_ctx *resource = (struct resource_ctx *)m_blk->ptr;
+    (void)fill_with_junk(fd);
 
-        /* Get the socket pointer. */
-        int32_t *sock = (int32_t *)resource->ptr;
-
-        /* If the descriptors match, free the memory block.*/
-        if((*sock) == (*sock_fd))
-        {
-            allocator->free_block(m_blk, socket_pool);
-            break;
-        }
-    }
+    atomic_store_uint32(&resource->ready, 1);
 
     return (0);
 }
 
-static int32_t free_desc_cached(int32_t *fd)
+static int32_t build_dirpath(struct resource_ctx *resource)
 {
-    /* Declare a memory block pointer. */
-    struct memory_block *m_blk = NULL;
-
-    /* Loop and find the resource */
-    NX_SLIST_FOREACH(m_blk, &desc_pool->allocated_list)
-    {
-        /* Get resource pointer. */
-        struct resource_ctx *resource = (struct resource_ctx *)m_blk->ptr;
+    if(mkdir((char *)resource->ptr, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) < 0 && errno != EEXIST)
+        return (-1);
 
-        /* Get the descriptor pointer. */
-        int32_t *desc = (int32_t *)resource->ptr;
-
-        /* If the descriptors match, free the memory block.*/
-        if((*fd) == (*desc))
-        {
-            allocator->free_block(m_blk, desc_pool);
-            break;
-        }
-    }
+    atomic_store_uint32(&resource->ready, 1);
 
     return (0);
 }
@@ -347,6 +418,13 @@ static char *get_dirpath_cached(void)
     /* Get resource pointer. */
     struct resource_ctx *resource = (struct resource_ctx *)m_blk->ptr;
 
+    if(atomic_load_uint32(&resource->ready) == 0 && build_dirpath(resource) < 0)
+    {
+        output->write(ERROR, "Can't create directory: %s\n", strerror(errno));
+        allocator->free_block(m_blk, dirpath_pool);
+        return (NULL);
+    }
+
     /* Set fd to the descriptor we grabbed from the pool. */
     path = (char *)resource->ptr;
 
@@ -369,11 +447,17 @@ static char *get_filepath_cached(void)
     /* Get resource pointer. */
     struct resource_ctx *resource = (struct resource_ctx *)m_blk->ptr;
 
+    if(atomic_load_uint32(&resource->ready) == 0 && build_filepath(resource) < 0)
+    {
+        output->write(ERROR, "Can't create file: %s\n", strerror(errno));
+        allocator->free_block(m_blk, file_pool);
+        return (NULL);
+    }
+
     /* Set fd to the descriptor we grabbed from the pool. */
     path = (char *)resource->ptr;
 
     return (path);
-
 }
 
 // static char *get_mountpath_cached(void)
@@ -397,6 +481,98 @@ static char *get_filepath_cached(void)
 //     return (path);
 // }
 
+/* Open a descriptor for the descriptor pool. */
+static int32_t open_pool_desc(char *path)
+{
+    int32_t fd = -1;
+
+#if defined(LINUX) && defined(SYS_memfd_create)
+    /* A memfd costs two syscalls instead of creating and mapping a file. */
+    fd = (int32_t)syscall(SYS_memfd_create, "nextgen", 0);
+    if(fd >= 0)
+    {
+        (void)fill_with_junk(fd);
+        return (fd);
+    }
+#endif
+
+    uint64_t size = 0;
+    char *file_path auto_free = NULL;
+
+    /* Create a random file in path. */
+    if(create_random_file(path, ".txt", &file_path, &size) < 0)
+        return (-1);
+
+    /* Open newly created file.  */
+    fd = open(file_path, O_RDWR, 0777);
+    if(fd < 0)
+    {
+        printf("Can't open newly created file: %s\n", strerror(errno));
+        return (-1);
+    }
+
+    return (fd);
+}
+
+/* Put a fresh descriptor on the number of a broken pooled one, in this
+   process only. Returns zero on success and -1 on failure. */
+static int32_t replace_pooled_desc(int32_t fd, int32_t replacement)
+{
+    if(replacement < 0)
+        return (-1);
+
+    /* A closed number is the lowest free one, so it's often reused right away. */
+    if(replacement == fd)
+        return (0);
+
+    if(dup2(replacement, fd) < 0)
+    {
+        close(replacement);
+        return (-1);
+    }
+
+    close(replacement);
+
+    return (0);
+}
+
+/* The maintainer only sees the supervisor's descriptor table. A child that
+   closed a pooled descriptor, or put something else on it's number with
+   dup2() or by reusing it, would keep it broken for the rest of it's life,
+   so every descriptor is checked here in the child when it's handed out. */
+static void check_pooled_desc(int32_t fd)
+{
+    struct stat sb;
+
+    if(fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode) != 0)
+        return;
+
+    if(replace_pooled_desc(fd, open_pool_desc("/tmp")) < 0)
+        output->write(ERROR, "Can't replace pooled descriptor %d\n", fd);
+
+    return;
+}
+
+static void check_pooled_socket(int32_t sock)
+{
+    int32_t error = 0;
+    socklen_t len = sizeof(int32_t);
+
+    /* Fails when the number is closed or isn't a socket any more. */
+    if(getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &len) == 0 && error == 0)
+        return;
+
+    int32_t replacement = -1;
+
+    if(connect_ipv6(&replacement) < 0)
+        replacement = -1;
+
+    if(replace_pooled_desc(sock, replacement) < 0)
+        output->write(ERROR, "Can't replace pooled socket %d\n", sock);
+
+    return;
+}
+
 static int32_t get_socket_cached(void)
 {
     int32_t *sock = NULL;
@@ -416,6 +592,8 @@ static int32_t get_socket_cached(void)
     /* Set fd to the descriptor we grabbed from the pool. */
     sock = (int32_t *)resource->ptr;
 
+    check_pooled_socket(*sock);
+
     return ((*sock));
 }
 
@@ -438,27 +616,85 @@ static int32_t get_desc_cached(void)
     /* Set fd to the descriptor we grabbed from the pool. */
     fd = (int32_t *)resource->ptr;
 
+    check_pooled_desc(*fd);
+
     return (*fd);
 }
 
-static int32_t init_resource_ctx(struct resource_ctx **resource, uint32_t size)
+static int32_t get_pid_cached(void)
 {
-    /* Allocate a resource context struct as shared memory. */
-    (*resource) = allocator->shared(sizeof(struct resource_ctx));
-    if((*resource) == NULL)
+    int32_t *pid = NULL;
+    struct memory_block *m_blk = NULL;
+
+    /* Grab a shared memory block from the pid pool. */
+    m_blk = allocator->get_block(pid_pool);
+    if(m_blk == NULL)
     {
-        printf("Can't allocate resource context\n");
+        printf("Can't get shared block\n");
         return (-1);
     }
 
-    (*resource)->ptr = allocator->shared(size);
-    if((*resource)->ptr == NULL)
+    /* Get resource pointer. */
+    struct resource_ctx *resource = (struct resource_ctx *)m_blk->ptr;
+
+    pid = (int32_t *)resource->ptr;
+
+    int32_t current = atomic_load_int32(pid);
+
+    /* The supervisor replaced the process since the block was last handed out,
+       rekey it now that we hold it so the release finds it by the new pid. */
+    if((uint64_t)current != m_blk->key)
     {
-        printf("Can't alloc resource pointer\n");
-        return (-1);
+        if(set_block_key(pid_pool, m_blk, (uint64_t)current) < 0)
+            output->write(ERROR, "Can't rekey pid block\n");
     }
 
-    return (0);
+    return (current);
+}
+
+int32_t replace_sacrificial_process(int32_t pid)
+{
+    if(pid_pool == NULL || pid <= 0)
+        return (0);
+
+    struct memory_block *m_blk = find_block(pid_pool, (uint64_t)pid);
+    if(m_blk == NULL)
+        return (0);
+
+    int32_t *current = (int32_t *)((struct resource_ctx *)m_blk->ptr)->ptr;
+
+    /* An older process of the block that was already replaced. */
+    if(atomic_load_int32(current) != pid)
+        return (0);
+
+    /* A child may hold the block right now, so only the pid is swapped here.
+       The key stays on the dead pid until the next child to take the block rekeys it. */
+    int32_t replacement = spawn_sacrificial_process();
+    if(replacement < 0)
+        return (-1);
+
+    atomic_store_int32(current, replacement);
+
+    return (1);
+}
+
+/* Size of a pool block holding a resource context followed by size bytes of payload. */
+static uint64_t resource_block_size(uint64_t size)
+{
+    return ((sizeof(struct resource_ctx) + size + 15) & ~(uint64_t)15);
+}
+
+static struct resource_ctx *init_resource_ctx(struct memory_block *m_blk)
+{
+    /* The context and it's payload live in the block's slot of the pool's
+       data mapping, so building a pool costs no mapping per block. */
+    struct resource_ctx *resource = (struct resource_ctx *)m_blk->ptr;
+
+    resource->m_blk = m_blk;
+    resource->ptr = resource + 1;
+    resource->ready = 1;
+
+    return (resource);
 }
 
 static struct shared_pool *create_fd_pool(char *path)
@@ -467,7 +703,7 @@ static struct shared_pool *create_fd_pool(char *path)
     struct memory_block *m_blk = NULL;
     struct shared_pool *pool = NULL;
 
-    pool = allocator->shared_pool(sizeof(int32_t *), POOL_SIZE);
+    pool = allocator->shared_pool(fd_pool_size, resource_block_size(sizeof(int32_t)));
     if(pool == NULL)
     {
         printf("Can't allocate descriptor memory pool\n");
@@ -477,45 +713,25 @@ static struct shared_pool *create_fd_pool(char *path)
     /* Create a bunch of file descriptors and stick them into the resource pool. */
     init_shared_pool(pool, m_blk)
     {
-        uint64_t size = 0;
-
-        /* Don't free that will be taken cared off later. */
-        struct resource_ctx *resource = NULL;
-
-        /* Declare a auto free pointer for storing the filepath. */
-        char *file_path auto_free = NULL;
+        struct resource_ctx *resource = init_resource_ctx(m_blk);
 
-        /* Create a resource context. */
-        rtrn = init_resource_ctx(&resource, sizeof(int32_t));
-        if(rtrn < 0)
-        {
-            printf("Can't initialize resource context\n");
-            return (NULL);
-        }
-
-        /* Create a random file in temp. */
-        rtrn = create_random_file(path, ".txt", &file_path, &size);
-        if(rtrn < 0)
-        {
-            printf("Can't create random file\n");
-            return (NULL);
-        }
-
-        /* Open newly created file.  */
-        int32_t fd = open(file_path, O_RDWR, 0777);
+        int32_t fd = open_pool_desc(path);
         if(fd < 0)
         {
-            printf("Can't open newly created file: %s\n",
-                   strerror(errno));
+            printf("Can't create pool descriptor\n");
             return (NULL);
         }
 
         /* Move fd to shared memory. */
         memmove(resource->ptr, &fd, sizeof(int32_t));
 
-        resource->m_blk = m_blk;
-
-        m_blk->ptr = resource;
+        /* Key the block by the resource so it can be released in constant time. */
+        rtrn = set_block_key(pool, m_blk, (uint64_t)fd);
+        if(rtrn < 0)
+        {
+            printf("Can't key resource block\n");
+            return (NULL);
+        }
     }
 
     return (pool);
@@ -528,46 +744,43 @@ static struct shared_pool *create_file_pool(char *path)
     struct shared_pool *pool = NULL;
 
     /* Create shared memory pool. */
-    pool = allocator->shared_pool(sizeof(char *), POOL_SIZE);
+    pool = allocator->shared_pool(POOL_SIZE, resource_block_size(PATH_MAX + 1));
     if(pool == NULL)
     {
         printf("Can't allocate file path memory pool\n");
         return (NULL);
     }
 
-    /* Initialize shared pool with file paths. */
+    /* Initialize shared pool with file paths, the files are created on first use. */
     init_shared_pool(pool, m_blk)
     {
-        uint64_t file_size = 0;
-
-        /* Don't free, that will be taken cared off later. */
-        char *file_path = NULL;
-        struct resource_ctx *resource = NULL;
+        char *file_name auto_free = NULL;
+        struct resource_ctx *resource = init_resource_ctx(m_blk);
 
-        /* Initialize resource context. */
-        rtrn = init_resource_ctx(&resource, PATH_MAX + 1);
+        rtrn = generate_file_name(&file_name, "txt");
         if(rtrn < 0)
         {
-            printf("Initialize resource context\n");
+            printf("Can't generate file name\n");
             return (NULL);
         }
 
-        /* Create random file in /tmp. */
-        rtrn = create_random_file(path, ".txt", &file_path, &file_size);
-        if(rtrn < 0)
+        /* Write the file path to shared memory. */
+        rtrn = snprintf((char *)resource->ptr, PATH_MAX + 1, "%s/%s", path, file_name);
+        if(rtrn < 0 || rtrn > PATH_MAX)
         {
-            printf("Can't create random file\n");
+            printf("File path is too long\n");
             return (NULL);
         }
 
-        /* Move file path to shared memory. */
-        memmove(resource->ptr, file_path, strlen(file_path));
-
-        /* Set memory block pointer. */
-        resource->m_blk = m_blk;
+        resource->ready = 0;
 
-        /* Set resource pointer. */
-        m_blk->ptr = resource;
+        /* Key the block by the resource so it can be released in constant time. */
+        rtrn = set_block_key(pool, m_blk, (uint64_t)(uintptr_t)resource->ptr);
+        if(rtrn < 0)
+        {
+            printf("Can't key resource block\n");
+            return (NULL);
+        }
     }
 
     return (pool);
@@ -626,7 +839,7 @@ static struct shared_pool *create_dirpath_pool(char *path)
 {
     struct shared_pool *pool = NULL;
 
-    pool = allocator->shared_pool(sizeof(char *), POOL_SIZE);
+    pool = allocator->shared_pool(POOL_SIZE, resource_block_size(PATH_MAX + 1));
     if(pool == NULL)
     {
         printf("Can't allocate dir path memory pool\n");
@@ -636,29 +849,14 @@ static struct shared_pool *create_dirpath_pool(char *path)
     int32_t rtrn = 0;
     struct memory_block *m_blk = NULL;
 
-    NX_SLIST_FOREACH(m_blk, &pool->free_list)
+    /* Only the paths are generated here, the directories are created on first use. */
+    init_shared_pool(pool, m_blk)
     {
         /* Temp variable that we define with auto_clean so that we
         don't have to worry about calling free. */
         char *dir_name auto_free = NULL;
 
-        /* Don't free, that will be taken cared of later. */
-        char *dir_path = NULL;
-        struct resource_ctx *resource = NULL;
-
-        resource = allocator->shared(sizeof(struct resource_ctx));
-        if(resource == NULL)
-        {
-            printf("Can't alloc resource object\n");
-            return (NULL);
-        }
-
-        resource->ptr = allocator->shared(PATH_MAX + 1);
-        if(resource->ptr == NULL)
-        {
-            printf("Can't alloc resource pointer\n");
-            return (NULL);
-        }
+        struct resource_ctx *resource = init_resource_ctx(m_blk);
 
         /* Use generate_name to create a random directory name.  */
         rtrn = generate_directory_name((char **)&dir_name);
@@ -669,18 +867,22 @@ static struct shared_pool *create_dirpath_pool(char *path)
         }
 
         /* Join the dir name with the temp path. */
-        rtrn = asprintf(&dir_path, "%s/%s", path, dir_name);
-        if(rtrn < 0)
+        rtrn = snprintf((char *)resource->ptr, PATH_MAX + 1, "%s/%s", path, dir_name);
+        if(rtrn < 0 || rtrn > PATH_MAX)
         {
-            printf("Can't join paths: %s\n", strerror(errno));
+            printf("Directory path is too long\n");
             return (NULL);
         }
 
-        memmove(resource->ptr, dir_path, strlen(dir_path));
+        resource->ready = 0;
 
-        resource->m_blk = m_blk;
-
-        m_blk->ptr = resource;
+        /* Key the block by the resource so it can be released in constant time. */
+        rtrn = set_block_key(pool, m_blk, (uint64_t)(uintptr_t)resource->ptr);
+        if(rtrn < 0)
+        {
+            printf("Can't key resource block\n");
+            return (NULL);
+        }
     }
 
     return (pool);
@@ -718,7 +920,7 @@ static struct shared_pool *create_dirpath_pool(char *path)
 //
 //     struct memory_block *m_blk = NULL;
 //
-//     NX_SLIST_FOREACH(m_blk, &pool->free_list)
+//     init_shared_pool(pool, m_blk)
 //     {
 //         struct resource_ctx *resource = (struct resource_ctx *)m_blk->ptr;
 //
@@ -781,7 +983,7 @@ static struct shared_pool *create_socket_pool(void)
 {
     struct shared_pool *pool = NULL;
 
-    pool = allocator->shared_pool(sizeof(int32_t), POOL_SIZE);
+    pool = allocator->shared_pool(fd_pool_size, resource_block_size(sizeof(int32_t)));
     if(pool == NULL)
     {
         printf("Can't allocate socket memory pool\n");
@@ -791,47 +993,142 @@ static struct shared_pool *create_socket_pool(void)
     int32_t rtrn = 0;
     struct memory_block *m_blk = NULL;
 
-    NX_SLIST_FOREACH(m_blk, &pool->free_list)
+    init_shared_pool(pool, m_blk)
     {
-        int32_t *sock = NULL;
+        int32_t sock = 0;
+
+        struct resource_ctx *resource = init_resource_ctx(m_blk);
 
-        struct resource_ctx *resource = NULL;
+        rtrn = connect_ipv6(&sock);
+        if(rtrn < 0)
+        {
+            printf("Can't create socket\n");
+            return (NULL);
+        }
+
+        memmove(resource->ptr, &sock, sizeof(int32_t));
 
-        /* Initialize resource context. */
-        rtrn = init_resource_ctx(&resource, sizeof(int32_t));
+        /* Key the block by the resource so it can be released in constant time. */
+        rtrn = set_block_key(pool, m_blk, (uint64_t)sock);
         if(rtrn < 0)
         {
-            printf("Initialize resource context\n");
+            printf("Can't key resource block\n");
             return (NULL);
         }
+    }
+
+    return (pool);
+}
+
+static struct shared_pool *create_pid_pool(void)
+{
+    struct shared_pool *pool = NULL;
+
+    pool = allocator->shared_pool(PID_POOL_SIZE, resource_block_size(sizeof(int32_t)));
+    if(pool == NULL)
+    {
+        printf("Can't allocate pid memory pool\n");
+        return (NULL);
+    }
+
+    int32_t rtrn = 0;
+    struct memory_block *m_blk = NULL;
+
+    init_shared_pool(pool, m_blk)
+    {
+        struct resource_ctx *resource = init_resource_ctx(m_blk);
 
-        sock = allocator->alloc(sizeof(int32_t));
-        if(sock == NULL)
+        int32_t pid = spawn_sacrificial_process();
+        if(pid < 0)
         {
-            printf("Can't allocate socket\n");
+            printf("Can't create sacrificial process\n");
             return (NULL);
         }
 
-        rtrn = connect_ipv6(sock);
+        memmove(resource->ptr, &pid, sizeof(int32_t));
+
+        /* Key the block by the resource so it can be released in constant time. */
+        rtrn = set_block_key(pool, m_blk, (uint64_t)pid);
         if(rtrn < 0)
         {
-            printf("Can't create socket\n");
-            allocator->free((void **)&sock);
+            printf("Can't key resource block\n");
             return (NULL);
         }
+    }
+
+    return (pool);
+}
+
+/* Descriptors the fuzzer, the fuzzed calls and the socket server need beside the pools. */
+static const uint32_t FD_RESERVE = 256;
+
+/* The descriptor and socket pools each hold one descriptor per block. The fork
+   server waits with pselect(), so every descriptor has to stay below FD_SETSIZE. */
+static void size_fd_pools(void)
+{
+    struct rlimit limit;
+    uint64_t budget = FD_SETSIZE;
+
+    if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur < budget)
+        budget = limit.rlim_cur;
 
-        memmove(resource->ptr, sock, sizeof(int32_t));
+    fd_pool_size = POOL_SIZE;
 
-        resource->m_blk = m_blk;
+    if(budget < (uint64_t)FD_RESERVE + 2)
+        fd_pool_size = 1;
+    else if(budget - FD_RESERVE < (uint64_t)POOL_SIZE * 2)
+        fd_pool_size = (uint32_t)((budget - FD_RESERVE) / 2);
+
+    return;
+}
+
+/* A pool built on it's own thread and how long that took. */
+struct pool_builder
+{
+    enum rsrc_type type;
+    struct shared_pool *pool;
+    uint64_t elapsed;
+    pthread_t thread;
+    int32_t started;
+};
+
+static void *build_pool(void *arg)
+{
+    struct pool_builder *builder = (struct pool_builder *)arg;
+    uint64_t start = get_time_ns();
+
+    switch(builder->type)
+    {
+        case RSRC_DESC:
+            builder->pool = create_fd_pool("/tmp");
+            break;
+
+        case RSRC_FILE:
+            builder->pool = create_file_pool("/tmp");
+            break;
+
+        case RSRC_DIR:
+            builder->pool = create_dirpath_pool("/tmp");
+            break;
 
-        m_blk->ptr = resource;
+        case RSRC_SOCKET:
+            builder->pool = create_socket_pool();
+            break;
+
+        default:
+            break;
     }
 
-    return (pool);
+    builder->elapsed = get_time_ns() - start;
+
+    return (NULL);
 }
 
 static int32_t create_resource_pools(void)
 {
+    uint64_t start = get_time_ns();
+    uint32_t i;
+
     int32_t rtrn = start_socket_server();
     if(rtrn < 0)
     {
@@ -839,37 +1136,365 @@ static int32_t create_resource_pools(void)
         return (-1);
     }
 
-    desc_pool = create_fd_pool("/tmp");
+    size_fd_pools();
+
+    struct pool_builder builders[RSRC_TYPES];
+
+    memset(builders, 0, sizeof(builders));
+
+    /* The pools don't depend on each other, build them all at once. */
+    for(i = 0; i < RSRC_TYPES; i++)
+    {
+        builders[i].type = (enum rsrc_type)i;
+
+        if(pthread_create(&builders[i].thread, NULL, build_pool, &builders[i]) == 0)
+            builders[i].started = 1;
+        else
+            (void)build_pool(&builders[i]);
+    }
+
+    /* Sacrificial processes die with the thread that forked
+       them, so they are spawned from this one. */
+    uint64_t pid_start = get_time_ns();
+
+    pid_pool = create_pid_pool();
+
+    uint64_t pid_elapsed = get_time_ns() - pid_start;
+
+    for(i = 0; i < RSRC_TYPES; i++)
+    {
+        if(builders[i].started == 1)
+            (void)pthread_join(builders[i].thread, NULL);
+    }
+
+    desc_pool = builders[RSRC_DESC].pool;
     if(desc_pool == NULL)
     {
         output->write(ERROR, "Failed to create fd pool\n");
         return (-1);
     }
 
-    file_pool = create_file_pool("/tmp");
+    file_pool = builders[RSRC_FILE].pool;
     if(file_pool == NULL)
     {
         output->write(ERROR, "Failed to create file pool\n");
         return (-1);
     }
 
-    dirpath_pool = create_dirpath_pool("/tmp");
+    dirpath_pool = builders[RSRC_DIR].pool;
     if(dirpath_pool == NULL)
     {
         output->write(ERROR, "Failed to create dirpath pool\n");
         return (-1);
     }
 
-    socket_pool = create_socket_pool();
+    socket_pool = builders[RSRC_SOCKET].pool;
     if(socket_pool == NULL)
     {
         output->write(ERROR, "Failed to create socket pool\n");
         return (-1);
     }
 
+    if(pid_pool == NULL)
+    {
+        output->write(ERROR, "Failed to create pid pool\n");
+        return (-1);
+    }
+
+    output->write(STD, "Resource pools built in %llu ms: descriptors %llu ms, files %llu ms, dirs %llu ms, sockets %llu ms, pids %llu ms\n",
+                  (unsigned long long)((get_time_ns() - start) / 1000000),
+                  (unsigned long long)(builders[RSRC_DESC].elapsed / 1000000),
+                  (unsigned long long)(builders[RSRC_FILE].elapsed / 1000000),
+                  (unsigned long long)(builders[RSRC_DIR].elapsed / 1000000),
+                  (unsigned long long)(builders[RSRC_SOCKET].elapsed / 1000000),
+                  (unsigned long long)(pid_elapsed / 1000000));
+
     return (0);
 }
 
+/* Children share the open file description with us, so repairs made here
+   are seen by every child right away. */
+static int32_t check_desc(int32_t fd)
+{
+    int32_t repaired = 0;
+    struct stat sb;
+
+    if(fstat(fd, &sb) < 0)
+        return (0);
+
+    int32_t flags = fcntl(fd, F_GETFL);
+    if(flags >= 0 && (flags & BAD_DESC_FLAGS) != 0)
+    {
+        (void)fcntl(fd, F_SETFL, flags & ~BAD_DESC_FLAGS);
+        repaired = 1;
+    }
+
+    if(sb.st_size == 0)
+    {
+        (void)fill_with_junk(fd);
+        repaired = 1;
+    }
+
+    /* The offset is shared too, rewind it so reads return data again. */
+    if(lseek(fd, 0, SEEK_CUR) >= sb.st_size && sb.st_size > 0)
+    {
+        (void)lseek(fd, 0, SEEK_SET);
+        repaired = 1;
+    }
+
+    return (repaired);
+}
+
+static int32_t check_filepath(const char *path)
+{
+    struct stat sb;
+
+    if(stat(path, &sb) == 0)
+    {
+        if(S_ISREG(sb.st_mode) == 0)
+            return (0);
+
+        /* Put back the permissions of a file a child chmod'ed. */
+        if((sb.st_mode & (S_IRUSR | S_IWUSR)) != (S_IRUSR | S_IWUSR))
+        {
+            (void)chmod(path, 0777);
+            return (1);
+        }
+
+        return (0);
+    }
+
+    if(errno != ENOENT)
+        return (0);
+
+    /* A child unlinked or renamed it, recreate it with fresh contents. */
+    int32_t fd auto_close = open(path, O_RDWR | O_CREAT | O_TRUNC, 0777);
+    if(fd < 0)
+        return (0);
+
+    (void)fill_with_junk(fd);
+
+    return (1);
+}
+
+static int32_t check_dirpath(const char *path)
+{
+    struct stat sb;
+
+    if(stat(path, &sb) == 0)
+    {
+        if(S_ISDIR(sb.st_mode) == 0)
+            return (0);
+
+        if((sb.st_mode & S_IRWXU) != S_IRWXU)
+        {
+            (void)chmod(path, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+            return (1);
+        }
+
+        return (0);
+    }
+
+    if(errno != ENOENT)
+        return (0);
+
+    if(mkdir(path, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) < 0)
+        return (0);
+
+    return (1);
+}
+
+static int32_t check_socket(int32_t sock)
+{
+    int32_t error = 0;
+    socklen_t len = sizeof(int32_t);
+
+    if(getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &len) < 0)
+        return (0);
+
+#ifdef LINUX
+    /* The socket server hangs up right away, so the pooled connections
+       normally sit in CLOSE_WAIT. Closed means a child shut it down. */
+    struct tcp_info info;
+    len = sizeof(struct tcp_info);
+
+    if(error == 0 && getsockopt(sock, IPPROTO_TCP, TCP_INFO, &info, &len) == 0 &&
+       info.tcpi_state == TCP_CLOSE)
+        error = ENOTCONN;
+#endif
+
+    if(error == 0)
+        return (0);
+
+    /* A shut down socket can't be repaired, put a new connection on the
+       same descriptor number. Processes forked from now on get it. */
+    int32_t replacement = 0;
+    if(connect_ipv6(&replacement) < 0)
+        return (0);
+
+    if(dup2(replacement, sock) < 0)
+    {
+        close(replacement);
+        return (0);
+    }
+
+    close(replacement);
+
+    return (1);
+}
+
+/* Run check on every block of pool and count the repairs under type. */
+static void sweep_pool(struct shared_pool *pool, enum rsrc_type type)
+{
+    uint64_t i;
+
+    if(pool == NULL)
+        return;
+
+    for(i = 0; i < pool->block_count && atomic_load_uint32(&maintainer_stop) == 0; i++)
+    {
+        struct resource_ctx *resource = (struct resource_ctx *)pool->blocks[i].ptr;
+        int32_t repaired = 0;
+
+        /* Paths nobody used yet are created here, off the children's hot path. */
+        if(atomic_load_uint32(&resource->ready) == 0)
+        {
+            if(type == RSRC_FILE)
+                (void)build_filepath(resource);
+            else if(type == RSRC_DIR)
+                (void)build_dirpath(resource);
+
+            continue;
+        }
+
+        switch(type)
+        {
+            case RSRC_DESC:
+                repaired = check_desc(*(int32_t *)resource->ptr);
+                break;
+
+            case RSRC_FILE:
+                repaired = check_filepath((char *)resource->ptr);
+                break;
+
+            case RSRC_DIR:
+                repaired = check_dirpath((char *)resource->ptr);
+                break;
+
+            case RSRC_SOCKET:
+                repaired = check_socket(*(int32_t *)resource->ptr);
+                break;
+
+            default:
+                break;
+        }
+
+        if(repaired == 1)
+            atomic_add_uint64(&replacements[type], 1);
+    }
+
+    return;
+}
+
+static void *maintain_resources(void *arg)
+{
+    struct timespec interval = {
+        .tv_sec = MAINTAIN_INTERVAL / 1000,
+        .tv_nsec = (MAINTAIN_INTERVAL % 1000) * 1000000L
+    };
+
+    (void)arg;
+
+    while(atomic_load_uint32(&maintainer_stop) == 0)
+    {
+        sweep_pool(desc_pool, RSRC_DESC);
+        sweep_pool(file_pool, RSRC_FILE);
+        sweep_pool(dirpath_pool, RSRC_DIR);
+        sweep_pool(socket_pool, RSRC_SOCKET);
+
+        (void)nanosleep(&interval, NULL);
+    }
+
+    return (NULL);
+}
+
+int32_t start_resource_maintainer(void)
+{
+    if(maintainer_running == 1)
+        return (0);
+
+    atomic_store_uint32(&maintainer_stop, 0);
+
+    int32_t rtrn = pthread_create(&maintainer, NULL, maintain_resources, NULL);
+    if(rtrn != 0)
+    {
+        output->write(ERROR, "Can't start resource maintainer: %s\n", strerror(rtrn));
+        return (-1);
+    }
+
+    maintainer_running = 1;
+
+    return (0);
+}
+
+void stop_resource_maintainer(void)
+{
+    if(maintainer_running != 1)
+        return;
+
+    atomic_store_uint32(&maintainer_stop, 1);
+    (void)pthread_join(maintainer, NULL);
+
+    maintainer_running = 0;
+
+    return;
+}
+
+uint64_t get_resource_replacements(enum rsrc_type type)
+{
+    if(type >= RSRC_TYPES)
+        return (0);
+
+    return (atomic_load_uint64(&replacements[type]));
+}
+
+uint32_t reclaim_resources(int32_t pid)
+{
+    struct shared_pool *pools[] = { desc_pool, file_pool, dirpath_pool, socket_pool, pid_pool };
+    uint32_t reclaimed = 0;
+    uint32_t i;
+
+    for(i = 0; i < sizeof(pools) / sizeof(pools[0]); i++)
+    {
+        if(pools[i] != NULL)
+            reclaimed += reclaim_blocks(pools[i], pid);
+    }
+
+    return (reclaimed);
+}
+
+void get_resource_pool_stats(uint64_t *steals, uint64_t *waits, uint64_t *exhausted)
+{
+    struct shared_pool *pools[] = { desc_pool, file_pool, dirpath_pool, socket_pool, pid_pool };
+    uint32_t i;
+
+    (*steals) = 0;
+    (*waits) = 0;
+    (*exhausted) = 0;
+
+    for(i = 0; i < sizeof(pools) / sizeof(pools[0]); i++)
+    {
+        if(pools[i] == NULL)
+            continue;
+
+        (*steals) += atomic_load_uint64(&pools[i]->steals);
+        (*waits) += atomic_load_uint64(&pools[i]->waits);
+        (*exhausted) += atomic_load_uint64(&pools[i]->exhausted);
+    }
+
+    return;
+}
+
 struct resource_generator *get_cached_resource_generator(void)
 {
     struct resource_generator *rsrc_gen = NULL;
@@ -896,6 +1521,8 @@ struct resource_generator *get_cached_resource_generator(void)
     rsrc_gen->free_dirpath = &free_dirpath_cached;
     rsrc_gen->get_socket = &get_socket_cached;
     rsrc_gen->free_socket = &free_socket_cached;
+    rsrc_gen->get_pid = &get_pid_cached;
+    rsrc_gen->free_pid = &free_pid_cached;
 
     return (rsrc_gen);
 }
@@ -919,6 +1546,8 @@ struct resource_generator *get_resource_generator(void)
     rsrc_gen->free_dirpath = &free_dirpath_nocached;
     rsrc_gen->get_socket = &get_socket_nocached;
     rsrc_gen->free_socket = &free_socket_nocached;
+    rsrc_gen->get_pid = &get_pid_nocached;
+    rsrc_gen->free_pid = &free_pid_nocached;
 
     return (rsrc_gen);
 }
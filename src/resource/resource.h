@@ -24,11 +24,17 @@
 
 enum rsrc_gen_type { CACHE, NO_CACHE };
 
+/* Pooled resource types the maintainer thread repairs. */
+enum rsrc_type { RSRC_DESC, RSRC_FILE, RSRC_DIR, RSRC_SOCKET, RSRC_TYPES };
+
 struct resource_ctx
 {
     struct memory_block *m_blk;
 
     void *ptr;
+
+    /* Zero while the file or directory a pooled path names is not created yet. */
+    uint32_t ready;
 };
 
 struct desc_generator
@@ -55,12 +61,19 @@ struct filepath_generator
     int32_t (*free_filepath)(char **);
 };
 
+struct pid_generator
+{
+    int32_t (*get_pid)(void);
+    int32_t (*free_pid)(int32_t *);
+};
+
 struct resource_generator
 {
     struct desc_generator;
     struct socket_generator;
     struct dirpath_generator;
     struct filepath_generator;
+    struct pid_generator;
 };
 
 extern struct desc_generator *get_default_desc_generator(void);
@@ -69,6 +82,54 @@ extern struct desc_generator *get_default_desc_generator(void);
 extern struct resource_generator *get_resource_generator(void);
 extern struct resource_generator *get_cached_resource_generator(void);
 
+/**
+ * Start a thread that sweeps the cached resource pools in the background and
+ * repairs what fuzzed syscalls broke: status flags, offsets and contents of
+ * descriptors, unlinked or chmod'ed files and directories, and shut down
+ * sockets. It also creates the files and directories of pooled paths no
+ * child used yet. Call it after get_cached_resource_generator().
+ * @return Zero on success and -1 on failure.
+ */
+extern int32_t start_resource_maintainer(void);
+
+/**
+ * Stop and join the thread started by start_resource_maintainer().
+ */
+extern void stop_resource_maintainer(void);
+
+/**
+ * Get the number of resources of a type the maintainer repaired or replaced.
+ * @param type The resource type.
+ * @return The count.
+ */
+extern uint64_t get_resource_replacements(enum rsrc_type type);
+
+/**
+ * Return the pooled resources a dead process was holding to their pools.
+ * @param pid The pid of the process, it must already be reaped.
+ * @return The number of resources returned.
+ */
+extern uint32_t reclaim_resources(int32_t pid);
+
+/**
+ * Replace a sacrificial process of the pid pool that died. Children never
+ * fork replacements themselves, a process forked by a child would die with
+ * that child and be left a zombie nobody reaps. Call this from the process
+ * that created the pools after it reaped pid.
+ * @param pid The pid of the reaped process.
+ * @return 1 when pid was a sacrificial process and was replaced, 0 when it
+ * wasn't one and -1 when no replacement could be started.
+ */
+extern int32_t replace_sacrificial_process(int32_t pid);
+
+/**
+ * Sum the contention counters of the cached resource pools.
+ * @param steals Set to the number of resources a child took from another child's shard.
+ * @param waits Set to the number of times a pool was empty and a child had to wait.
+ * @param exhausted Set to the number of times a child gave up waiting on a pool.
+ */
+extern void get_resource_pool_stats(uint64_t *steals, uint64_t *waits, uint64_t *exhausted);
+
 extern void inject_resource_deps(struct dependency_context *ctx);
 
 #endif
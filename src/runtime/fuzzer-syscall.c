@@ -14,11 +14,14 @@
  **/
 
 #include "fuzzer.h"
+#include "runtime.h"
 #include "io/io.h"
 #include "syscall/child.h"
 #include "syscall/syscall.h"
 #include "memory/memory.h"
+#include "resource/resource.h"
 #include "syscall/signals.h"
+#include "coverage/coverage.h"
 #include "concurrent/concurrent.h"
 #include "utils/utils.h"
 #include "log/log.h"
@@ -26,6 +29,21 @@
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#ifdef LINUX
+
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+
+#else
+
+#include <sys/event.h>
+
+#endif
 
 static struct output_writter *output;
 static struct memory_allocator *allocator;
@@ -33,13 +51,398 @@ static struct fuzzer_control *control;
 
 static char *db_path = NULL;
 
+/* Where the per syscall return value histograms are exported, next to the database. */
+static char results_path[4096];
+
+/* How often in milliseconds the supervisor reports stats. */
+static const int32_t STATS_INTERVAL = 5000;
+
+/* How long in milliseconds the supervisor sleeps waiting for a child to
+   exit before waking up to rebuild the syscall weights. */
+static const int32_t WEIGHT_INTERVAL = 1000;
+
+/* Statistics about the supervisor process it's self. All times are in nanoseconds. */
+struct supervisor_stats
+{
+    uint64_t start_time;
+    uint64_t idle_time;
+    uint64_t respawns;
+    uint64_t respawn_time;
+    uint64_t last_report;
+    uint64_t last_idle;
+    uint64_t last_cpu;
+    uint64_t last_weights;
+    uint64_t last_export;
+    uint64_t stuck;
+};
+
+static struct supervisor_stats stats;
+
+/* When setup started, for reporting the time to the first children. */
+static uint64_t setup_start;
+
+/* epoll descriptor on Linux and kqueue descriptor on the BSDs and macOS. */
+static int32_t event_fd = -1;
+
+#ifdef LINUX
+
+/* signalfd descriptor that becomes readable when SIGCHLD is pending. */
+static int32_t signal_fd = -1;
+
+#endif
+
+/* Pipe used by stop_syscall_fuzzer() to wake the supervisor. */
+static int32_t wake_pipe[2] = {-1, -1};
+
 static int32_t stop_syscall_fuzzer(void)
 {
     atomic_store_uint32(&control->stop, TRUE);
 
+    /* Wake the supervisor so it notices the stop flag right away, if
+       that fails it still sees the flag when it's wait times out. */
+    if(wake_pipe[1] > -1 && write(wake_pipe[1], "!", 1) < 0)
+        output->write(ERROR, "Can't wake supervisor: %s\n", strerror(errno));
+
     return (0);
 }
 
+static int32_t create_event_loop(void)
+{
+    int32_t rtrn = 0;
+    sigset_t mask;
+
+    /* Block SIGCHLD, so instead of interrupting us it stays pending
+       until we pick it up from the event loop. */
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+
+    rtrn = sigprocmask(SIG_BLOCK, &mask, NULL);
+    if(rtrn < 0)
+    {
+        output->write(ERROR, "Can't block SIGCHLD: %s\n", strerror(errno));
+        return (-1);
+    }
+
+    rtrn = pipe(wake_pipe);
+    if(rtrn < 0)
+    {
+        output->write(ERROR, "Can't create wake pipe: %s\n", strerror(errno));
+        return (-1);
+    }
+
+#ifdef LINUX
+
+    signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if(signal_fd < 0)
+    {
+        output->write(ERROR, "signalfd: %s\n", strerror(errno));
+        return (-1);
+    }
+
+    event_fd = epoll_create1(EPOLL_CLOEXEC);
+    if(event_fd < 0)
+    {
+        output->write(ERROR, "epoll_create1: %s\n", strerror(errno));
+        return (-1);
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(struct epoll_event));
+
+    event.events = EPOLLIN;
+    event.data.fd = signal_fd;
+
+    rtrn = epoll_ctl(event_fd, EPOLL_CTL_ADD, signal_fd, &event);
+    if(rtrn < 0)
+    {
+        output->write(ERROR, "epoll_ctl: %s\n", strerror(errno));
+        return (-1);
+    }
+
+    event.data.fd = wake_pipe[0];
+
+    rtrn = epoll_ctl(event_fd, EPOLL_CTL_ADD, wake_pipe[0], &event);
+    if(rtrn < 0)
+    {
+        output->write(ERROR, "epoll_ctl: %s\n", strerror(errno));
+        return (-1);
+    }
+
+#else
+
+    event_fd = kqueue();
+    if(event_fd < 0)
+    {
+        output->write(ERROR, "kqueue: %s\n", strerror(errno));
+        return (-1);
+    }
+
+    struct kevent events[2];
+
+    EV_SET(&events[0], SIGCHLD, EVFILT_SIGNAL, EV_ADD, 0, 0, NULL);
+    EV_SET(&events[1], (uintptr_t)wake_pipe[0], EVFILT_READ, EV_ADD, 0, 0, NULL);
+
+    rtrn = kevent(event_fd, events, 2, NULL, 0, NULL);
+    if(rtrn < 0)
+    {
+        output->write(ERROR, "kevent: %s\n", strerror(errno));
+        return (-1);
+    }
+
+#endif
+
+    return (0);
+}
+
+/* Add a descriptor to the event loop, so the supervisor wakes up when it's readable. */
+static int32_t watch_fd(int32_t fd)
+{
+    int32_t rtrn = 0;
+
+#ifdef LINUX
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(struct epoll_event));
+
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+
+    rtrn = epoll_ctl(event_fd, EPOLL_CTL_ADD, fd, &event);
+    if(rtrn < 0)
+    {
+        output->write(ERROR, "epoll_ctl: %s\n", strerror(errno));
+        return (-1);
+    }
+
+#else
+
+    struct kevent event;
+
+    EV_SET(&event, (uintptr_t)fd, EVFILT_READ, EV_ADD, 0, 0, NULL);
+
+    rtrn = kevent(event_fd, &event, 1, NULL, 0, NULL);
+    if(rtrn < 0)
+    {
+        output->write(ERROR, "kevent: %s\n", strerror(errno));
+        return (-1);
+    }
+
+#endif
+
+    return (0);
+}
+
+static int32_t start_fork_server_mode(void)
+{
+    int32_t rtrn = 0;
+
+    rtrn = start_fork_server();
+    if(rtrn < 0)
+    {
+        output->write(ERROR, "Can't start fork server\n");
+        return (-1);
+    }
+
+    return (watch_fd(get_fork_server_fd()));
+}
+
+/* Block until a child exits, we are woken up or the timeout in milliseconds expires.
+   Time spent blocked is added to the supervisor's idle time. */
+static int32_t wait_for_event(int32_t timeout)
+{
+    int32_t i;
+    int32_t count = 0;
+    char buf[64];
+    uint64_t start = get_time_ns();
+
+#ifdef LINUX
+
+    struct epoll_event events[3];
+
+    count = epoll_wait(event_fd, events, 3, timeout);
+
+    stats.idle_time += get_time_ns() - start;
+
+    if(count < 0)
+    {
+        if(errno == EINTR)
+            return (0);
+
+        output->write(ERROR, "epoll_wait: %s\n", strerror(errno));
+        return (-1);
+    }
+
+    for(i = 0; i < count; i++)
+    {
+        if(events[i].data.fd == signal_fd)
+        {
+            struct signalfd_siginfo info;
+
+            /* Drain the signalfd, the children are reaped with waitpid() anyway. */
+            while(read(signal_fd, &info, sizeof(struct signalfd_siginfo)) > 0)
+                continue;
+        }
+        else if(events[i].data.fd == wake_pipe[0])
+        {
+            if(read(wake_pipe[0], buf, sizeof(buf)) < 0)
+                output->write(ERROR, "Can't read wake pipe: %s\n", strerror(errno));
+        }
+    }
+
+#else
+
+    struct kevent events[3];
+    struct timespec ts = {
+        .tv_sec = timeout / 1000,
+        .tv_nsec = (timeout % 1000) * 1000000
+    };
+
+    count = kevent(event_fd, NULL, 0, events, 3, &ts);
+
+    stats.idle_time += get_time_ns() - start;
+
+    if(count < 0)
+    {
+        if(errno == EINTR)
+            return (0);
+
+        output->write(ERROR, "kevent: %s\n", strerror(errno));
+        return (-1);
+    }
+
+    for(i = 0; i < count; i++)
+    {
+        if(events[i].filter == EVFILT_READ && events[i].ident == (uintptr_t)wake_pipe[0])
+        {
+            if(read(wake_pipe[0], buf, sizeof(buf)) < 0)
+                output->write(ERROR, "Can't read wake pipe: %s\n", strerror(errno));
+        }
+    }
+
+#endif
+
+    return (count);
+}
+
+/* Reap every child that has exited and return it's slot to the free stack. */
+static uint32_t reap_children(void)
+{
+    pid_t pid = 0;
+    int32_t rtrn = 0;
+    int32_t status = 0;
+    uint32_t reaped = 0;
+
+    while((pid = waitpid(-1, &status, WNOHANG)) > 0)
+    {
+        struct syscall_child *child = NULL;
+
+        if(pid == get_fork_server_pid())
+        {
+            /* The workers can't report back without the template, so
+               kill them all and start over with a new fork server. */
+            output->write(ERROR, "Fork server exited, restarting it\n");
+            kill_all_children();
+
+            if(start_fork_server_mode() < 0)
+                atomic_store_uint32(&control->stop, TRUE);
+
+            continue;
+        }
+
+        /* A sacrificial process a fuzzed call killed, start it's replacement here
+           in the supervisor, a child can't keep a process it forks alive. */
+        rtrn = replace_sacrificial_process(pid);
+        if(rtrn < 0)
+            output->write(ERROR, "Can't replace sacrificial process %d\n", (int)pid);
+
+        if(rtrn != 0)
+            continue;
+
+        /* Whatever the process held in the resource pools is free again,
+           this includes workers reap_stuck_children() abandoned. */
+        (void)reclaim_resources(pid);
+
+        /* Not all our children are syscall children, ie sacrificial processes. */
+        child = get_child_with_pid(pid);
+        if(child == NULL)
+            continue;
+
+        reap_syscall_child(child, pid, status);
+        reaped++;
+    }
+
+    return (reaped);
+}
+
+/* Start a child process in every free slot. */
+static int32_t start_children(void)
+{
+    int32_t rtrn = 0;
+    struct syscall_child *child = NULL;
+
+    while((child = create_syscall_child()) != NULL)
+    {
+        rtrn = child->start(child);
+        if(rtrn < 0)
+        {
+            output->write(ERROR, "Child process failed to start\n");
+            return (-1);
+        }
+    }
+
+    return (0);
+}
+
+static uint64_t get_cpu_time(void)
+{
+    struct rusage usage;
+
+    (void)getrusage(RUSAGE_SELF, &usage);
+
+    return (((uint64_t)usage.ru_utime.tv_sec * 1000000000) + ((uint64_t)usage.ru_utime.tv_usec * 1000) +
+            ((uint64_t)usage.ru_stime.tv_sec * 1000000000) + ((uint64_t)usage.ru_stime.tv_usec * 1000));
+}
+
+static void report_stats(struct children_state *state, uint64_t now)
+{
+    uint64_t cpu = get_cpu_time();
+    uint64_t wall = now - stats.last_report;
+    uint64_t idle = stats.idle_time - stats.last_idle;
+    uint64_t avg_respawn = 0;
+    uint64_t pool_steals = 0;
+    uint64_t pool_waits = 0;
+    uint64_t pool_exhausted = 0;
+
+    if(wall == 0)
+        return;
+
+    get_resource_pool_stats(&pool_steals, &pool_waits, &pool_exhausted);
+
+    if(stats.respawns > 0)
+        avg_respawn = stats.respawn_time / stats.respawns;
+
+    output->write(STD, "Children: %u/%u, respawns: %llu (avg %llu us), stuck: %llu, edges: %llu, pool steals: %llu, waits: %llu (exhausted %llu), supervisor cpu: %.2f%%, idle: %.2f%%\n",
+                  atomic_load_uint32(&state->running_children), state->total_children,
+                  (unsigned long long)stats.respawns, (unsigned long long)(avg_respawn / 1000),
+                  (unsigned long long)stats.stuck, (unsigned long long)get_coverage_edges(),
+                  (unsigned long long)pool_steals, (unsigned long long)pool_waits,
+                  (unsigned long long)pool_exhausted,
+                  ((double)(cpu - stats.last_cpu) * 100.0) / (double)wall,
+                  ((double)idle * 100.0) / (double)wall);
+
+    output->write(STD, "Resources repaired: descriptors: %llu, files: %llu, dirs: %llu, sockets: %llu\n",
+                  (unsigned long long)get_resource_replacements(RSRC_DESC),
+                  (unsigned long long)get_resource_replacements(RSRC_FILE),
+                  (unsigned long long)get_resource_replacements(RSRC_DIR),
+                  (unsigned long long)get_resource_replacements(RSRC_SOCKET));
+
+    stats.last_report = now;
+    stats.last_idle = stats.idle_time;
+    stats.last_cpu = cpu;
+
+    return;
+}
+
 static int32_t start_syscall_fuzzer(void)
 {
     int32_t rtrn = 0;
@@ -70,25 +473,104 @@ static int32_t start_syscall_fuzzer(void)
        cleanup the child processes before this, the main process exits.   */
     setup_ctrlc_handler();
 
-    while(control->stop != TRUE)
+    rtrn = create_event_loop();
+    if(rtrn < 0)
+    {
+        output->write(ERROR, "Can't create event loop\n");
+        return (-1);
+    }
+
+    memset(&stats, 0, sizeof(struct supervisor_stats));
+    stats.start_time = get_time_ns();
+    stats.last_report = stats.start_time;
+    stats.last_cpu = get_cpu_time();
+    stats.last_weights = stats.start_time;
+    stats.last_export = stats.start_time;
+
+    if(atomic_load_uint32(&control->fork_server) == TRUE)
+    {
+        rtrn = start_fork_server_mode();
+        if(rtrn < 0)
+            return (-1);
+    }
+
+    rtrn = start_children();
+    if(rtrn < 0)
+        return (-1);
+
+    output->write(STD, "First children started %llu ms after setup began\n",
+                  (unsigned long long)((get_time_ns() - setup_start) / 1000000));
+
+    /* Not fatal, children just see more broken resources without it. */
+    if(start_resource_maintainer() < 0)
+        output->write(ERROR, "Running without the resource maintainer\n");
+
+    /* Sleep until a child exits, then replace it. The supervisor
+       uses no CPU while all the children are running. */
+    while(atomic_load_uint32(&control->stop) != TRUE)
     {
-        if(state->running_children < state->total_children)
+        rtrn = wait_for_event(WEIGHT_INTERVAL);
+        if(rtrn < 0)
+            return (-1);
+
+        uint64_t reap_time = get_time_ns();
+        uint32_t reaped = reap_children();
+
+        if(atomic_load_uint32(&control->fork_server) == TRUE)
+            reaped += reap_fork_server_children();
+
+        if(atomic_load_uint32(&control->stop) == TRUE)
+            break;
+
+        /* Cheap when there are no free slots, create_syscall_child() returns NULL right away. */
+        rtrn = start_children();
+        if(rtrn < 0)
+            return (-1);
+
+        if(reaped > 0)
         {
-            struct syscall_child *child = NULL;
+            stats.respawns += reaped;
+            stats.respawn_time += (get_time_ns() - reap_time) * reaped;
+        }
 
-            child = create_syscall_child();
-            if(child == NULL)
-               continue;
+        uint64_t now = get_time_ns();
 
-            rtrn = child->start(child);
+        /* Free the slots of workers stuck in a call, they are replaced on the next pass. */
+        stats.stuck += reap_stuck_children(now);
+
+        /* The children keep picking from the live table while the other one is rebuilt. */
+        if(now - stats.last_weights >= (uint64_t)WEIGHT_INTERVAL * 1000000)
+        {
+            rtrn = update_syscall_lanes();
             if(rtrn < 0)
-            {
-                output->write(ERROR, "Child process failed to start\n");
                 return (-1);
-            }
+
+            rtrn = update_syscall_weights();
+            if(rtrn < 0)
+                return (-1);
+
+            stats.last_weights = now;
+        }
+
+        if(get_verbosity() == TRUE && now - stats.last_report >= (uint64_t)STATS_INTERVAL * 1000000)
+            report_stats(state, now);
+
+        /* Not fatal, the next interval tries again. */
+        if(now - stats.last_export >= (uint64_t)STATS_INTERVAL * 1000000)
+        {
+            (void)export_results(results_path);
+            stats.last_export = now;
         }
     }
 
+    stop_resource_maintainer();
+
+    report_stats(state, get_time_ns());
+
+    rtrn = export_results(results_path);
+    if(rtrn < 0)
+        output->write(ERROR, "Failed to export syscall results\n");
+
     return (0);
 }
 
@@ -96,6 +578,8 @@ static int32_t setup_syscall_fuzzer(void)
 {
     int32_t rtrn = 0;
 
+    setup_start = get_time_ns();
+
     rtrn = create_db(db_path);
     if(rtrn < 0)
     {
@@ -103,6 +587,82 @@ static int32_t setup_syscall_fuzzer(void)
         return (-1);
     }
 
+    /* Build the resource pools, ie the descriptors and sacrificial
+       processes, before any child is forked so they are shared by all of them. */
+    struct resource_generator *rsrc_gen = NULL;
+
+    rsrc_gen = get_cached_resource_generator();
+    if(rsrc_gen == NULL)
+    {
+        output->write(ERROR, "Failed to create resource generator\n");
+        return (-1);
+    }
+
+    struct dependency_context *ctx = NULL;
+
+    ctx = create_dependency_ctx(create_dependency(rsrc_gen, RESOURCE_GEN), NULL);
+    if(ctx == NULL)
+    {
+        output->write(ERROR, "Failed to create dependency context\n");
+        return (-1);
+    }
+
+    inject_syscall_deps(ctx);
+
+    /* Build the hot table now so children inherit it instead of each building their own. */
+    if(get_table() == NULL)
+    {
+        output->write(ERROR, "Failed to get syscall table\n");
+        return (-1);
+    }
+
+    rtrn = setup_weighted_selection();
+    if(rtrn < 0)
+    {
+        output->write(ERROR, "Failed to setup weighted syscall selection\n");
+        return (-1);
+    }
+
+    rtrn = snprintf(results_path, sizeof(results_path), "%s-syscalls.tsv", db_path);
+    if(rtrn < 0 || (size_t)rtrn >= sizeof(results_path))
+    {
+        output->write(ERROR, "Output path is too long\n");
+        return (-1);
+    }
+
+    /* Children killed by a signal leave their last tests next to the results. */
+    set_crash_log_prefix(db_path);
+
+    rtrn = setup_result_stats();
+    if(rtrn < 0)
+    {
+        output->write(ERROR, "Failed to setup syscall result stats\n");
+        return (-1);
+    }
+
+    rtrn = setup_syscall_lanes();
+    if(rtrn < 0)
+    {
+        output->write(ERROR, "Failed to setup syscall lanes\n");
+        return (-1);
+    }
+
+    /* Coverage is optional, without KCOV the campaign just runs blind. */
+    struct coverage_backend *kcov = get_kcov_backend();
+    if(kcov != NULL && kcov->available() == NX_YES)
+    {
+        rtrn = setup_coverage(kcov);
+        if(rtrn < 0)
+        {
+            output->write(ERROR, "Failed to setup kernel coverage\n");
+            return (-1);
+        }
+    }
+    else
+    {
+        output->write(STD, "KCOV is not available, running without kernel coverage\n");
+    }
+
     return (0);
 }
 
@@ -17,10 +17,12 @@
 #include "io/io.h"
 #include "memory/memory.h"
 #include "platform.h"
+#include "concurrent/concurrent.h"
 #include <stdio.h>
 
 static struct output_writter *output;
 static struct memory_allocator *allocator;
+static struct fuzzer_control *control;
 
 struct fuzzer_instance *get_fuzzer(struct fuzzer_config *config)
 {
@@ -33,6 +35,14 @@ struct fuzzer_instance *get_fuzzer(struct fuzzer_config *config)
     switch((int32_t)config->mode)
     {
         case MODE_SYSCALL:
+            /* Control is shared with the children, so pass the execution options through it. */
+            if(control != NULL)
+            {
+                atomic_store_uint32(&control->fork_server, (uint32_t)config->fork_server);
+                atomic_store_uint32(&control->uring, (uint32_t)config->uring);
+                atomic_store_uint32(&control->race, (uint32_t)config->race);
+            }
+
             return(get_syscall_fuzzer(config->output_path));
 
         default:
@@ -53,6 +63,9 @@ struct fuzzer_control *init_fuzzer_control(void)
     }
 
     control->stop = FALSE;
+    control->fork_server = FALSE;
+    control->uring = FALSE;
+    control->race = FALSE;
 
     return (control);
 }
@@ -72,6 +85,10 @@ void inject_fuzzer_deps(struct dependency_context *ctx)
             case OUTPUT:
                 output = (struct output_writter *)ctx->array[i]->interface;
                 break;
+
+            case CONTROL:
+                control = (struct fuzzer_control *)ctx->array[i]->interface;
+                break;
         }
     }
 }
@@ -23,6 +23,15 @@
 struct fuzzer_control
 {
     uint32_t stop;
+
+    /* Set to TRUE to start syscall children from a pre-warmed fork server. */
+    uint32_t fork_server;
+
+    /* Set to TRUE to have syscall children also submit tests in io_uring batches. */
+    uint32_t uring;
+
+    /* Set to TRUE to have syscall children also race paired syscalls from several threads. */
+    uint32_t race;
 };
 
 struct fuzzer_instance
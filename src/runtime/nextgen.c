@@ -58,6 +58,9 @@ static struct option longopts[] = {{"in", required_argument, NULL, 'i'},
                                    {"help", 0, NULL, 'h'},
                                    {"dumb", 0, NULL, 'd'},
                                    {"verbose", 0, NULL, 'v'},
+                                   {"forkserver", 0, NULL, 'k'},
+                                   {"uring", 0, NULL, 'u'},
+                                   {"race", 0, NULL, 'r'},
                                    {NULL, 0, NULL, 0}};
 
 static void display_help_banner(void)
@@ -69,6 +72,9 @@ static void display_help_banner(void)
     output->write(STD, "To use the syscall fuzzer in smart mode run.\n");
     output->write(STD, "sudo ./nextgen --syscall --out /path/to/out/directory\n");
     output->write(STD, "To use dumb mode just pass --dumb with any of the above commands.\n");
+    output->write(STD, "Pass --forkserver in syscall mode to fork children from a pre-warmed template process.\n");
+    output->write(STD, "Pass --uring in syscall mode on Linux to also submit tests in io_uring batches.\n");
+    output->write(STD, "Pass --race in syscall mode to also race paired syscalls from several threads.\n");
 
     return;
 }
@@ -88,6 +94,9 @@ static struct fuzzer_config *init_fuzzer_config(void)
     config->input_path = NULL;
     config->output_path = NULL;
     config->args = NULL;
+    config->fork_server = FALSE;
+    config->uring = FALSE;
+    config->race = FALSE;
 
     return (config);
 }
@@ -370,6 +379,18 @@ struct fuzzer_config *parse_cmd_line(int32_t argc, const char *argv[])
                 set_verbosity(TRUE);
                 break;
 
+            case 'k':
+                config->fork_server = TRUE;
+                break;
+
+            case 'u':
+                config->uring = TRUE;
+                break;
+
+            case 'r':
+                config->race = TRUE;
+                break;
+
             default:
                 display_help_banner();
                 allocator->free((void **)&config);
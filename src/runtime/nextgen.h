@@ -30,7 +30,9 @@ struct fuzzer_config
     char *args;
     int32_t smart_mode;
     enum fuzz_mode mode;
-    const char paddding[4];
+    int32_t fork_server;
+    int32_t uring;
+    int32_t race;
 };
 
 /**
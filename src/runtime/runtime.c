@@ -26,6 +26,9 @@
 
 static int32_t verbose;
 
+/* Size of the per child scratch arena used while running a test case. */
+static const uint64_t SCRATCH_SIZE = 1024 * 1024;
+
 int32_t get_verbosity(void)
 {
     return (verbose);
@@ -56,10 +59,20 @@ int32_t inject_deps(struct output_writter *output)
         return (-1);
     }
 
+    struct memory_allocator *scratch = NULL;
+
+    scratch = get_arena_allocator(SCRATCH_SIZE);
+    if(scratch == NULL)
+    {
+        output->write(ERROR, "Failed to get scratch allocator\n");
+        return (-1);
+    }
+
     struct dependency_context *ctx = NULL;
 
     ctx = create_dependency_ctx(create_dependency(output, OUTPUT),
                                 create_dependency(allocator, ALLOCATOR),
+                                create_dependency(scratch, SCRATCH_ALLOCATOR),
                                 NULL);
     if(ctx == NULL)
     {
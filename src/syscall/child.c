@@ -17,21 +17,34 @@
 #include "io/io.h"
 #include "signals.h"
 #include "syscall.h"
+#include "program.h"
+#include "lane.h"
+#include "race.h"
+#include "testlog.h"
+#ifdef LINUX
+#include "uring.h"
+#endif
 #include "utils/noreturn.h"
 #include "memory/memory.h"
-#include "mutate/mutate.h"
+#include "resource/resource.h"
 #include "runtime/fuzzer.h"
+#include "runtime/platform.h"
 #include "concurrent/concurrent.h"
+#include "utils/utils.h"
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <signal.h>
-
-#ifdef MAC_OS
-
-#include <mach/boolean.h>
-
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#ifdef LINUX
+#include <dirent.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
 #endif
 
 static struct memory_allocator *allocator;
@@ -39,28 +52,360 @@ static struct output_writter *output;
 static struct fuzzer_control *control;
 static struct children_state *state = NULL;
 
-static int32_t child_loop(struct syscall_child *child)
+/* A call still in flight this long after it started is stuck, every per call timer is much shorter. */
+static const uint64_t STUCK_CALL_NS = 5000000000ULL;
+
+/* In race mode every this many iterations a child outside the slow lane runs a race instead of a program. */
+#define RACE_INTERVAL 8
+
+/* In io_uring mode every this many iterations is a batch, the rest run programs and races. */
+#define URING_INTERVAL 2
+
+/* Pids of workers reap_stuck_children() gave up on. Their slots were
+   already freed, so their exit records from the fork server only free
+   what they held in the pools. Old entries are overwritten, by then
+   those workers are long gone. */
+#define MAX_ABANDONED 64
+
+static pid_t abandoned[MAX_ABANDONED];
+static uint32_t abandoned_next;
+
+/* Where the test logs of children killed by a signal go, NULL to not write them. */
+static const char *crash_log_prefix = NULL;
+
+/* Set while this process is executing a syscall, so the signal
+   handler knows which jump point to return to. */
+static struct syscall_child *current_child = NULL;
+
+/* An exit record sent from the fork server to the supervisor. The slot
+   is out of range for a worker whose slot was already given away. */
+struct fork_server_status
 {
-    (void)child;
+    uint32_t slot;
+    int32_t status;
+    pid_t pid;
+};
+
+/* Pid of the fork server's template process. */
+static pid_t server_pid = -1;
+
+/* Carries slot indexes from the supervisor to the fork server. */
+static int32_t request_pipe[2] = {-1, -1};
+
+/* Carries exit records from the fork server back to the supervisor. */
+static int32_t status_pipe[2] = {-1, -1};
+
+/* Setup the process local state a child needs before it's first test. */
+static int32_t prepare_child(void)
+{
+    int32_t rtrn = 0;
+
+    rtrn = setup_child_signal_handler();
+    if(rtrn < 0)
+    {
+        output->write(ERROR, "Can't setup child signal handler\n");
+        return (-1);
+    }
+
+    return (0);
+}
+
+/* Arm a one shot timer that raises SIGALRM after ms milliseconds, zero disarms it. */
+static void arm_call_timer(uint32_t ms)
+{
+    struct itimerval timer;
+
+    memset(&timer, 0, sizeof(struct itimerval));
+    timer.it_value.tv_sec = ms / 1000;
+    timer.it_value.tv_usec = (ms % 1000) * 1000;
+
+    (void)setitimer(ITIMER_REAL, &timer, NULL);
+
+    return;
+}
+
+/* Record a test in the child's log right before it runs, so the supervisor
+   still has it if the call takes the child down. The paths and structs the
+   arguments point at are copied too, the memory is gone once the child is. */
+static void log_test(struct syscall_child *child, struct test_case *test)
+{
+    uint32_t i;
+    uint32_t total_args = get_total_args(test);
+    uint32_t number = get_table()->hot[get_syscall_index(test)].number;
+    const void *data[NX_ARG_SLOTS];
+    uint32_t data_size[NX_ARG_SLOTS];
+
+    for(i = 0; i < total_args; i++)
+        data_size[i] = get_argument_data(test, i, &data[i]);
+
+    log_test_record(child->log, number, get_argument_array(test), data, data_size, total_args);
+}
+
+/* Execute the calls of a program in order. A signal raised while a call
+   is in flight jumps back here instead of killing the child, and the rest
+   of the program is dropped since later calls may depend on that one. */
+static void run_program(struct syscall_child *child, struct program *prog)
+{
+    uint32_t i;
+    uint32_t total_calls = get_total_calls(prog);
+
+    for(i = 0; i < total_calls; i++)
+    {
+        struct test_case *test = get_program_call(prog, i);
+        uint32_t timeout = get_call_timeout(test);
+
+        if(sigsetjmp(child->return_jump, 1) != 0)
+        {
+            current_child = NULL;
+            arm_call_timer(0);
+            atomic_store_uint64(&child->call_start, 0);
+            set_did_jump(child, NX_NO);
+
+            /* The timer going off is a timeout, any other signal is a crash. */
+            if(atomic_load_int32(&child->had_error) == NX_YES)
+                record_test_crash(test);
+            else
+                record_syscall_timeout(get_syscall_index(test));
+
+            return;
+        }
+
+        /* Log the arguments the call really gets, after earlier results are passed in. */
+        link_program_call(prog, i);
+        log_test(child, test);
+
+        if(timeout > 0)
+            arm_call_timer(timeout);
+
+        uint64_t start = get_time_ns();
+
+        atomic_store_uint32(&child->call_index, get_syscall_index(test));
+        atomic_store_uint64(&child->call_start, start);
+
+        current_child = child;
+        start_coverage();
+        (void)execute_program_call(prog, i);
+        uint32_t new_edges = stop_coverage();
+
+        if(timeout > 0)
+            arm_call_timer(0);
+
+        current_child = NULL;
+
+        atomic_store_uint64(&child->call_start, 0);
 
-    setup_child_signal_handler();
+        set_had_error(child, (get_error(test) != 0) ? NX_YES : NX_NO);
+        set_ret_value(child, (int32_t)get_return_value(test));
 
+        record_test_result(test, get_time_ns() - start, new_edges);
+    }
+
+    return;
+}
+
+/* Run one round of a race. No jump point is set since the calls run on
+   several threads, so a crash takes the child down and the supervisor
+   restarts it, while the watchdog covers a round that never finishes. */
+static void run_race_round(struct syscall_child *child, struct race *race)
+{
+    if(generate_race(race) < 0)
+        return;
+
+    uint32_t i;
     struct test_case *test = NULL;
 
+    for(i = 0; (test = get_race_call(race, i)) != NULL; i++)
+        log_test(child, test);
+
+    atomic_store_uint32(&child->call_index, get_syscall_index(get_race_leader(race)));
+    atomic_store_uint64(&child->call_start, get_time_ns());
+
+    run_race(race);
+
+    atomic_store_uint64(&child->call_start, 0);
+
+    cleanup_race(race);
+}
+
+#ifdef LINUX
+
+/* Submit one io_uring batch. The batch's own timeout cancels blocking calls,
+   so the watchdog only steps in when the kernel can't cancel one. A stuck
+   batch is blamed on it's first call. */
+static void run_uring_round(struct syscall_child *child, struct uring_batch *batch)
+{
+    if(generate_uring_batch(batch) < 0)
+        return;
+
+    uint32_t i;
+    struct test_case *test = NULL;
+
+    for(i = 0; (test = get_uring_test(batch, i)) != NULL; i++)
+        log_test(child, test);
+
+    atomic_store_uint32(&child->call_index, get_syscall_index(get_uring_test(batch, 0)));
+    atomic_store_uint64(&child->call_start, get_time_ns());
+
+    (void)run_uring_batch(batch);
+
+    atomic_store_uint64(&child->call_start, 0);
+
+    cleanup_uring_batch(batch);
+}
+
+#endif
+
+#ifdef LINUX
+
+/* One past the highest descriptor the child holds, the pools' descriptors
+   are all inherited from the supervisor so they are below it. */
+static int32_t get_desc_watermark(void)
+{
+    DIR *dir = opendir("/proc/self/fd");
+    if(dir == NULL)
+    {
+        output->write(ERROR, "Can't list descriptors: %s\n", strerror(errno));
+        return (-1);
+    }
+
+    int32_t highest = -1;
+    int32_t self = dirfd(dir);
+    struct dirent *entry = NULL;
+
+    while((entry = readdir(dir)) != NULL)
+    {
+        if(entry->d_name[0] == '.')
+            continue;
+
+        int32_t fd = atoi(entry->d_name);
+        if(fd != self && fd > highest)
+            highest = fd;
+    }
+
+    (void)closedir(dir);
+
+    return (highest + 1);
+}
+
+/* Close the descriptors the last round created and nothing closed, ie
+   the ones pipe and socketpair write into a buffer. Otherwise a long
+   lived child runs out of descriptors and every later call that makes
+   one fails with EMFILE. */
+static void close_leaked_descs(int32_t watermark)
+{
+    if(watermark < 0)
+        return;
+
+    (void)syscall(SYS_close_range, (uint32_t)watermark, ~0U, 0);
+
+    return;
+}
+
+#endif
+
+static int32_t child_loop(struct syscall_child *child)
+{
+    struct program *prog = NULL;
+    struct race *race = NULL;
+    uint32_t iteration = 0;
+
+    set_syscall_lane(child->lane);
+
+    /* Take and return pool resources on the shard of our slot. */
+    set_pool_shard(child->slot);
+
+    /* Coverage is per process, so it's opened here after the fork. A child
+       that can't open it still fuzzes, it just reports no new edges. */
+    (void)open_coverage();
+
+    /* Allocate the program once, every iteration reuses its test cases. */
+    prog = alloc_program();
+    if(prog == NULL)
+    {
+        output->write(ERROR, "Failed to create program\n");
+        close_coverage();
+        return (-1);
+    }
+
+    /* Slow lane children mostly sit in blocking calls, racing them gains nothing.
+       The racer count differs between slots so races of every size run. */
+    if(atomic_load_uint32(&control->race) == TRUE && child->lane != LANE_SLOW)
+    {
+        race = create_race(2 + (child->slot % (NX_MAX_RACERS - 1)));
+        if(race == NULL)
+            output->write(ERROR, "Failed to create race, running programs only\n");
+    }
+
+#ifdef LINUX
+    struct uring_batch *batch = NULL;
+
+    if(atomic_load_uint32(&control->uring) == TRUE)
+    {
+        batch = create_uring_batch();
+        if(batch == NULL)
+            output->write(ERROR, "Failed to create io_uring batch, running without it\n");
+    }
+
+    /* Taken once everything the child keeps is open. */
+    int32_t watermark = get_desc_watermark();
+#endif
+
     while(control->stop != TRUE)
     {
-        test = create_test_case();
-        if(test == NULL)
+#ifdef LINUX
+        /* Whatever the last round left open. */
+        close_leaked_descs(watermark);
+#endif
+
+        iteration++;
+
+        if(race != NULL && (iteration % RACE_INTERVAL) == 0)
+        {
+            run_race_round(child, race);
+            continue;
+        }
+
+#ifdef LINUX
+        if(batch != NULL && (iteration % URING_INTERVAL) == 1)
+        {
+            run_uring_round(child, batch);
+            continue;
+        }
+#endif
+
+        if(next_program(prog) < 0)
         {
-            output->write(ERROR, "Failed to create test case\n");
+            output->write(ERROR, "Failed to create program\n");
+            free_program(&prog);
+            close_coverage();
+
+            if(race != NULL)
+                destroy_race(&race);
+
+#ifdef LINUX
+            if(batch != NULL)
+                destroy_uring_batch(&batch);
+#endif
+
             return (-1);
         }
 
-        mutate_buffer((void **)get_argument_array(test), get_total_args(test));
+        run_program(child, prog);
 
-        cleanup_test(test);
+        cleanup_program(prog);
     }
 
+    free_program(&prog);
+    close_coverage();
+
+    if(race != NULL)
+        destroy_race(&race);
+
+#ifdef LINUX
+    if(batch != NULL)
+        destroy_uring_batch(&batch);
+#endif
+
     return (0);
 }
 
@@ -79,6 +424,13 @@ static int32_t start_child(struct syscall_child *child)
     pid = fork();
     if(pid == 0)
     {
+        sigset_t mask;
+
+        /* The supervisor blocks SIGCHLD so it can wait on it, unblock
+           everything so the child starts with a clean signal mask. */
+        sigemptyset(&mask);
+        (void)sigprocmask(SIG_SETMASK, &mask, NULL);
+
         if(ck_pr_cas_int(&child->pid, INITIALIZING, getpid()) != true)
             _exit(-1);
 
@@ -92,6 +444,9 @@ static int32_t start_child(struct syscall_child *child)
             return (-1);
         }
 
+        if(prepare_child() < 0)
+            _exit(-1);
+
         child_loop(child);
 
         _exit(0);
@@ -120,6 +475,367 @@ static int32_t start_child(struct syscall_child *child)
     }
 }
 
+NX_NO_RETURN static void run_worker(struct syscall_child *child)
+{
+    sigset_t mask;
+
+    /* Workers inherit the signal handlers and warm state of the template,
+       they just need the template's SIGCHLD setup undone. */
+    (void)signal(SIGCHLD, SIG_DFL);
+    sigemptyset(&mask);
+    (void)sigprocmask(SIG_SETMASK, &mask, NULL);
+
+    (void)close(request_pipe[0]);
+    (void)close(status_pipe[1]);
+
+    atomic_add_uint32(&state->running_children, 1);
+
+    if(ck_pr_cas_int(&child->pid, INITIALIZING, getpid()) != true)
+    {
+        atomic_dec_uint32(&state->running_children);
+        _exit(-1);
+    }
+
+    child_loop(child);
+
+    _exit(0);
+}
+
+static void send_status(uint32_t slot, int32_t status, pid_t pid)
+{
+    struct fork_server_status record = {
+        .slot = slot,
+        .status = status,
+        .pid = pid
+    };
+
+    char *buf = (char *)&record;
+    size_t left = sizeof(struct fork_server_status);
+
+    /* The record is smaller than PIPE_BUF so it's written in one piece,
+       unless a SIGCHLD interrupts us while the pipe is full. */
+    while(left > 0)
+    {
+        ssize_t ret = write(status_pipe[1], buf, left);
+        if(ret < 0)
+        {
+            if(errno == EINTR || errno == EAGAIN)
+                continue;
+
+            /* The supervisor is gone, there is nobody left to tell. */
+            return;
+        }
+
+        buf += ret;
+        left -= (size_t)ret;
+    }
+
+    return;
+}
+
+static void fork_server_sigchld(int sig)
+{
+    /* Nothing to do, we only need SIGCHLD to interrupt pselect(). */
+    (void)sig;
+}
+
+NX_NO_RETURN static void fork_server_loop(void)
+{
+    int32_t rtrn = 0;
+    sigset_t mask;
+    sigset_t wait_mask;
+    struct sigaction sa;
+    pid_t *workers = NULL;
+
+    workers = allocator->alloc(sizeof(pid_t) * state->total_children);
+    if(workers == NULL)
+        _exit(-1);
+
+    memset(workers, 0, sizeof(pid_t) * state->total_children);
+
+    memset(&sa, 0, sizeof(struct sigaction));
+    sa.sa_handler = &fork_server_sigchld;
+    sigfillset(&sa.sa_mask);
+    (void)sigaction(SIGCHLD, &sa, NULL);
+
+    /* Keep SIGCHLD blocked except while waiting in pselect(), so a worker
+       can't exit between fork() and us recording it's pid. */
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    (void)sigprocmask(SIG_BLOCK, &mask, &wait_mask);
+    sigdelset(&wait_mask, SIGCHLD);
+
+    while(1)
+    {
+        fd_set read_set;
+        pid_t pid = 0;
+        int32_t status = 0;
+
+        FD_ZERO(&read_set);
+        FD_SET(request_pipe[0], &read_set);
+
+        rtrn = pselect(request_pipe[0] + 1, &read_set, NULL, NULL, NULL, &wait_mask);
+        if(rtrn < 0 && errno != EINTR)
+            _exit(-1);
+
+        /* Tell the supervisor about every worker that exited. A worker the
+           supervisor abandoned may have had it's slot handed to a new one
+           already, it's record goes out with an out of range slot so the
+           supervisor still reclaims what it held. */
+        while((pid = waitpid(-1, &status, WNOHANG)) > 0)
+        {
+            uint32_t i;
+
+            for(i = 0; i < state->total_children; i++)
+            {
+                if(workers[i] == pid)
+                {
+                    workers[i] = 0;
+                    break;
+                }
+            }
+
+            send_status(i, status, pid);
+        }
+
+        if(rtrn < 1)
+            continue;
+
+        uint32_t slot = 0;
+
+        ssize_t ret = read(request_pipe[0], &slot, sizeof(uint32_t));
+        if(ret == 0)
+        {
+            /* The supervisor is gone, so are we. */
+            _exit(0);
+        }
+
+        if(ret != sizeof(uint32_t) || slot >= state->total_children)
+            continue;
+
+        pid = fork();
+        if(pid == 0)
+        {
+            run_worker(state->children[slot]);
+        }
+        else if(pid > 0)
+        {
+            workers[slot] = pid;
+        }
+        else
+        {
+            /* Let the supervisor free the slot so it can try again. */
+            send_status(slot, -1, 0);
+        }
+    }
+}
+
+static int32_t start_child_forked(struct syscall_child *child)
+{
+    /* The worker claims the slot and updates running_children it's self,
+       so there is no need to wait on a handshake here. */
+    ssize_t ret = write(request_pipe[1], &child->slot, sizeof(uint32_t));
+    if(ret != sizeof(uint32_t))
+    {
+        output->write(ERROR, "Can't send fork request: %s\n", strerror(errno));
+        return (-1);
+    }
+
+    return (0);
+}
+
+static void close_fork_server_pipes(void)
+{
+    uint32_t i;
+
+    for(i = 0; i < 2; i++)
+    {
+        if(request_pipe[i] > -1)
+            (void)close(request_pipe[i]);
+
+        if(status_pipe[i] > -1)
+            (void)close(status_pipe[i]);
+
+        request_pipe[i] = -1;
+        status_pipe[i] = -1;
+    }
+
+    return;
+}
+
+int32_t start_fork_server(void)
+{
+    int32_t rtrn = 0;
+
+    close_fork_server_pipes();
+
+    rtrn = pipe(request_pipe);
+    if(rtrn < 0)
+    {
+        output->write(ERROR, "Request pipe creation failed: %s\n", strerror(errno));
+        return (-1);
+    }
+
+    rtrn = pipe(status_pipe);
+    if(rtrn < 0)
+    {
+        output->write(ERROR, "Status pipe creation failed: %s\n", strerror(errno));
+        return (-1);
+    }
+
+    server_pid = fork();
+    if(server_pid == 0)
+    {
+        (void)close(request_pipe[1]);
+        (void)close(status_pipe[0]);
+
+        if(prepare_child() < 0)
+            _exit(-1);
+
+        /* Run one test case through the generators so the code, PRNG state
+           and argument pages are faulted in before we fork any workers. */
+        struct test_case *test = create_test_case();
+        if(test != NULL)
+        {
+            cleanup_test(test);
+            free_test_case(&test);
+        }
+
+        fork_server_loop();
+    }
+    else if(server_pid < 0)
+    {
+        output->write(ERROR, "Failed to create fork server: %s\n", strerror(errno));
+        return (-1);
+    }
+
+    (void)close(request_pipe[0]);
+    (void)close(status_pipe[1]);
+    request_pipe[0] = -1;
+    status_pipe[1] = -1;
+
+    rtrn = fcntl(status_pipe[0], F_SETFL, O_NONBLOCK);
+    if(rtrn < 0)
+    {
+        output->write(ERROR, "fcntl: %s\n", strerror(errno));
+        return (-1);
+    }
+
+    uint32_t i;
+
+    for(i = 0; i < state->total_children; i++)
+        state->children[i]->start = &start_child_forked;
+
+    return (0);
+}
+
+pid_t get_fork_server_pid(void)
+{
+    return (server_pid);
+}
+
+int32_t get_fork_server_fd(void)
+{
+    return (status_pipe[0]);
+}
+
+/* Write out the test log of a child killed by a signal. */
+static void save_crash_log(struct syscall_child *child, pid_t pid, int32_t sig)
+{
+    char path[4096];
+
+    if(crash_log_prefix == NULL)
+        return;
+
+    int32_t rtrn = snprintf(path, sizeof(path), "%s-crash-%d.tsv", crash_log_prefix, (int)pid);
+    if(rtrn < 0 || (size_t)rtrn >= sizeof(path))
+    {
+        output->write(ERROR, "Crash log path is too long\n");
+        return;
+    }
+
+    if(write_test_log(child->log, path, pid, sig) < 0)
+    {
+        output->write(ERROR, "Failed to save the tests of child %d\n", (int)pid);
+        return;
+    }
+
+    output->write(STD, "Child %d killed by signal %d, it's last tests are in %s\n", (int)pid, sig, path);
+}
+
+/* Check for and forget an abandoned worker. */
+static int32_t is_abandoned(pid_t pid)
+{
+    uint32_t i;
+
+    if(pid <= 0)
+        return (0);
+
+    for(i = 0; i < MAX_ABANDONED; i++)
+    {
+        if(abandoned[i] == pid)
+        {
+            abandoned[i] = 0;
+            return (1);
+        }
+    }
+
+    return (0);
+}
+
+uint32_t reap_fork_server_children(void)
+{
+    uint32_t reaped = 0;
+    struct fork_server_status record;
+
+    while(read(status_pipe[0], &record, sizeof(struct fork_server_status)) == sizeof(struct fork_server_status))
+    {
+        /* Abandoned workers held resources too, now they can be reused. */
+        if(record.pid > 0)
+            (void)reclaim_resources(record.pid);
+
+        if(is_abandoned(record.pid) == 1 || record.slot >= state->total_children)
+            continue;
+
+        reap_syscall_child(state->children[record.slot], record.pid, record.status);
+        reaped++;
+    }
+
+    return (reaped);
+}
+
+uint32_t reap_stuck_children(uint64_t now)
+{
+    uint32_t i;
+    uint32_t killed = 0;
+
+    for(i = 0; i < state->total_children; i++)
+    {
+        struct syscall_child *child = state->children[i];
+        pid_t pid = atomic_load_int32(&child->pid);
+        uint64_t start = atomic_load_uint64(&child->call_start);
+
+        if(pid == EMPTY || pid == INITIALIZING || start == 0 || now < start || now - start < STUCK_CALL_NS)
+            continue;
+
+        (void)kill(pid, SIGKILL);
+        record_syscall_timeout(atomic_load_uint32(&child->call_index));
+        save_crash_log(child, pid, SIGKILL);
+
+        abandoned[abandoned_next] = pid;
+        abandoned_next = (abandoned_next + 1) % MAX_ABANDONED;
+
+        /* The process may stay in uninterruptible sleep for a long time
+           yet. It's pid is no longer in any slot, so when it does exit
+           reap_children() and reap_fork_server_children() ignore it. */
+        atomic_store_uint64(&child->call_start, 0);
+        release_syscall_child(child);
+        killed++;
+    }
+
+    return (killed);
+}
+
 void kill_all_children(void)
 {
     uint32_t i;
@@ -128,10 +844,32 @@ void kill_all_children(void)
     {
         pid_t pid = atomic_load_int32(&state->children[i]->pid);
 
-        /* Ignore errors because we are going to be potentially looping over invalid pids. */
-        kill(pid, SIGKILL);
+        /* EMPTY and INITIALIZING aren't pids, kill(0) would take down our own process group.
+           Ignore errors since the child may have exited already. Once SIGKILL is pending the
+           child can't take more resources, and when the fork server died it's exit record
+           never arrives, so free what it holds right away. */
+        if(pid > INITIALIZING)
+        {
+            (void)kill(pid, SIGKILL);
+            (void)reclaim_resources(pid);
+        }
 
         atomic_store_int32(&state->children[i]->pid, EMPTY);
+
+        /* Every slot is free again. */
+        state->free_slots[i] = state->total_children - i - 1;
+    }
+
+    state->free_count = state->total_children;
+    atomic_store_uint32(&state->running_children, 0);
+
+    /* The same goes for workers reap_stuck_children() gave up on. */
+    for(i = 0; i < MAX_ABANDONED; i++)
+    {
+        if(abandoned[i] > 0)
+            (void)reclaim_resources(abandoned[i]);
+
+        abandoned[i] = 0;
     }
 
     return;
@@ -139,23 +877,51 @@ void kill_all_children(void)
 
 struct syscall_child *create_syscall_child(void)
 {
-    uint32_t i;
-
-    for(i = 0; i < state->total_children; i++)
+    /* Pop slots until we find one we can claim, normally the first one. */
+    while(state->free_count > 0)
     {
-        struct syscall_child *child = state->children[i];
+        state->free_count--;
+
+        struct syscall_child *child = state->children[state->free_slots[state->free_count]];
 
-        if(atomic_load_int32(&child->pid) == EMPTY)
+        /* Try setting this child object to INITIALIZING so other threads won't try and change it. */
+        if(ck_pr_cas_int(&child->pid, EMPTY, INITIALIZING) == true)
         {
-            /* Try setting this child object to INITIALIZING so other threads won't try and change it. */
-            if(ck_pr_cas_int(&child->pid, EMPTY, INITIALIZING) == true)
-                return (child);
+            /* The last process in this slot is gone, it's log was saved if it needed to be. */
+            reset_test_log(child->log);
+            return (child);
         }
     }
 
     return (NULL);
 }
 
+void release_syscall_child(struct syscall_child *child)
+{
+    /* A child that never got to claim it's slot never counted it's self as running. */
+    if(ck_pr_fas_int(&child->pid, EMPTY) != INITIALIZING)
+        atomic_dec_uint32(&state->running_children);
+
+    /* Push the slot back so the next create_syscall_child() call gets it without a scan. */
+    state->free_slots[state->free_count] = child->slot;
+    state->free_count++;
+
+    return;
+}
+
+void reap_syscall_child(struct syscall_child *child, pid_t pid, int32_t status)
+{
+    if(pid > 0 && WIFSIGNALED(status))
+        save_crash_log(child, pid, WTERMSIG(status));
+
+    release_syscall_child(child);
+}
+
+void set_crash_log_prefix(const char *prefix)
+{
+    crash_log_prefix = prefix;
+}
+
 static int32_t stop_child(void)
 {
     atomic_store_uint32(&control->stop, TRUE);
@@ -188,6 +954,13 @@ struct children_state *create_children_state(uint32_t total_children)
         return (NULL);
     }
 
+    child_state->free_slots = allocator->shared(sizeof(uint32_t) * total_children);
+    if(child_state->free_slots == NULL)
+    {
+        output->write(ERROR, "child_state free slot allocation failed\n");
+        return (NULL);
+    }
+
     uint32_t i;
 
     for(i = 0; i < total_children; i++)
@@ -200,8 +973,31 @@ struct children_state *create_children_state(uint32_t total_children)
             return (NULL);
         }
 
+        child_state->children[i]->log = create_test_log();
+        if(child_state->children[i]->log == NULL)
+        {
+            output->write(ERROR, "Child test log allocation failed\n");
+            return (NULL);
+        }
+
+        child_state->children[i]->slot = i;
+        child_state->children[i]->lane = LANE_ANY;
         child_state->children[i]->start = &start_child;
         child_state->children[i]->stop = &stop_child;
+
+        /* Push slots in reverse so the lowest slot is handed out first. */
+        child_state->free_slots[i] = total_children - i - 1;
+    }
+
+    child_state->free_count = total_children;
+
+    /* With more than one child, keep about one in eight for syscalls that block. */
+    if(total_children > 1)
+    {
+        child_state->total_slow = (total_children / 8 > 0) ? total_children / 8 : 1;
+
+        for(i = 0; i < total_children; i++)
+            child_state->children[i]->lane = (i < child_state->total_slow) ? LANE_SLOW : LANE_FAST;
     }
 
     return (child_state);
@@ -221,6 +1017,11 @@ struct syscall_child *get_child_with_pid(pid_t pid)
     return (NULL);
 }
 
+struct syscall_child *get_current_child(void)
+{
+    return (current_child);
+}
+
 void set_children_state(struct children_state *c_state)
 {
     state = c_state;
@@ -252,7 +1053,7 @@ NX_NO_RETURN void jump(struct syscall_child *child)
 {
     /* Jump to the return point saved earlier.
       No need for a return because it will not be executed. */
-    longjmp(child->return_jump, 0);
+    siglongjmp(child->return_jump, 1);
 }
 
 void set_child_pid(struct syscall_child *child, int32_t pid)
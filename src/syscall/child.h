@@ -25,17 +25,32 @@
 enum child_state {EMPTY, INITIALIZING};
 
 struct children_state;
+struct test_log;
 
 struct syscall_child
 {
     pid_t pid;
+    uint32_t slot;
     int32_t (*start)(struct syscall_child *);
     int32_t (*stop)(void);
     int32_t ret_value;
     int32_t had_error;
     int32_t sig_num;
     int32_t did_jump;
-    jmp_buf return_jump;
+
+    /* The enum syscall_lane this worker runs. */
+    uint32_t lane;
+
+    /* The syscall table index of the call in flight and when it started,
+       call_start is zero between calls. The supervisor reads these to find
+       workers stuck in a call their timer couldn't interrupt. */
+    uint32_t call_index;
+    uint64_t call_start;
+
+    /* The last tests this worker ran, kept in case it dies. */
+    struct test_log *log;
+
+    sigjmp_buf return_jump;
 };
 
 /* This children state object is used for sharing
@@ -56,6 +71,17 @@ struct children_state
     /* An array of child context structures. These structures track variables
        local to the child process. */
     struct syscall_child **children;
+
+    /* Stack of child slot indexes that are free to be started. Only the
+       supervisor process pushes and pops, so no locking is needed. */
+    uint32_t *free_slots;
+
+    /* The number of slot indexes currently on the free_slots stack. */
+    uint32_t free_count;
+
+    /* Slots below total_slow run the slow lane, the rest the fast lane.
+       Zero when there are too few children to spare one. */
+    uint32_t total_slow;
 };
 
 /**
@@ -65,6 +91,31 @@ struct children_state
  */
 extern struct syscall_child *create_syscall_child(void);
 
+/**
+ * Return a syscall child object to the free slot stack after it's process
+ * has been reaped, so create_syscall_child() can hand it out again.
+ * Only call this function from the main program thread.
+ * @param child The syscall child object whose process has exited.
+ */
+extern void release_syscall_child(struct syscall_child *child);
+
+/**
+ * Handle the exit of a child process. When it was killed by a signal it's
+ * last tests are written out, then the slot is released.
+ * Only call this function from the main program thread.
+ * @param child The syscall child object whose process has exited.
+ * @param pid The pid the process had.
+ * @param status The exit status from waitpid().
+ */
+extern void reap_syscall_child(struct syscall_child *child, pid_t pid, int32_t status);
+
+/**
+ * Write the last tests of children killed by a signal to prefix followed
+ * by "-crash-<pid>.tsv". Nothing is written until this is called.
+ * @param prefix The path prefix, it must stay valid while children run.
+ */
+extern void set_crash_log_prefix(const char *prefix);
+
 /**
  * Use this function to create a children state object.
  * This state object is used to track info about running syscall children,
@@ -81,10 +132,56 @@ extern struct children_state *create_children_state(uint32_t);
 extern struct syscall_child *get_child_with_pid(pid_t pid);
 
 /**
- * Kill's all syscall children processes currently running.
+ * Start the fork server. The fork server is a template process that sets up
+ * signal handlers, PRNG state and argument pages once, then forks ready to run
+ * workers when asked. After this call child->start() sends a request to the
+ * fork server instead of forking the child from the caller.
+ * @return Zero on success and -1 on failure.
+ */
+extern int32_t start_fork_server(void);
+
+/**
+ * @return The pid of the fork server template process, or -1 when no fork server was started.
+ */
+extern pid_t get_fork_server_pid(void);
+
+/**
+ * The fork server writes an exit record to this descriptor for each worker that exits.
+ * Wait for it to become readable then call reap_fork_server_children().
+ * @return A non blocking descriptor to read exit records from.
+ */
+extern int32_t get_fork_server_fd(void);
+
+/**
+ * Read the exit records sent by the fork server and release the slots of the exited workers.
+ * @return The number of workers that were reaped.
+ */
+extern uint32_t reap_fork_server_children(void);
+
+/**
+ * Kill workers that have been in the same call for much longer than any
+ * timer allows, ie stuck in uninterruptible sleep, and free their slots
+ * right away so a replacement can start while the kill is still pending.
+ * Only call this function from the main program thread.
+ * @param now The current time in nanoseconds.
+ * @return The number of workers that were killed.
+ */
+extern uint32_t reap_stuck_children(uint64_t now);
+
+/**
+ * Kill's all syscall children processes currently running and returns the
+ * resources they, and the workers reap_stuck_children() abandoned, held to
+ * the pools. Safe to call from a signal handler, reclaiming only uses atomics.
  */
 extern void kill_all_children(void);
 
+/**
+ * Return the syscall child object of the calling process while it is executing
+ * a syscall, ie while it's return_jump point is armed.
+ * @return A syscall_child object/struct or NULL when no syscall is in flight.
+ */
+extern struct syscall_child *get_current_child(void);
+
 /**
  * This function will jump to the last saved point of execution.
  * @param The syscall_child object of the child process we want to jump to.
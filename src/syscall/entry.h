@@ -18,6 +18,11 @@
 #ifndef ENTRY_H
 #define ENTRY_H
 
+/* Number of argument slots in an entry and a test case. This has to be
+   a constant expression so it can size arrays, ARG_LIMIT in platform.h can't.
+   It's defined before the includes below since syscall_table.h needs it. */
+#define NX_ARG_SLOTS 9
+
 //#include "runtime/platform.h"
 #include "syscall.h"
 #include "child.h"
@@ -25,9 +30,7 @@
 
 #include <stdbool.h>
 
-enum test_id { V_ID, P_ID, VP_ID, VPV_ID, PV_ID, PVV_ID,
-               PP_ID, VPVVPV_ID, VPVP_ID,
-               VVPV_ID };
+struct arg_desc;
 
 enum syscall_status { ON, OFF };
 
@@ -42,24 +45,32 @@ struct syscall_entry
   const int32_t need_alarm;
   const int32_t requires_root;
 
+  /* NX_YES when the syscall can change the pages of the buffers it's handed,
+     so the buffer pool maps them again before reusing them. */
+  const int32_t damages_buffers;
+
   const char padding[2];
-  int32_t arg_type_array[9];
+  int32_t arg_type_array[NX_ARG_SLOTS];
 
   const uint32_t total_args;
   const uint32_t entry_number;
 
   const char padding2[8];
 
-  struct arg_context *arg_context_array[9];
+  struct arg_context *arg_context_array[NX_ARG_SLOTS];
 
-  int32_t (*get_arg_array[9])(uint64_t **);
+  int32_t (*get_arg_array[NX_ARG_SLOTS])(uint64_t *);
 
-  int32_t (*test_syscall)(int32_t, uint64_t **);
-
-  enum test_id id;
+  /* Set for arguments syscalls.desc describes beyond a plain kind, see struct
+     arg_desc. get_arg_array still holds a plain generator for those. */
+  const struct arg_desc *arg_desc_array[NX_ARG_SLOTS];
 
   uint32_t syscall_number;
 
+  /* The arg_kind of the resource the syscall returns, KIND_INT when it
+     doesn't return one. Programs feed these results to later calls. */
+  const int32_t return_kind;
+
   const char *return_type;
 };
 
@@ -0,0 +1,1276 @@
+/**
+ * Copyright (c) 2016, Harrison Bowden, Minneapolis, MN
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ **/
+
+/**
+*     @file syscall-gen.c
+*     @brief Build time generator for the Linux syscall table. It reads the
+*     syscall numbers from <asm/unistd_64.h> and the argument descriptions from
+*     syscalls.desc, and writes a C file holding every syscall_entry, the static
+*     argument description tables and the linux_syscall_table, including the
+*     table's perfect hash name index and number index. This program runs on
+*     the build host, it only links against syscall_hash.c which depends on
+*     nothing but libc.
+*
+*     The constants flag sets and enums are built from are extracted from the
+*     installed headers first. With --probe syscall-gen writes a probe program
+*     that prints the value of every flag and enum constant the headers
+*     define. The build compiles and runs it, and the resulting list is
+*     handed back to syscall-gen, which writes the values as literals and
+*     drops the constants these headers don't have.
+*
+*     Usage: syscall-gen --probe <syscalls.desc> <probe.c>
+*            syscall-gen <asm/unistd_64.h> <syscalls.desc> <output.c> [constants]
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "syscall_hash.h"
+
+/* Keep these in sync with entry.h and syscall_table.h. */
+#define MAX_ARGS 6
+#define MAX_SYSCALLS 512
+#define MAX_NAME 64
+
+/* A generated symbol is a name, an infix like "_field_" and a number. */
+#define MAX_SYMBOL (MAX_NAME + 32)
+#define MAX_LINE 512
+
+#define MAX_INCLUDES 32
+#define MAX_CONSTANTS 2048
+#define MAX_SETS 128
+#define MAX_STRUCTS 32
+#define MAX_FIELDS 32
+
+/* generate_flags() picks a subset with one random 32 bit word. */
+#define MAX_VALUES 32
+
+/* Structs come from the per test scratch arena, keep them to a page. */
+#define MAX_STRUCT_SIZE 4096
+
+struct arg_kind
+{
+    const char *name;
+    const char *type;
+    const char *generator;
+    const char *kind;
+};
+
+/* Argument kinds a description may use, and the arg type, generator
+   and enum arg_kind value each one maps to. */
+static const struct arg_kind arg_kinds[] = {
+    {"int", "INT", "generate_int", "KIND_INT"},
+    {"ptr", "ADDRESS", "generate_ptr", "KIND_PTR"},
+    {"buf", "ADDRESS", "generate_buf", "KIND_BUF"},
+    {"fd", "FILE_DESC", "generate_fd", "KIND_FD"},
+    {"sock", "SOCKET", "generate_socket", "KIND_SOCKET"},
+    {"pid", "PID", "generate_pid", "KIND_PID"},
+    {"path", "FILE_PATH", "generate_path", "KIND_PATH"}
+};
+
+static const uint32_t total_kinds = sizeof(arg_kinds) / sizeof(arg_kinds[0]);
+
+/* A named flags or enum declaration. */
+struct value_set
+{
+    char name[MAX_NAME];
+    int32_t is_flags;
+    uint32_t count;
+    char values[MAX_VALUES][MAX_NAME];
+    const struct value_set *base;
+    int32_t used;
+};
+
+enum spec_kind { SPEC_PLAIN, SPEC_FLAGS, SPEC_ENUM, SPEC_RANGE, SPEC_LEN, SPEC_STRUCT };
+
+struct struct_desc;
+
+/* How one argument or struct field is generated. */
+struct arg_spec
+{
+    enum spec_kind kind;
+    const struct arg_kind *plain;
+    const struct value_set *set;
+    const struct struct_desc *st;
+    char min[MAX_NAME];
+    char max[MAX_NAME];
+    uint32_t len_slot;
+};
+
+struct field_desc
+{
+    uint32_t size;
+    uint32_t offset;
+    struct arg_spec spec;
+};
+
+struct struct_desc
+{
+    char name[MAX_NAME];
+    uint32_t size;
+    uint32_t total_fields;
+    struct field_desc fields[MAX_FIELDS];
+    int32_t used;
+};
+
+struct syscall_desc
+{
+    char name[MAX_NAME];
+    uint32_t number;
+    uint32_t total_args;
+    struct arg_spec args[MAX_ARGS];
+    const struct arg_kind *ret;
+    int32_t described;
+    int32_t off;
+    int32_t alarm;
+    int32_t root;
+    int32_t remap;
+};
+
+static struct syscall_desc syscalls[MAX_SYSCALLS];
+static uint32_t total_syscalls;
+
+static char includes[MAX_INCLUDES][MAX_NAME];
+static uint32_t total_includes;
+
+static struct value_set sets[MAX_SETS];
+static uint32_t total_sets;
+
+static struct struct_desc structs[MAX_STRUCTS];
+static uint32_t total_structs;
+
+/* A constant the probe program extracted from the headers. */
+struct constant
+{
+    char name[MAX_NAME];
+    uint64_t value;
+};
+
+static struct constant constants[MAX_CONSTANTS];
+static uint32_t total_constants;
+
+/* Set when constants were extracted, values are then written as literals. */
+static int32_t have_constants;
+
+/* Set while writing the probe, syscall lines are ignored then. */
+static int32_t probing;
+
+static struct syscall_desc *find_syscall(const char *name)
+{
+    uint32_t i;
+
+    for(i = 0; i < total_syscalls; i++)
+    {
+        if(strcmp(syscalls[i].name, name) == 0)
+            return (&syscalls[i]);
+    }
+
+    return (NULL);
+}
+
+static const struct arg_kind *find_kind(const char *name)
+{
+    uint32_t i;
+
+    for(i = 0; i < total_kinds; i++)
+    {
+        if(strcmp(arg_kinds[i].name, name) == 0)
+            return (&arg_kinds[i]);
+    }
+
+    return (NULL);
+}
+
+static const struct value_set *find_set(const char *name)
+{
+    uint32_t i;
+
+    for(i = 0; i < total_sets; i++)
+    {
+        if(strcmp(sets[i].name, name) == 0)
+            return (&sets[i]);
+    }
+
+    return (NULL);
+}
+
+static const struct struct_desc *find_struct(const char *name)
+{
+    uint32_t i;
+
+    for(i = 0; i < total_structs; i++)
+    {
+        if(strcmp(structs[i].name, name) == 0)
+            return (&structs[i]);
+    }
+
+    return (NULL);
+}
+
+/* Numbers in syscalls.desc are used as is, everything else is a constant from the headers. */
+static int32_t is_literal(const char *value)
+{
+    return (value[0] == '-' || (value[0] >= '0' && value[0] <= '9'));
+}
+
+static const struct constant *find_constant(const char *name)
+{
+    uint32_t i;
+
+    for(i = 0; i < total_constants; i++)
+    {
+        if(strcmp(constants[i].name, name) == 0)
+            return (&constants[i]);
+    }
+
+    return (NULL);
+}
+
+/* Copy a token into a MAX_NAME buffer, failing on tokens that don't fit. */
+static int32_t copy_name(char *dst, const char *src, const char *path, uint32_t line_number)
+{
+    size_t len = strlen(src);
+
+    if(len >= MAX_NAME)
+    {
+        fprintf(stderr, "syscall-gen: %s:%u: %s is too long\n", path, line_number, src);
+        return (-1);
+    }
+
+    memmove(dst, src, len + 1);
+
+    return (0);
+}
+
+/* Collect every "#define __NR_<name> <number>" line. */
+static int32_t parse_unistd(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if(file == NULL)
+    {
+        fprintf(stderr, "syscall-gen: can't open %s: %s\n", path, strerror(errno));
+        return (-1);
+    }
+
+    char line[MAX_LINE];
+
+    while(fgets(line, sizeof(line), file) != NULL)
+    {
+        char name[MAX_NAME];
+        uint32_t number = 0;
+
+        if(sscanf(line, "#define __NR_%63s %u", name, &number) != 2)
+            continue;
+
+        if(total_syscalls == MAX_SYSCALLS)
+        {
+            fprintf(stderr, "syscall-gen: more than %d syscalls\n", MAX_SYSCALLS);
+            fclose(file);
+            return (-1);
+        }
+
+        struct syscall_desc *desc = &syscalls[total_syscalls++];
+
+        memset(desc, 0, sizeof(struct syscall_desc));
+        memmove(desc->name, name, strlen(name) + 1);
+        desc->number = number;
+    }
+
+    fclose(file);
+
+    if(total_syscalls == 0)
+    {
+        fprintf(stderr, "syscall-gen: no syscalls found in %s\n", path);
+        return (-1);
+    }
+
+    return (0);
+}
+
+/* Parse an argument kind: a plain kind, flags:<set>, enum:<set>,
+   range:<min>:<max>, len:<slot> or struct:<name>. Struct fields
+   only take values, not resources, buffers or lengths. */
+static int32_t parse_arg_spec(char *token, struct arg_spec *spec, int32_t is_field,
+                              const char *path, uint32_t line_number)
+{
+    memset(spec, 0, sizeof(struct arg_spec));
+
+    char *param = strchr(token, ':');
+
+    if(param == NULL)
+    {
+        spec->kind = SPEC_PLAIN;
+        spec->plain = find_kind(token);
+
+        if(spec->plain == NULL || (is_field == 1 && strcmp(token, "int") != 0))
+        {
+            fprintf(stderr, "syscall-gen: %s:%u: unknown argument kind %s\n", path, line_number, token);
+            return (-1);
+        }
+
+        return (0);
+    }
+
+    (*param++) = '\0';
+
+    if(strcmp(token, "flags") == 0 || strcmp(token, "enum") == 0)
+    {
+        spec->kind = (token[0] == 'f') ? SPEC_FLAGS : SPEC_ENUM;
+        spec->set = find_set(param);
+
+        if(spec->set == NULL || spec->set->is_flags != (spec->kind == SPEC_FLAGS))
+        {
+            fprintf(stderr, "syscall-gen: %s:%u: no %s named %s declared\n", path, line_number, token, param);
+            return (-1);
+        }
+
+        return (0);
+    }
+
+    if(strcmp(token, "range") == 0)
+    {
+        char *max = strchr(param, ':');
+        if(max == NULL)
+        {
+            fprintf(stderr, "syscall-gen: %s:%u: range needs a min and a max\n", path, line_number);
+            return (-1);
+        }
+
+        (*max++) = '\0';
+        spec->kind = SPEC_RANGE;
+
+        if(copy_name(spec->min, param, path, line_number) < 0 ||
+           copy_name(spec->max, max, path, line_number) < 0)
+            return (-1);
+
+        return (0);
+    }
+
+    if(strcmp(token, "len") == 0 && is_field == 0)
+    {
+        spec->kind = SPEC_LEN;
+        spec->len_slot = (uint32_t)strtoul(param, NULL, 10);
+
+        if(spec->len_slot >= MAX_ARGS)
+        {
+            fprintf(stderr, "syscall-gen: %s:%u: len:%s is not an argument\n", path, line_number, param);
+            return (-1);
+        }
+
+        return (0);
+    }
+
+    if(strcmp(token, "struct") == 0 && is_field == 0)
+    {
+        spec->kind = SPEC_STRUCT;
+        spec->st = find_struct(param);
+
+        if(spec->st == NULL)
+        {
+            fprintf(stderr, "syscall-gen: %s:%u: no struct named %s declared\n", path, line_number, param);
+            return (-1);
+        }
+
+        return (0);
+    }
+
+    fprintf(stderr, "syscall-gen: %s:%u: unknown argument kind %s\n", path, line_number, token);
+    return (-1);
+}
+
+/* include <header>: a header the generated file needs for the constants used. */
+static int32_t parse_include(const char *path, uint32_t line_number)
+{
+    char *token = strtok(NULL, " \t\r\n");
+
+    if(token == NULL || total_includes == MAX_INCLUDES)
+    {
+        fprintf(stderr, "syscall-gen: %s:%u: bad include\n", path, line_number);
+        return (-1);
+    }
+
+    return (copy_name(includes[total_includes++], token, path, line_number));
+}
+
+/* flags <name> [enum:<name>] <value>... or enum <name> <value>... */
+static int32_t parse_set(int32_t is_flags, const char *path, uint32_t line_number)
+{
+    char *token = strtok(NULL, " \t\r\n");
+
+    if(token == NULL || total_sets == MAX_SETS)
+    {
+        fprintf(stderr, "syscall-gen: %s:%u: bad declaration\n", path, line_number);
+        return (-1);
+    }
+
+    if(find_set(token) != NULL)
+    {
+        fprintf(stderr, "syscall-gen: %s:%u: %s is declared twice\n", path, line_number, token);
+        return (-1);
+    }
+
+    struct value_set *set = &sets[total_sets];
+
+    memset(set, 0, sizeof(struct value_set));
+    set->is_flags = is_flags;
+
+    if(copy_name(set->name, token, path, line_number) < 0)
+        return (-1);
+
+    while((token = strtok(NULL, " \t\r\n")) != NULL)
+    {
+        if(token[0] == '#')
+            break;
+
+        /* A flag set can carry one enum, exactly one of it's values is always set. */
+        if(is_flags == 1 && strncmp(token, "enum:", 5) == 0)
+        {
+            set->base = find_set(token + 5);
+            if(set->base == NULL || set->base->is_flags == 1)
+            {
+                fprintf(stderr, "syscall-gen: %s:%u: no enum named %s declared\n", path, line_number, token + 5);
+                return (-1);
+            }
+
+            continue;
+        }
+
+        if(set->count == MAX_VALUES)
+        {
+            fprintf(stderr, "syscall-gen: %s:%u: %s has more than %d values\n",
+                    path, line_number, set->name, MAX_VALUES);
+            return (-1);
+        }
+
+        if(copy_name(set->values[set->count++], token, path, line_number) < 0)
+            return (-1);
+    }
+
+    if(set->count == 0 && (is_flags == 0 || set->base == NULL))
+    {
+        fprintf(stderr, "syscall-gen: %s:%u: %s has no values\n", path, line_number, set->name);
+        return (-1);
+    }
+
+    total_sets++;
+
+    return (0);
+}
+
+/* struct <name> <u8|u16|u32|u64>:<kind>... Fields are laid out with natural alignment. */
+static int32_t parse_struct(const char *path, uint32_t line_number)
+{
+    char *token = strtok(NULL, " \t\r\n");
+
+    if(token == NULL || total_structs == MAX_STRUCTS)
+    {
+        fprintf(stderr, "syscall-gen: %s:%u: bad struct declaration\n", path, line_number);
+        return (-1);
+    }
+
+    if(find_struct(token) != NULL)
+    {
+        fprintf(stderr, "syscall-gen: %s:%u: struct %s is declared twice\n", path, line_number, token);
+        return (-1);
+    }
+
+    struct struct_desc *st = &structs[total_structs];
+    uint32_t align = 1;
+
+    memset(st, 0, sizeof(struct struct_desc));
+
+    if(copy_name(st->name, token, path, line_number) < 0)
+        return (-1);
+
+    while((token = strtok(NULL, " \t\r\n")) != NULL)
+    {
+        if(token[0] == '#')
+            break;
+
+        char *spec = strchr(token, ':');
+        if(spec == NULL || st->total_fields == MAX_FIELDS)
+        {
+            fprintf(stderr, "syscall-gen: %s:%u: bad field %s\n", path, line_number, token);
+            return (-1);
+        }
+
+        (*spec++) = '\0';
+
+        struct field_desc *field = &st->fields[st->total_fields++];
+
+        if(strcmp(token, "u8") == 0)
+            field->size = 1;
+        else if(strcmp(token, "u16") == 0)
+            field->size = 2;
+        else if(strcmp(token, "u32") == 0)
+            field->size = 4;
+        else if(strcmp(token, "u64") == 0)
+            field->size = 8;
+        else
+        {
+            fprintf(stderr, "syscall-gen: %s:%u: unknown field width %s\n", path, line_number, token);
+            return (-1);
+        }
+
+        if(parse_arg_spec(spec, &field->spec, 1, path, line_number) < 0)
+            return (-1);
+
+        field->offset = (st->size + field->size - 1) & ~(field->size - 1);
+        st->size = field->offset + field->size;
+
+        if(field->size > align)
+            align = field->size;
+    }
+
+    st->size = (st->size + align - 1) & ~(align - 1);
+
+    if(st->total_fields == 0 || st->size > MAX_STRUCT_SIZE)
+    {
+        fprintf(stderr, "syscall-gen: %s:%u: struct %s must have fields and fit in %d bytes\n",
+                path, line_number, st->name, MAX_STRUCT_SIZE);
+        return (-1);
+    }
+
+    total_structs++;
+
+    return (0);
+}
+
+static int32_t parse_desc_line(char *line, const char *path, uint32_t line_number)
+{
+    char *token = strtok(line, " \t\r\n");
+
+    /* Skip blank lines and comments. */
+    if(token == NULL || token[0] == '#')
+        return (0);
+
+    if(strcmp(token, "include") == 0)
+        return (parse_include(path, line_number));
+
+    if(strcmp(token, "flags") == 0)
+        return (parse_set(1, path, line_number));
+
+    if(strcmp(token, "enum") == 0)
+        return (parse_set(0, path, line_number));
+
+    if(strcmp(token, "struct") == 0)
+        return (parse_struct(path, line_number));
+
+    if(probing == 1)
+        return (0);
+
+    struct syscall_desc *desc = find_syscall(token);
+    if(desc == NULL)
+    {
+        /* Older kernel headers won't have every syscall we describe. */
+        fprintf(stderr, "syscall-gen: %s:%u: %s is not in unistd_64.h, skipping\n",
+                path, line_number, token);
+        return (0);
+    }
+
+    if(desc->described == 1)
+    {
+        fprintf(stderr, "syscall-gen: %s:%u: %s is described twice\n", path, line_number, token);
+        return (-1);
+    }
+
+    desc->described = 1;
+
+    while((token = strtok(NULL, " \t\r\n")) != NULL)
+    {
+        if(token[0] == '#')
+            break;
+
+        if(token[0] == '@')
+        {
+            if(strcmp(token, "@off") == 0)
+                desc->off = 1;
+            else if(strcmp(token, "@alarm") == 0)
+                desc->alarm = 1;
+            else if(strcmp(token, "@root") == 0)
+                desc->root = 1;
+            else if(strcmp(token, "@remap") == 0)
+                desc->remap = 1;
+            else
+            {
+                fprintf(stderr, "syscall-gen: %s:%u: unknown flag %s\n", path, line_number, token);
+                return (-1);
+            }
+
+            continue;
+        }
+
+        /* =<kind> marks a syscall that returns a resource later calls of a program can use. */
+        if(token[0] == '=')
+        {
+            const struct arg_kind *ret = find_kind(token + 1);
+            if(ret == NULL || (strcmp(ret->name, "fd") != 0 && strcmp(ret->name, "sock") != 0 &&
+                               strcmp(ret->name, "ptr") != 0))
+            {
+                fprintf(stderr, "syscall-gen: %s:%u: %s can't be returned\n", path, line_number, token);
+                return (-1);
+            }
+
+            desc->ret = ret;
+            continue;
+        }
+
+        if(desc->total_args == MAX_ARGS)
+        {
+            fprintf(stderr, "syscall-gen: %s:%u: %s has more than %d arguments\n",
+                    path, line_number, desc->name, MAX_ARGS);
+            return (-1);
+        }
+
+        if(parse_arg_spec(token, &desc->args[desc->total_args++], 0, path, line_number) < 0)
+            return (-1);
+    }
+
+    uint32_t i;
+
+    /* A length has to describe a buffer. */
+    for(i = 0; i < desc->total_args; i++)
+    {
+        if(desc->args[i].kind != SPEC_LEN)
+            continue;
+
+        struct arg_spec *target = &desc->args[desc->args[i].len_slot];
+
+        if(desc->args[i].len_slot >= desc->total_args ||
+           (target->kind != SPEC_STRUCT && (target->kind != SPEC_PLAIN ||
+            (strcmp(target->plain->name, "buf") != 0 && strcmp(target->plain->name, "ptr") != 0))))
+        {
+            fprintf(stderr, "syscall-gen: %s:%u: len:%u of %s is not a buffer\n",
+                    path, line_number, desc->args[i].len_slot, desc->name);
+            return (-1);
+        }
+    }
+
+    return (0);
+}
+
+static int32_t parse_desc(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if(file == NULL)
+    {
+        fprintf(stderr, "syscall-gen: can't open %s: %s\n", path, strerror(errno));
+        return (-1);
+    }
+
+    char line[MAX_LINE];
+    uint32_t line_number = 0;
+
+    while(fgets(line, sizeof(line), file) != NULL)
+    {
+        line_number++;
+
+        if(parse_desc_line(line, path, line_number) < 0)
+        {
+            fclose(file);
+            return (-1);
+        }
+    }
+
+    fclose(file);
+
+    return (0);
+}
+
+/* Read the "<name> <value>" lines the probe program printed. */
+static int32_t parse_constants(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if(file == NULL)
+    {
+        fprintf(stderr, "syscall-gen: can't open %s: %s\n", path, strerror(errno));
+        return (-1);
+    }
+
+    char line[MAX_LINE];
+
+    while(fgets(line, sizeof(line), file) != NULL)
+    {
+        char name[MAX_NAME];
+        unsigned long long value = 0;
+
+        if(sscanf(line, "%63s %llx", name, &value) != 2)
+            continue;
+
+        if(total_constants == MAX_CONSTANTS)
+        {
+            fprintf(stderr, "syscall-gen: more than %d constants in %s\n", MAX_CONSTANTS, path);
+            fclose(file);
+            return (-1);
+        }
+
+        memmove(constants[total_constants].name, name, strlen(name) + 1);
+        constants[total_constants++].value = (uint64_t)value;
+    }
+
+    fclose(file);
+
+    have_constants = 1;
+
+    return (0);
+}
+
+/* Emit a probe printing every constant the declarations use. Constants
+   are checked with #ifdef so ones missing from these headers are left
+   out instead of breaking the build. */
+static void write_probe_value(FILE *out, const char *value, char printed[][MAX_NAME], uint32_t *total_printed)
+{
+    uint32_t i;
+
+    if(is_literal(value) == 1)
+        return;
+
+    for(i = 0; i < (*total_printed); i++)
+    {
+        if(strcmp(printed[i], value) == 0)
+            return;
+    }
+
+    if((*total_printed) < MAX_CONSTANTS)
+        memmove(printed[(*total_printed)++], value, strlen(value) + 1);
+
+    fprintf(out, "#ifdef %s\n", value);
+    fprintf(out, "    fprintf(out, \"%s 0x%%llx\\n\", (unsigned long long)(uint64_t)(%s));\n", value, value);
+    fprintf(out, "#endif\n");
+}
+
+static int32_t write_probe(const char *path)
+{
+    FILE *out = fopen(path, "w");
+    if(out == NULL)
+    {
+        fprintf(stderr, "syscall-gen: can't create %s: %s\n", path, strerror(errno));
+        return (-1);
+    }
+
+    static char printed[MAX_CONSTANTS][MAX_NAME];
+    uint32_t total_printed = 0;
+    uint32_t i, j;
+
+    fprintf(out, "/* Generated by syscall-gen from syscalls.desc, do not edit. */\n\n");
+    fprintf(out, "#ifndef _GNU_SOURCE\n#define _GNU_SOURCE\n#endif\n\n");
+    fprintf(out, "#include <stdio.h>\n#include <stdint.h>\n");
+
+    for(i = 0; i < total_includes; i++)
+        fprintf(out, "#include %s\n", includes[i]);
+
+
+    fprintf(out, "\nint main(int argc, char *argv[])\n{\n");
+    fprintf(out, "    FILE *out = (argc == 2) ? fopen(argv[1], \"w\") : stdout;\n");
+    fprintf(out, "    if(out == NULL)\n        return (1);\n\n");
+
+    for(i = 0; i < total_sets; i++)
+    {
+        for(j = 0; j < sets[i].count; j++)
+            write_probe_value(out, sets[i].values[j], printed, &total_printed);
+    }
+
+    fprintf(out, "\n    return ((fclose(out) == 0) ? 0 : 1);\n}\n");
+
+    if(fclose(out) != 0)
+    {
+        fprintf(stderr, "syscall-gen: can't write %s: %s\n", path, strerror(errno));
+        return (-1);
+    }
+
+    return (0);
+}
+
+/* Drop the set values these headers don't define. A flag set can lose
+   values, an enum that loses all of them can't be generated. */
+static int32_t resolve_sets(void)
+{
+    uint32_t i, j, kept;
+
+    if(have_constants == 0)
+        return (0);
+
+    for(i = 0; i < total_sets; i++)
+    {
+        struct value_set *set = &sets[i];
+
+        for(j = 0, kept = 0; j < set->count; j++)
+        {
+            if(is_literal(set->values[j]) == 0 && find_constant(set->values[j]) == NULL)
+            {
+                fprintf(stderr, "syscall-gen: %s isn't defined by these headers, leaving it out of %s\n",
+                        set->values[j], set->name);
+                continue;
+            }
+
+            if(kept != j)
+                memmove(set->values[kept], set->values[j], MAX_NAME);
+
+            kept++;
+        }
+
+        set->count = kept;
+
+        if(set->count == 0 && set->is_flags == 0)
+        {
+            fprintf(stderr, "syscall-gen: none of enum %s's values are defined\n", set->name);
+            return (-1);
+        }
+    }
+
+    return (0);
+}
+
+/* Write a value as the probed literal, or as the constant itself when nothing was probed. */
+static void write_value(FILE *out, const char *value)
+{
+    const struct constant *constant = NULL;
+
+    if(have_constants == 1 && is_literal(value) == 0)
+        constant = find_constant(value);
+
+    if(constant != NULL)
+        fprintf(out, "UINT64_C(0x%llx) /* %s */", (unsigned long long)constant->value, value);
+    else
+        fprintf(out, "(uint64_t)(%s)", value);
+}
+
+/* Mark the sets and structs a spec refers to, so only those are written. */
+static void mark_spec(const struct arg_spec *spec)
+{
+    uint32_t i;
+    const struct value_set *set = NULL;
+
+    switch(spec->kind)
+    {
+        case SPEC_FLAGS:
+        case SPEC_ENUM:
+            for(set = spec->set; set != NULL; set = set->base)
+                sets[set - sets].used = 1;
+            break;
+
+        case SPEC_STRUCT:
+            structs[spec->st - structs].used = 1;
+
+            for(i = 0; i < spec->st->total_fields; i++)
+                mark_spec(&spec->st->fields[i].spec);
+
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void mark_used(void)
+{
+    uint32_t i, j;
+
+    for(i = 0; i < total_syscalls; i++)
+    {
+        for(j = 0; j < syscalls[i].total_args; j++)
+            mark_spec(&syscalls[i].args[j]);
+    }
+}
+
+/* Print a symbol made of a name, an infix and a number into a MAX_SYMBOL buffer. */
+static int32_t symbol_name(char *name, const char *base, const char *infix, uint32_t number)
+{
+    int32_t rtrn = snprintf(name, MAX_SYMBOL, "%s%s%u", base, infix, number);
+    if(rtrn < 0 || rtrn >= MAX_SYMBOL)
+    {
+        fprintf(stderr, "syscall-gen: symbol name for %s is too long\n", base);
+        return (-1);
+    }
+
+    return (0);
+}
+
+static void write_sets(FILE *out)
+{
+    uint32_t i, j;
+
+    for(i = 0; i < total_sets; i++)
+    {
+        struct value_set *set = &sets[i];
+
+        /* Unreferenced sets would be unused static variables in the table. */
+        if(set->used == 0)
+            continue;
+
+        if(set->count > 0)
+        {
+            fprintf(out, "static const uint64_t values_%s[] = {\n", set->name);
+
+            for(j = 0; j < set->count; j++)
+            {
+                fprintf(out, "    ");
+                write_value(out, set->values[j]);
+                fprintf(out, ",\n");
+            }
+
+            fprintf(out, "};\n\n");
+        }
+
+        fprintf(out, "static const struct arg_desc desc_%s = {\n", set->name);
+        fprintf(out, "    .kind = %s,\n", set->is_flags ? "KIND_FLAGS" : "KIND_ENUM");
+        fprintf(out, "    .count = %u,\n", set->count);
+
+        if(set->count > 0)
+            fprintf(out, "    .values = values_%s,\n", set->name);
+
+        if(set->base != NULL)
+            fprintf(out, "    .base = &desc_%s,\n", set->base->name);
+
+        fprintf(out, "};\n\n");
+    }
+}
+
+/* Write the static description a spec needs, if it isn't a shared set or struct. */
+static void write_spec_desc(FILE *out, const char *name, struct arg_spec *spec)
+{
+    if(spec->kind == SPEC_RANGE)
+    {
+        fprintf(out, "static const struct arg_desc desc_%s = {\n", name);
+        fprintf(out, "    .kind = KIND_RANGE,\n");
+        fprintf(out, "    .min = ");
+        write_value(out, spec->min);
+        fprintf(out, ",\n    .max = ");
+        write_value(out, spec->max);
+        fprintf(out, ",\n");
+        fprintf(out, "};\n\n");
+    }
+    else if(spec->kind == SPEC_LEN)
+    {
+        fprintf(out, "static const struct arg_desc desc_%s = {\n", name);
+        fprintf(out, "    .kind = KIND_LEN,\n");
+        fprintf(out, "    .min = %u,\n", spec->len_slot);
+        fprintf(out, "};\n\n");
+    }
+}
+
+/* Print a pointer to the description of a spec, ie what write_spec_desc() or write_sets() wrote. */
+static void write_spec_ref(FILE *out, const char *name, struct arg_spec *spec)
+{
+    switch(spec->kind)
+    {
+        case SPEC_FLAGS:
+        case SPEC_ENUM:
+            fprintf(out, "&desc_%s", spec->set->name);
+            break;
+
+        case SPEC_STRUCT:
+            fprintf(out, "&desc_struct_%s", spec->st->name);
+            break;
+
+        case SPEC_RANGE:
+        case SPEC_LEN:
+            fprintf(out, "&desc_%s", name);
+            break;
+
+        default:
+            fprintf(out, "NULL");
+            break;
+    }
+}
+
+static int32_t write_structs(FILE *out)
+{
+    uint32_t i, j;
+    char name[MAX_SYMBOL];
+
+    for(i = 0; i < total_structs; i++)
+    {
+        struct struct_desc *st = &structs[i];
+
+        if(st->used == 0)
+            continue;
+
+        for(j = 0; j < st->total_fields; j++)
+        {
+            if(symbol_name(name, st->name, "_field_", j) < 0)
+                return (-1);
+
+            write_spec_desc(out, name, &st->fields[j].spec);
+        }
+
+        fprintf(out, "static const struct struct_field fields_%s[] = {\n", st->name);
+
+        for(j = 0; j < st->total_fields; j++)
+        {
+            if(symbol_name(name, st->name, "_field_", j) < 0)
+                return (-1);
+
+            fprintf(out, "    {.offset = %u, .size = %u, .desc = ", st->fields[j].offset, st->fields[j].size);
+            write_spec_ref(out, name, &st->fields[j].spec);
+            fprintf(out, "},\n");
+        }
+
+        fprintf(out, "};\n\n");
+
+        fprintf(out, "static const struct arg_desc desc_struct_%s = {\n", st->name);
+        fprintf(out, "    .kind = KIND_STRUCT,\n");
+        fprintf(out, "    .count = %u,\n", st->total_fields);
+        fprintf(out, "    .fields = fields_%s,\n", st->name);
+        fprintf(out, "    .max = %u,\n", st->size);
+        fprintf(out, "};\n\n");
+    }
+
+    return (0);
+}
+
+static int32_t write_entry(FILE *out, struct syscall_desc *desc, uint32_t index)
+{
+    uint32_t i;
+    char name[MAX_SYMBOL];
+
+    for(i = 0; i < desc->total_args; i++)
+    {
+        if(symbol_name(name, desc->name, "_", i) < 0)
+            return (-1);
+
+        write_spec_desc(out, name, &desc->args[i]);
+    }
+
+    fprintf(out, "static struct syscall_entry entry_%s = {\n", desc->name);
+    fprintf(out, "    .syscall_name = \"%s\",\n", desc->name);
+    fprintf(out, "    .syscall_symbol = %u,\n", desc->number);
+    fprintf(out, "    .syscall_number = %u,\n", desc->number);
+    fprintf(out, "    .entry_number = %u,\n", index);
+    fprintf(out, "    .total_args = %u,\n", desc->total_args);
+    fprintf(out, "    .return_type = \"long\",\n");
+    fprintf(out, "    .status = %s,\n", desc->off ? "OFF" : "ON");
+    fprintf(out, "    .need_alarm = %s,\n", desc->alarm ? "NX_YES" : "NX_NO");
+    fprintf(out, "    .requires_root = %s,\n", desc->root ? "NX_YES" : "NX_NO");
+    fprintf(out, "    .damages_buffers = %s,\n", desc->remap ? "NX_YES" : "NX_NO");
+    fprintf(out, "    .return_kind = %s,\n", desc->ret ? desc->ret->kind : "KIND_INT");
+
+    for(i = 0; i < desc->total_args; i++)
+    {
+        struct arg_spec *spec = &desc->args[i];
+
+        if(spec->kind == SPEC_PLAIN)
+        {
+            fprintf(out, "    .arg_type_array[%u] = %s,\n", i, spec->plain->type);
+            fprintf(out, "    .get_arg_array[%u] = &%s,\n", i, spec->plain->generator);
+            continue;
+        }
+
+        /* Described arguments keep a plain generator for callers that don't know about descriptions. */
+        const struct arg_kind *plain = (spec->kind == SPEC_STRUCT) ? find_kind("ptr") : find_kind("int");
+
+        if(symbol_name(name, desc->name, "_", i) < 0)
+            return (-1);
+
+        fprintf(out, "    .arg_type_array[%u] = %s,\n", i, plain->type);
+        fprintf(out, "    .get_arg_array[%u] = &%s,\n", i, plain->generator);
+        fprintf(out, "    .arg_desc_array[%u] = ", i);
+        write_spec_ref(out, name, spec);
+        fprintf(out, ",\n");
+    }
+
+    fprintf(out, "};\n\n");
+
+    return (0);
+}
+
+static void write_uint16_array(FILE *out, const char *field, const uint16_t *array, uint32_t count)
+{
+    uint32_t i;
+
+    fprintf(out, "    .%s = {", field);
+
+    for(i = 0; i < count; i++)
+        fprintf(out, "%s%u,", (i % 16) == 0 ? "\n        " : " ", array[i]);
+
+    fprintf(out, "\n    },\n");
+}
+
+/* Emit the name and number indexes so nothing has to be hashed at startup. */
+static int32_t write_index(FILE *out)
+{
+    uint32_t i;
+    const char *names[MAX_SYSCALLS];
+    static uint16_t seeds[NX_NAME_BUCKETS];
+    static uint16_t slot_index[NX_NAME_SLOTS];
+    static uint64_t slot_hash[NX_NAME_SLOTS];
+    static uint16_t number_index[NX_MAX_SYSCALL_NUMBER];
+
+    for(i = 0; i < total_syscalls; i++)
+        names[i] = syscalls[i].name;
+
+    if(build_name_hash(names, total_syscalls, seeds, slot_index, slot_hash) < 0)
+    {
+        fprintf(stderr, "syscall-gen: can't build the syscall name index\n");
+        return (-1);
+    }
+
+    for(i = 0; i < total_syscalls; i++)
+    {
+        if(syscalls[i].number >= NX_MAX_SYSCALL_NUMBER)
+        {
+            fprintf(stderr, "syscall-gen: %s's number %u is too large to index\n",
+                    syscalls[i].name, syscalls[i].number);
+            return (-1);
+        }
+
+        number_index[syscalls[i].number] = (uint16_t)(i + 1);
+    }
+
+    fprintf(out, "    .indexed = 1,\n");
+
+    write_uint16_array(out, "name_seed", seeds, NX_NAME_BUCKETS);
+    write_uint16_array(out, "name_slot_index", slot_index, NX_NAME_SLOTS);
+
+    fprintf(out, "    .name_slot_hash = {");
+
+    for(i = 0; i < NX_NAME_SLOTS; i++)
+        fprintf(out, "%sUINT64_C(0x%016llx),", (i % 4) == 0 ? "\n        " : " ",
+                (unsigned long long)slot_hash[i]);
+
+    fprintf(out, "\n    },\n");
+
+    write_uint16_array(out, "number_index", number_index, NX_MAX_SYSCALL_NUMBER);
+
+    return (0);
+}
+
+static int32_t write_table(const char *path)
+{
+    FILE *out = fopen(path, "w");
+    if(out == NULL)
+    {
+        fprintf(stderr, "syscall-gen: can't create %s: %s\n", path, strerror(errno));
+        return (-1);
+    }
+
+    uint32_t i, j;
+    uint32_t undescribed = 0;
+
+    fprintf(out, "/* Generated by syscall-gen from <asm/unistd_64.h> and syscalls.desc, do not edit. */\n\n");
+    fprintf(out, "#ifndef _GNU_SOURCE\n#define _GNU_SOURCE\n#endif\n\n");
+
+    for(i = 0; i < total_includes; i++)
+        fprintf(out, "#include %s\n", includes[i]);
+
+    fprintf(out, "\n#include \"entry.h\"\n");
+    fprintf(out, "#include \"generate.h\"\n");
+    fprintf(out, "#include \"arg_types.h\"\n");
+    fprintf(out, "#include \"syscall_table.h\"\n\n");
+
+    mark_used();
+    write_sets(out);
+
+    if(write_structs(out) < 0)
+    {
+        fclose(out);
+        return (-1);
+    }
+
+    for(i = 0, j = 0; i < total_syscalls; i++)
+    {
+        struct syscall_desc *desc = &syscalls[i];
+
+        /* Syscalls nobody described yet keep an entry, so they can be found by
+           name and number, but are switched off. Random ints could hand them
+           anything, a new syscall has to be reviewed before it's fuzzed. */
+        if(desc->described == 0)
+        {
+            desc->total_args = MAX_ARGS;
+            for(j = 0; j < MAX_ARGS; j++)
+            {
+                desc->args[j].kind = SPEC_PLAIN;
+                desc->args[j].plain = &arg_kinds[0];
+            }
+
+            desc->off = 1;
+            undescribed++;
+        }
+
+        if(write_entry(out, desc, i) < 0)
+        {
+            fclose(out);
+            return (-1);
+        }
+    }
+
+    fprintf(out, "struct syscall_table linux_syscall_table = {\n");
+    fprintf(out, "    .total_syscalls = %u,\n", total_syscalls);
+
+    for(i = 0; i < total_syscalls; i++)
+        fprintf(out, "    .sys_entry[%u] = &entry_%s,\n", i, syscalls[i].name);
+
+    if(write_index(out) < 0)
+    {
+        fclose(out);
+        return (-1);
+    }
+
+    fprintf(out, "};\n");
+
+    if(fclose(out) != 0)
+    {
+        fprintf(stderr, "syscall-gen: can't write %s: %s\n", path, strerror(errno));
+        return (-1);
+    }
+
+    if(undescribed > 0)
+        fprintf(stderr, "syscall-gen: %u syscalls have no description, they are switched off\n", undescribed);
+
+    return (0);
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc == 4 && strcmp(argv[1], "--probe") == 0)
+    {
+        probing = 1;
+
+        if(parse_desc(argv[2]) < 0)
+            return (1);
+
+        if(write_probe(argv[3]) < 0)
+            return (1);
+
+        return (0);
+    }
+
+    if(argc != 4 && argc != 5)
+    {
+        fprintf(stderr, "usage: syscall-gen --probe <syscalls.desc> <probe.c>\n");
+        fprintf(stderr, "       syscall-gen <asm/unistd_64.h> <syscalls.desc> <output.c> [constants]\n");
+        return (1);
+    }
+
+    if(parse_unistd(argv[1]) < 0)
+        return (1);
+
+    if(parse_desc(argv[2]) < 0)
+        return (1);
+
+    if(argc == 5 && parse_constants(argv[4]) < 0)
+        return (1);
+
+    if(resolve_sets() < 0)
+        return (1);
+
+    if(write_table(argv[3]) < 0)
+        return (1);
+
+    return (0);
+}
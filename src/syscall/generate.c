@@ -14,6 +14,10 @@
  **/
 
 #include "generate.h"
+#include "program.h"
+#ifdef LINUX
+#include "uring.h"
+#endif
 #include "crypto/random.h"
 #include "io/io.h"
 #include "memory/memory.h"
@@ -24,11 +28,11 @@
 
 #include <unistd.h>
 #include <string.h>
-#include <sys/mman.h>
 #include <errno.h>
 
 static struct output_writter *output;
 static struct memory_allocator *allocator;
+static struct memory_allocator *scratch;
 static struct random_generator *random_gen;
 static struct resource_generator *rsrc_gen;
 
@@ -44,6 +48,10 @@ void inject_generate_deps(struct dependency_context *ctx)
                 allocator = (struct memory_allocator *)ctx->array[i]->interface;
                 break;
 
+            case SCRATCH_ALLOCATOR:
+                scratch = (struct memory_allocator *)ctx->array[i]->interface;
+                break;
+
             case OUTPUT:
                 output = (struct output_writter *)ctx->array[i]->interface;
                 break;
@@ -59,7 +67,7 @@ void inject_generate_deps(struct dependency_context *ctx)
     }
 }
 
-int32_t generate_mach_port(uint64_t **ptr)
+int32_t generate_mach_port(uint64_t *ptr)
 {
   (void)ptr;
 
@@ -67,102 +75,113 @@ int32_t generate_mach_port(uint64_t **ptr)
     return (0);
 }
 
-int32_t generate_ptr(uint64_t **ptr)
+/* Per child pool of guard paged buffers, created on first use so each
+   child, or the fork server before it forks, maps its own. */
+static struct buffer_pool *buffers;
+
+/* The most calls that hold buffers before the pool is reset. */
+#ifdef LINUX
+#define BUFFER_CALLS (NX_URING_BATCH > NX_MAX_CALLS ? NX_URING_BATCH : NX_MAX_CALLS)
+#else
+#define BUFFER_CALLS NX_MAX_CALLS
+#endif
+
+/* Size of the last buffer handed out, KIND_LEN arguments are generated from it. */
+static uint64_t last_buffer_size;
+
+static struct buffer_pool *get_buffers(void)
 {
-  int32_t rtrn = 0;
-  uint32_t number = 0;
-  uint32_t nbytes = 0;
-
-  rtrn = random_gen->range(1023, &nbytes);
-  if(rtrn < 0)
-  {
-      output->write(ERROR, "Can't pick random size\n");
-      return (-1);
-  }
-
-  /* Add one to nbytes so that we don't have a zero.
-  Which would cause mmap to fail on some platforms. */
-  nbytes = nbytes + 1;
-
-  rtrn = random_gen->range(2, &number);
-  if(rtrn < 0)
-  {
-      output->write(ERROR, "Can't pick random number\n");
-      return (-1);
-  }
-
-  switch(number)
-  {
-      case 0:
-          (*ptr) = mmap(NULL, nbytes, PROT_READ | PROT_WRITE,
-                        MAP_ANON | MAP_PRIVATE, -1, 0);
-          if(*ptr == MAP_FAILED)
-          {
-              output->write(ERROR, "mmap: %s\n", strerror(errno));
-              return (-1);
-          }
-          break;
-
-      case 1:
-          (*ptr) =
-              mmap(NULL, nbytes, PROT_READ, MAP_ANON | MAP_PRIVATE, -1, 0);
-          if(*ptr == MAP_FAILED)
-          {
-              output->write(ERROR, "mmap: %s\n", strerror(errno));
-              return (-1);
-          }
-          break;
-
-      case 2:
-          (*ptr) =
-              mmap(NULL, nbytes, PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
-          if(*ptr == MAP_FAILED)
-          {
-              output->write(ERROR, "mmap: %s\n", strerror(errno));
-              return (-1);
-          }
-          break;
-
-      default:
-          output->write(ERROR, "Should not get here\n");
-          return (-1);
-  }
+    if(buffers == NULL)
+    {
+        /* Every argument slot of every call may take a buffer of the same protection. */
+        buffers = create_buffer_pool(BUFFER_CALLS * NX_ARG_SLOTS);
+        if(buffers == NULL)
+            output->write(ERROR, "Can't create buffer pool: %s\n", strerror(errno));
+    }
 
-    return (0);
+    return (buffers);
 }
 
-int32_t generate_fd(uint64_t **fd)
+/* Take a buffer of random size and protection from the buffer pool and
+   store the address in the argument slot. The pool is recycled by cleanup_test(). */
+static int32_t get_random_buffer(uint64_t *slot)
 {
-    /* Allocate the descriptor. */
-    (*fd) = allocator->alloc(sizeof(int32_t));
-    if((*fd) == NULL)
+    int32_t rtrn = 0;
+    uint32_t number = 0;
+    uint32_t nbytes = 0;
+
+    if(get_buffers() == NULL)
+        return (-1);
+
+    rtrn = random_gen->range(1023, &nbytes);
+    if(rtrn < 0)
     {
-        output->write(ERROR, "Can't allocate a descriptor\n");
+        output->write(ERROR, "Can't pick random size\n");
         return (-1);
     }
 
-    /* Get a file descriptor from the descriptor pool. */
-    int32_t desc = rsrc_gen->get_desc();
-    if(desc < 0)
+    /* Add one to nbytes so that we don't have a zero sized buffer. */
+    nbytes = nbytes + 1;
+
+    /* Pick read/write, read only or write only. */
+    rtrn = random_gen->range(BUFFER_PROTS, &number);
+    if(rtrn < 0)
     {
-        output->write(ERROR, "Can't get file descriptor\n");
+        output->write(ERROR, "Can't pick random number\n");
         return (-1);
     }
 
-    memmove((*fd), &desc, sizeof(int32_t));
+    void *buf = get_pool_buffer(buffers, nbytes, (enum buffer_prot)number);
+    if(buf == NULL)
+    {
+        output->write(ERROR, "Buffer pool exhausted\n");
+        return (-1);
+    }
+
+    (*slot) = (uint64_t)(uintptr_t)buf;
+    last_buffer_size = nbytes;
 
     return (0);
 }
 
-int32_t generate_socket(uint64_t **sock)
+void damage_generated_buffers(void)
+{
+    if(buffers != NULL)
+        damage_buffer_pool(buffers);
+}
+
+void reset_generated_buffers(void)
+{
+    if(buffers == NULL)
+        return;
+
+    /* Not fatal, a buffer that couldn't be mapped again only faults the calls that get it. */
+    if(reset_buffer_pool(buffers) < 0)
+        output->write(ERROR, "Can't remap buffer pool: %s\n", strerror(errno));
+}
+
+int32_t generate_ptr(uint64_t *ptr)
 {
-    (*sock) = allocator->alloc(sizeof(int32_t));
-    if((*sock) == NULL)
+    return (get_random_buffer(ptr));
+}
+
+int32_t generate_fd(uint64_t *fd)
+{
+    /* Get a file descriptor from the descriptor pool. */
+    int32_t desc = rsrc_gen->get_desc();
+    if(desc < 0)
     {
-        output->write(ERROR, "Can't allocate socket\n");
+        output->write(ERROR, "Can't get file descriptor\n");
         return (-1);
     }
 
+    (*fd) = (uint64_t)desc;
+
+    return (0);
+}
+
+int32_t generate_socket(uint64_t *sock)
+{
     int32_t sock_fd = 0;
 
     sock_fd = rsrc_gen->get_socket();
@@ -172,139 +191,262 @@ int32_t generate_socket(uint64_t **sock)
         return (-1);
     }
 
-    memmove((*sock), &sock_fd, sizeof(int32_t));
+    (*sock) = (uint64_t)sock_fd;
 
     return (0);
 }
 
-int32_t generate_buf(uint64_t **buf)
+int32_t generate_buf(uint64_t *buf)
+{
+    return (get_random_buffer(buf));
+}
+
+int32_t generate_path(uint64_t *path)
+{
+    char *file_path = rsrc_gen->get_filepath();
+    if(file_path == NULL)
+    {
+        output->write(ERROR, "Can't get file path\n");
+        return (-1);
+    }
+
+    (*path) = (uint64_t)(uintptr_t)file_path;
+
+    return (0);
+}
+
+int32_t generate_int(uint64_t *num)
 {
     int32_t rtrn = 0;
     uint32_t number = 0;
-    uint32_t nbytes = 0;
 
-    rtrn = random_gen->range(1023, &nbytes);
+    rtrn = random_gen->range(INT32_MAX, &number);
     if(rtrn < 0)
     {
-        output->write(ERROR, "Can't pick random size\n");
+        output->write(ERROR, "Failed to generate random number\n");
         return (-1);
     }
 
-    /* Add one to nbytes so that we don't have a zero.
-    Which would cause mmap to fail on some platforms. */
-    nbytes = nbytes + 1;
+    (*num) = number;
 
-    rtrn = random_gen->range(2, &number);
-    if(rtrn < 0)
+    return (0);
+}
+
+int32_t generate_pid(uint64_t *pid)
+{
+    /* Get a sacrificial process from the pid pool. */
+    int32_t id = rsrc_gen->get_pid();
+    if(id < 0)
     {
-        output->write(ERROR, "Can't pick random number\n");
+        output->write(ERROR, "Can't get pid\n");
         return (-1);
     }
 
-    switch(number)
-    {
-        case 0:
-            (*buf) = mmap(NULL, nbytes, PROT_READ | PROT_WRITE,
-                          MAP_ANON | MAP_PRIVATE, -1, 0);
-            if(*buf == MAP_FAILED)
-            {
-                output->write(ERROR, "mmap: %s\n", strerror(errno));
-                return (-1);
-            }
-            break;
-
-        case 1:
-            (*buf) =
-                mmap(NULL, nbytes, PROT_READ, MAP_ANON | MAP_PRIVATE, -1, 0);
-            if(*buf == MAP_FAILED)
-            {
-                output->write(ERROR, "mmap: %s\n", strerror(errno));
-                return (-1);
-            }
-            break;
-
-        case 2:
-            (*buf) =
-                mmap(NULL, nbytes, PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
-            if(*buf == MAP_FAILED)
-            {
-                output->write(ERROR, "mmap: %s\n", strerror(errno));
-                return (-1);
-            }
-            break;
+    (*pid) = (uint64_t)id;
 
-        default:
-            output->write(ERROR, "Should not get here\n");
-            return (-1);
+    return (0);
+}
+
+int32_t (*const generator_table[NX_PLAIN_KINDS])(uint64_t *) = {
+    [KIND_INT] = &generate_int,
+    [KIND_PTR] = &generate_ptr,
+    [KIND_BUF] = &generate_buf,
+    [KIND_FD] = &generate_fd,
+    [KIND_SOCKET] = &generate_socket,
+    [KIND_PID] = &generate_pid,
+    [KIND_PATH] = &generate_path
+};
+
+enum arg_kind get_arg_kind(int32_t (*generator)(uint64_t *))
+{
+    uint32_t i;
+
+    for(i = 0; i < NX_PLAIN_KINDS; i++)
+    {
+        if(generator_table[i] == generator)
+            return ((enum arg_kind)i);
     }
 
-    return (0);
+    return (KIND_CUSTOM);
 }
 
-int32_t generate_path(uint64_t **path)
+uint64_t get_generated_buffer_size(void)
 {
-    (*path) = (uint64_t *)rsrc_gen->get_filepath();
-    if((*path) == NULL)
+    return (last_buffer_size);
+}
+
+static int32_t generate_enum(const struct arg_desc *desc, uint64_t *value)
+{
+    uint32_t number = 0;
+
+    int32_t rtrn = random_gen->range(desc->count, &number);
+    if(rtrn < 0)
     {
-        output->write(ERROR, "Can't get file path\n");
+        output->write(ERROR, "Can't pick enum value\n");
         return (-1);
     }
 
+    (*value) = desc->values[number];
+
     return (0);
 }
 
-int32_t generate_int(uint64_t **num)
+static int32_t generate_flags(const struct arg_desc *desc, uint64_t *value)
 {
-    int32_t rtrn = 0;
-    uint32_t number = 0;
+    uint32_t i;
+    uint32_t mask = 0;
+    uint64_t flags = 0;
 
-    rtrn = random_gen->range(INT32_MAX, &number);
+    /* syscall-gen keeps flag sets to 32 values, so one random word picks the subset. */
+    int32_t rtrn = random_gen->range(UINT32_MAX, &mask);
     if(rtrn < 0)
     {
-        output->write(ERROR, "Failed to generate random number\n");
+        output->write(ERROR, "Can't pick flags\n");
         return (-1);
     }
 
-    (*num) = allocator->alloc(sizeof(uint64_t));
-    if((*num) == NULL)
+    for(i = 0; i < desc->count; i++)
     {
-        output->write(ERROR, "Failed to allocate buffer\n");
-        return (-1);
+        if((mask & (UINT32_C(1) << i)) != 0)
+            flags |= desc->values[i];
+    }
+
+    /* Flag sets like mmap's need exactly one of some values. */
+    if(desc->base != NULL)
+    {
+        uint64_t base = 0;
+
+        rtrn = generate_enum(desc->base, &base);
+        if(rtrn < 0)
+            return (-1);
+
+        flags |= base;
     }
 
-    (**num) = number;
+    (*value) = flags;
 
     return (0);
 }
 
-int32_t generate_pid(uint64_t **pid)
+static int32_t generate_range(const struct arg_desc *desc, uint64_t *value)
 {
-    pid_t id = 0;
+    uint32_t number = 0;
+    uint64_t span = desc->max - desc->min;
+
+    /* Wide ranges are capped, the edges of those are rarely the interesting part. */
+    if(span >= UINT32_MAX)
+        span = UINT32_MAX - 1;
+
+    int32_t rtrn = random_gen->range((uint32_t)span + 1, &number);
+    if(rtrn < 0)
+    {
+        output->write(ERROR, "Can't pick number in range\n");
+        return (-1);
+    }
+
+    (*value) = desc->min + number;
+
+    return (0);
+}
 
-    (*pid) = allocator->alloc(sizeof(uint64_t));
-    if((*pid) == NULL)
+static int32_t generate_struct(const struct arg_desc *desc, uint64_t *value)
+{
+    /* Structs are only ever read and filled in by the kernel, so they come from
+       the scratch arena and leave the guard paged buffers to the buffer arguments. */
+    char *buf = scratch->alloc(desc->max);
+    if(buf == NULL)
     {
-        output->write(ERROR, "Failed to allocate buffer\n");
+        output->write(ERROR, "Scratch arena exhausted\n");
         return (-1);
     }
 
-    id = fork();
-    if(id == 0)
+    uint32_t i;
+    int32_t rtrn = 0;
+
+    for(i = 0; i < desc->count; i++)
     {
-        while(1)
+        const struct struct_field *field = &desc->fields[i];
+        uint64_t field_value = 0;
+        uint32_t low = 0;
+        uint32_t high = 0;
+
+        if(field->desc != NULL)
+        {
+            rtrn = generate_described(field->desc, &field_value);
+        }
+        else
+        {
+            rtrn = random_gen->range(UINT32_MAX, &low);
+            if(rtrn == 0)
+                rtrn = random_gen->range(UINT32_MAX, &high);
+
+            field_value = ((uint64_t)high << 32) | low;
+        }
+
+        if(rtrn < 0)
         {
-            usleep(1000);
+            output->write(ERROR, "Can't generate struct field\n");
+            return (-1);
         }
+
+        /* Fields are at most 8 bytes, copying the low bytes truncates on little endian hosts. */
+        memcpy(buf + field->offset, &field_value, field->size);
     }
-    else if(id > 0)
+
+    (*value) = (uint64_t)(uintptr_t)buf;
+    last_buffer_size = desc->max;
+
+    return (0);
+}
+
+int32_t generate_described(const struct arg_desc *desc, uint64_t *value)
+{
+    switch(desc->kind)
     {
-        (**pid) = (uint64_t) id;
+        case KIND_FLAGS:
+            return (generate_flags(desc, value));
 
+        case KIND_ENUM:
+            return (generate_enum(desc, value));
+
+        case KIND_RANGE:
+            return (generate_range(desc, value));
+
+        case KIND_STRUCT:
+            return (generate_struct(desc, value));
+
+        default:
+            output->write(ERROR, "Can't generate argument of kind %d\n", desc->kind);
+            return (-1);
+    }
+}
+
+int32_t generate_length(uint64_t size, uint64_t *len)
+{
+    uint32_t number = 0;
+
+    int32_t rtrn = random_gen->range(4, &number);
+    if(rtrn < 0)
+    {
+        output->write(ERROR, "Can't pick random number\n");
+        return (-1);
+    }
+
+    /* Mostly the exact size so the call gets past argument checks, sometimes shorter. */
+    if(number > 0 || size == 0)
+    {
+        (*len) = size;
         return (0);
     }
-    else
+
+    rtrn = random_gen->range((uint32_t)size, &number);
+    if(rtrn < 0)
     {
-        output->write(ERROR, "Failed to create child process: %s\n", strerror(errno));
+        output->write(ERROR, "Can't pick random number\n");
         return (-1);
     }
+
+    (*len) = number;
+
+    return (0);
 }
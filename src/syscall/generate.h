@@ -22,22 +22,103 @@
 
 #include <stdint.h>
 
+/* Argument kinds. The plain kinds, KIND_INT up to KIND_PATH, index generator_table.
+   KIND_FLAGS up to KIND_STRUCT are generated from the entry's struct arg_desc.
+   KIND_CUSTOM means the entry uses a generator outside the table, so the
+   entry's own function pointer is called. The hot syscall table stores
+   these instead of generator function pointers. */
+enum arg_kind { KIND_INT, KIND_PTR, KIND_BUF, KIND_FD, KIND_SOCKET, KIND_PID, KIND_PATH,
+                KIND_FLAGS, KIND_ENUM, KIND_RANGE, KIND_LEN, KIND_STRUCT, KIND_CUSTOM };
+
+/* The number of plain kinds in generator_table. */
+#define NX_PLAIN_KINDS KIND_FLAGS
+
+/* A field of a described struct, filled in from desc or with random bytes when desc is NULL. */
+struct struct_field
+{
+    uint16_t offset;
+    uint16_t size;
+    const char padding[4];
+    const struct arg_desc *desc;
+};
+
+/* Describes an argument syscall-gen generated from syscalls.desc.
+   KIND_FLAGS   OR of a random subset of values, plus one value of base when it's set.
+   KIND_ENUM    One of values.
+   KIND_RANGE   A number from min to max.
+   KIND_LEN     The size of the buffer in argument slot min.
+   KIND_STRUCT  A buffer of size max bytes holding fields. */
+struct arg_desc
+{
+    int32_t kind;
+    uint32_t count;
+    const uint64_t *values;
+    const struct arg_desc *base;
+    const struct struct_field *fields;
+    uint64_t min;
+    uint64_t max;
+};
+
+extern int32_t (*const generator_table[NX_PLAIN_KINDS])(uint64_t *);
+
+/**
+ * Generate an argument from it's description. KIND_LEN arguments are
+ * generated with generate_length() instead, as they depend on another argument.
+ * @param desc The description of the argument.
+ * @param value Where the argument is stored.
+ * @return Zero on success and -1 on failure.
+ */
+extern int32_t generate_described(const struct arg_desc *desc, uint64_t *value);
+
+/**
+ * Generate a length for a buffer, usually it's exact size.
+ * @param size The size of the buffer.
+ * @param len Where the length is stored.
+ * @return Zero on success and -1 on failure.
+ */
+extern int32_t generate_length(uint64_t size, uint64_t *len);
+
+/**
+ * @return The size of the last buffer generate_ptr(), generate_buf()
+ * or a described struct handed out.
+ */
+extern uint64_t get_generated_buffer_size(void);
+
+/**
+ * Map a generator function to it's argument kind.
+ * @param generator The generator function of a syscall entry argument.
+ * @return The argument kind, KIND_CUSTOM when the generator is not in generator_table.
+ */
+extern enum arg_kind get_arg_kind(int32_t (*generator)(uint64_t *));
+
 extern void inject_generate_deps(struct dependency_context *ctx);
 
-extern int32_t generate_int(uint64_t **num);
+extern int32_t generate_int(uint64_t *num);
 
-extern int32_t generate_mach_port(uint64_t **ptr);
+extern int32_t generate_mach_port(uint64_t *ptr);
 
-extern int32_t generate_ptr(uint64_t **ptr);
+extern int32_t generate_ptr(uint64_t *ptr);
 
-extern int32_t generate_fd(uint64_t **fd);
+extern int32_t generate_fd(uint64_t *fd);
 
-extern int32_t generate_socket(uint64_t **sock);
+extern int32_t generate_socket(uint64_t *sock);
 
-extern int32_t generate_buf(uint64_t **buf);
+extern int32_t generate_buf(uint64_t *buf);
 
-extern int32_t generate_pid(uint64_t **pid);
+extern int32_t generate_pid(uint64_t *pid);
 
-extern int32_t generate_path(uint64_t **path);
+extern int32_t generate_path(uint64_t *path);
+
+/**
+ * Have the buffers given out for the current test mapped again when they are
+ * handed back, for syscalls that can change their pages.
+ */
+extern void damage_generated_buffers(void);
+
+/**
+ * Hand every buffer given out by generate_buf() and generate_ptr()
+ * back to the buffer pool, called once a test case is done.
+ */
+extern void reset_generated_buffers(void);
 
 #endif
@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2015, Harrison Bowden, Minneapolis, MN
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ **/
+
+#include "lane.h"
+#include "crypto/random.h"
+#include "concurrent/concurrent.h"
+#include "io/io.h"
+#include "memory/memory.h"
+
+#include <string.h>
+
+static struct output_writter *output;
+static struct memory_allocator *allocator;
+static struct random_generator *random_gen;
+
+/* Syscalls averaging more than this per call over a window are slow. */
+static const uint64_t SLOW_LATENCY_NS = 10000000;
+
+/* A slow syscall turns fast again when it averages less than this. */
+static const uint64_t FAST_LATENCY_NS = 1000000;
+
+/* Calls a window needs before it's average latency is trusted, a slow
+   syscall needs more since unblocking it is the riskier mistake. */
+static const uint64_t SLOW_MIN_CALLS = 16;
+static const uint64_t FAST_MIN_CALLS = 64;
+
+/* Supervisor side state, the counters as of the window each syscall was last judged in. */
+struct lane_window
+{
+    uint64_t calls;
+    uint64_t total_ns;
+    uint64_t timeouts;
+};
+
+static struct lane_window last[NX_MAX_SYSCALLS];
+
+/* Write the slow list that isn't live from slow[] and make it live. */
+static void publish_slow_list(struct lane_state *lanes, struct syscall_table *table)
+{
+    uint32_t i;
+    uint32_t generation = atomic_load_uint32(&lanes->generation);
+    struct slow_list *list = &lanes->lists[(generation + 1) & 1];
+
+    list->count = 0;
+
+    for(i = 0; i < table->total_active; i++)
+    {
+        uint16_t index = table->active[i];
+
+        if(lanes->slow[index] == 1)
+            list->index[list->count++] = index;
+    }
+
+    /* The new list must be visible before the generation that points to it. */
+    ck_pr_fence_store();
+    atomic_store_uint32(&lanes->generation, generation + 1);
+
+    return;
+}
+
+struct lane_state *create_lane_state(struct syscall_table *table)
+{
+    struct lane_state *lanes = NULL;
+
+    lanes = allocator->shared(sizeof(struct lane_state));
+    if(lanes == NULL)
+    {
+        output->write(ERROR, "Failed to allocate lane state\n");
+        return (NULL);
+    }
+
+    memset(lanes, 0, sizeof(struct lane_state));
+    memset(last, 0, sizeof(last));
+
+    uint32_t i;
+
+    /* Start from the syscalls the descriptions say can block. */
+    for(i = 0; i < table->total_syscalls; i++)
+        lanes->slow[i] = ((table->hot[i].flags & SYSCALL_ALARM) != 0);
+
+    publish_slow_list(lanes, table);
+
+    return (lanes);
+}
+
+void classify_syscalls(struct lane_state *lanes, struct syscall_table *table, struct result_stats *stats)
+{
+    uint32_t i;
+    uint32_t changed = 0;
+
+    for(i = 0; i < table->total_active; i++)
+    {
+        uint16_t index = table->active[i];
+        struct syscall_results *results = &stats->results[index];
+        struct lane_window now;
+        struct lane_window window;
+
+        now.calls = get_result_calls(stats, index);
+        now.total_ns = atomic_load_uint64(&results->total_ns);
+        now.timeouts = atomic_load_uint64(&results->timeouts);
+
+        window.calls = now.calls - last[index].calls;
+        window.total_ns = now.total_ns - last[index].total_ns;
+        window.timeouts = now.timeouts - last[index].timeouts;
+
+        uint8_t slow = lanes->slow[index];
+
+        if(window.timeouts > 0)
+        {
+            slow = 1;
+        }
+        else if(slow == 0 && window.calls >= SLOW_MIN_CALLS)
+        {
+            slow = ((window.total_ns / window.calls) > SLOW_LATENCY_NS);
+        }
+        else if(slow == 1 && window.calls >= FAST_MIN_CALLS)
+        {
+            slow = ((window.total_ns / window.calls) >= FAST_LATENCY_NS);
+        }
+        else
+        {
+            /* Not enough calls to judge, keep accumulating the window. */
+            continue;
+        }
+
+        last[index] = now;
+
+        if(slow != lanes->slow[index])
+        {
+            lanes->slow[index] = slow;
+            changed = 1;
+        }
+    }
+
+    if(changed == 1)
+        publish_slow_list(lanes, table);
+
+    return;
+}
+
+int32_t is_slow_syscall(struct lane_state *lanes, uint32_t index)
+{
+    return (ck_pr_load_8(&lanes->slow[index]) == 1);
+}
+
+int32_t pick_slow_syscall(struct lane_state *lanes, uint32_t *index)
+{
+    int32_t rtrn = 0;
+    uint32_t generation = 0;
+    uint32_t count = 0;
+    uint32_t offset = 0;
+    struct slow_list *list = NULL;
+
+    /* Same as select_weighted(), a pick that raced a publish is retried. */
+    do
+    {
+        generation = atomic_load_uint32(&lanes->generation);
+        ck_pr_fence_load();
+
+        list = &lanes->lists[generation & 1];
+        count = ck_pr_load_32(&list->count);
+
+        if(count == 0)
+            return (-1);
+
+        rtrn = random_gen->range(count, &offset);
+        if(rtrn < 0)
+        {
+            output->write(ERROR, "Failed to pick slow syscall\n");
+            return (-1);
+        }
+
+        (*index) = list->index[offset];
+
+        ck_pr_fence_load();
+
+    } while(atomic_load_uint32(&lanes->generation) != generation);
+
+    return (0);
+}
+
+void inject_lane_deps(struct dependency_context *ctx)
+{
+    uint32_t i;
+
+    for(i = 0; i < ctx->count; i++)
+    {
+        switch((int32_t)ctx->array[i]->name)
+        {
+            case ALLOCATOR:
+                allocator = (struct memory_allocator *)ctx->array[i]->interface;
+                break;
+
+            case OUTPUT:
+                output = (struct output_writter *)ctx->array[i]->interface;
+                break;
+
+            case RANDOM_GEN:
+                random_gen = (struct random_generator *)ctx->array[i]->interface;
+                break;
+        }
+    }
+
+    return;
+}
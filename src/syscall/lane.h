@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2015, Harrison Bowden, Minneapolis, MN
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ **/
+
+#ifndef NX_LANE_H
+#define NX_LANE_H
+
+#include "syscall_table.h"
+#include "results.h"
+#include "depend-inject/depend-inject.h"
+
+#include <stdint.h>
+
+/* Which syscalls a worker runs. LANE_ANY workers run everything, it's
+   what a process runs until it's told otherwise and what every worker
+   runs when there is no slow lane. */
+enum syscall_lane { LANE_ANY, LANE_FAST, LANE_SLOW };
+
+/* The syscall table indexes of the syscalls classified as slow. */
+struct slow_list
+{
+    uint32_t count;
+    uint16_t index[NX_MAX_SYSCALLS];
+};
+
+/* Lives in shared memory. The supervisor classifies syscalls by their
+   measured latency and timeouts, writes the list that isn't live and then
+   bumps generation, generation & 1 is the live list. slow[] is read with
+   plain byte loads, a worker acting on a stale flag only costs a timer. */
+struct lane_state
+{
+    uint32_t generation;
+    const char padding[4];
+    uint8_t slow[NX_MAX_SYSCALLS];
+    struct slow_list lists[2];
+};
+
+/**
+ * Create the lane state in shared memory. Until there are measurements
+ * syscalls flagged as needing an alarm are classified slow.
+ * @param table The syscall table to classify.
+ * @return The lane state on success and NULL on failure.
+ */
+extern struct lane_state *create_lane_state(struct syscall_table *table);
+
+/**
+ * Reclassify the active syscalls from the latency and timeouts recorded
+ * since the last call. A syscall turns slow when one of it's calls timed
+ * out or it's average latency is high, and fast again after a window of
+ * quick calls without timeouts. Only the supervisor should call this.
+ * @param lanes The lane state to update.
+ * @param table The syscall table the lane state was created with.
+ * @param stats The result histograms the children record latency to.
+ */
+extern void classify_syscalls(struct lane_state *lanes, struct syscall_table *table, struct result_stats *stats);
+
+/**
+ * @param lanes The lane state to read.
+ * @param index The syscall table index of the syscall.
+ * @return One when the syscall is classified slow, zero otherwise.
+ */
+extern int32_t is_slow_syscall(struct lane_state *lanes, uint32_t index);
+
+/**
+ * Pick a syscall uniformly from the live slow list.
+ * @param lanes The lane state to pick from.
+ * @param index Where the picked syscall table index is stored.
+ * @return Zero on success and -1 when no syscall is slow.
+ */
+extern int32_t pick_slow_syscall(struct lane_state *lanes, uint32_t *index);
+
+extern void inject_lane_deps(struct dependency_context *ctx);
+
+#endif
@@ -1,30 +0,0 @@
-
-
-/**
- * Copyright (c) 2016, Harrison Bowden, Minneapolis, MN
- *
- * Permission to use, copy, modify, and/or distribute this software for any purpose
- * with or without fee is hereby granted, provided that the above copyright notice
- * and this permission notice appear in all copies.
- *
- * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
- * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
- * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
- * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
- * WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
- * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
- **/
-
-#ifndef LINUX_SYSCALL_TABLE_H
-#define LINUX_SYSCALL_TABLE_H
-
-#include "syscall_list.h"
-#include "syscall_table.h"
-
-struct syscall_table linux_syscall_table = {
-
-    .total_syscalls = 1,
-    .sys_entry[0] = &entry_read,
-};
-
-#endif
@@ -0,0 +1,461 @@
+/*
+ * Copyright (c) 2015, Harrison Bowden, Minneapolis, MN
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ **/
+
+#include "program.h"
+#include "generate.h"
+#include "crypto/random.h"
+#include "io/io.h"
+#include "memory/memory.h"
+
+#include <string.h>
+
+static struct output_writter *output;
+static struct memory_allocator *allocator;
+static struct random_generator *random_gen;
+
+/* Marks an argument that keeps it's generated value. */
+#define NO_REF 0xff
+
+/* Each call is a reused test case. arg_ref holds, for every argument of
+   every call, the index of the earlier call whose result is passed in
+   place of the generated value, or NO_REF. total_executed counts the calls
+   that returned, only their results are passed on and released. */
+struct program
+{
+    uint32_t total_calls;
+    uint32_t total_executed;
+    uint8_t arg_ref[NX_MAX_CALLS][NX_ARG_SLOTS];
+    struct test_case *calls[NX_MAX_CALLS];
+};
+
+/* Table indexes of the active syscalls that return a resource. */
+static uint16_t producers[NX_MAX_SYSCALLS];
+static uint32_t total_producers;
+static uint32_t producers_ready;
+
+struct program *alloc_program(void)
+{
+    struct program *prog = NULL;
+
+    prog = allocator->alloc(sizeof(struct program));
+    if(prog == NULL)
+    {
+        output->write(ERROR, "Failed to allocate program\n");
+        return (NULL);
+    }
+
+    memset(prog, 0, sizeof(struct program));
+
+    uint32_t i;
+
+    for(i = 0; i < NX_MAX_CALLS; i++)
+    {
+        prog->calls[i] = alloc_test_case();
+        if(prog->calls[i] == NULL)
+        {
+            output->write(ERROR, "Failed to allocate program call\n");
+            free_program(&prog);
+            return (NULL);
+        }
+    }
+
+    return (prog);
+}
+
+void free_program(struct program **prog)
+{
+    uint32_t i;
+
+    for(i = 0; i < NX_MAX_CALLS; i++)
+    {
+        if((*prog)->calls[i] != NULL)
+            free_test_case(&(*prog)->calls[i]);
+    }
+
+    allocator->free((void **)prog);
+}
+
+uint32_t get_total_calls(struct program *prog)
+{
+    return (prog->total_calls);
+}
+
+struct test_case *get_program_call(struct program *prog, uint32_t call)
+{
+    return (prog->calls[call]);
+}
+
+static const struct syscall_hot *get_call_hot(struct program *prog, uint32_t call)
+{
+    return (&get_table()->hot[get_syscall_index(prog->calls[call])]);
+}
+
+/* Whether an argument of arg_kind can be handed a result of return_kind. */
+static int32_t accepts_result(uint8_t arg_kind, uint8_t return_kind)
+{
+    switch(arg_kind)
+    {
+        case KIND_FD:
+            /* Sockets are file descriptors too. */
+            return (return_kind == KIND_FD || return_kind == KIND_SOCKET);
+
+        case KIND_SOCKET:
+            return (return_kind == KIND_SOCKET);
+
+        case KIND_PTR:
+        case KIND_BUF:
+            return (return_kind == KIND_PTR);
+
+        default:
+            return (0);
+    }
+}
+
+/* Point the arguments of a call at the results of earlier calls they can use. */
+static int32_t link_call(struct program *prog, uint32_t call)
+{
+    uint32_t i, j;
+    int32_t rtrn = 0;
+    const struct syscall_hot *hot = get_call_hot(prog, call);
+
+    memset(prog->arg_ref[call], NO_REF, NX_ARG_SLOTS);
+
+    for(i = 0; i < hot->total_args; i++)
+    {
+        uint8_t candidates[NX_MAX_CALLS];
+        uint32_t total_candidates = 0;
+
+        for(j = 0; j < call; j++)
+        {
+            if(accepts_result(hot->arg_kind[i], get_call_hot(prog, j)->return_kind) == 1)
+                candidates[total_candidates++] = (uint8_t)j;
+        }
+
+        if(total_candidates == 0)
+            continue;
+
+        uint32_t number = 0;
+
+        /* Leave a quarter of the arguments generated, so pool resources get used too. */
+        rtrn = random_gen->range(4, &number);
+        if(rtrn < 0)
+        {
+            output->write(ERROR, "Can't pick random number\n");
+            return (-1);
+        }
+
+        if(number == 0)
+            continue;
+
+        rtrn = random_gen->range(total_candidates, &number);
+        if(rtrn < 0)
+        {
+            output->write(ERROR, "Can't pick random number\n");
+            return (-1);
+        }
+
+        prog->arg_ref[call][i] = candidates[number];
+    }
+
+    return (0);
+}
+
+/* Pick a syscall that returns a resource, programs usually start with one. */
+static int32_t pick_producer(uint32_t *index)
+{
+    if(producers_ready == 0)
+    {
+        uint32_t i;
+        struct syscall_table *table = get_table();
+
+        for(i = 0; i < table->total_active; i++)
+        {
+            if(table->hot[table->active[i]].return_kind != KIND_INT)
+                producers[total_producers++] = table->active[i];
+        }
+
+        producers_ready = 1;
+    }
+
+    if(total_producers == 0)
+        return (-1);
+
+    uint32_t i;
+    uint32_t number = 0;
+
+    /* Producers that block, ie accept, are left to the slow workers. */
+    for(i = 0; i < total_producers; i++)
+    {
+        int32_t rtrn = random_gen->range(total_producers, &number);
+        if(rtrn < 0)
+        {
+            output->write(ERROR, "Can't pick random number\n");
+            return (-1);
+        }
+
+        if(in_syscall_lane(producers[number]) == 1)
+        {
+            (*index) = producers[number];
+            return (0);
+        }
+    }
+
+    return (-1);
+}
+
+int32_t generate_program(struct program *prog)
+{
+    uint32_t i;
+    int32_t rtrn = 0;
+    uint32_t total_calls = 0;
+
+    rtrn = random_gen->range(NX_MAX_CALLS, &total_calls);
+    if(rtrn < 0)
+    {
+        output->write(ERROR, "Can't pick program length\n");
+        return (-1);
+    }
+
+    total_calls++;
+
+    prog->total_calls = 0;
+    prog->total_executed = 0;
+
+    for(i = 0; i < total_calls; i++)
+    {
+        uint32_t index = 0;
+
+        if(i == 0 && total_calls > 1 && pick_producer(&index) == 0)
+            rtrn = init_test_case_at(prog->calls[i], index);
+        else
+            rtrn = init_test_case(prog->calls[i]);
+
+        if(rtrn < 0)
+        {
+            /* Running short of pool resources only makes the program shorter. */
+            if(i > 0)
+                break;
+
+            output->write(ERROR, "Failed to generate program\n");
+            return (-1);
+        }
+
+        prog->total_calls = i + 1;
+
+        rtrn = link_call(prog, i);
+        if(rtrn < 0)
+        {
+            cleanup_program(prog);
+            return (-1);
+        }
+    }
+
+    return (0);
+}
+
+int32_t mutate_program(struct program *prog)
+{
+    uint32_t i;
+    int32_t rtrn = 0;
+    uint32_t total_calls = prog->total_calls;
+
+    prog->total_calls = 0;
+    prog->total_executed = 0;
+
+    /* Same calls with fresh arguments. */
+    for(i = 0; i < total_calls; i++)
+    {
+        rtrn = init_test_case_at(prog->calls[i], get_syscall_index(prog->calls[i]));
+        if(rtrn < 0)
+        {
+            /* Like in generate_program(), running short of resources makes the program shorter. */
+            if(i > 0)
+                return (0);
+
+            output->write(ERROR, "Failed to mutate program\n");
+            return (-1);
+        }
+
+        prog->total_calls = i + 1;
+    }
+
+    uint32_t operation = 0;
+    uint32_t call = 0;
+
+    rtrn = random_gen->range(3, &operation);
+    if(rtrn < 0)
+        goto fail;
+
+    rtrn = random_gen->range(total_calls, &call);
+    if(rtrn < 0)
+        goto fail;
+
+    switch(operation)
+    {
+        /* Rewire the arguments of one call. */
+        case 0:
+            rtrn = link_call(prog, call);
+            break;
+
+        /* Swap one call for another syscall, later calls may have used it's result. */
+        case 1:
+            /* The other calls keep their buffers, only this call's resources go back. */
+            release_test_args(prog->calls[call]);
+
+            rtrn = init_test_case(prog->calls[call]);
+            if(rtrn < 0)
+            {
+                /* Drop the call and everything after it. */
+                for(i = call + 1; i < total_calls; i++)
+                    release_test_args(prog->calls[i]);
+
+                prog->total_calls = call;
+                if(call == 0)
+                {
+                    output->write(ERROR, "Failed to mutate program\n");
+                    return (-1);
+                }
+
+                return (0);
+            }
+
+            for(i = call; i < total_calls && rtrn == 0; i++)
+                rtrn = link_call(prog, i);
+
+            break;
+
+        /* Grow or shrink the program by one call. */
+        default:
+            if(total_calls < NX_MAX_CALLS)
+            {
+                /* Not fatal, the program just doesn't grow. */
+                if(init_test_case(prog->calls[total_calls]) < 0)
+                    break;
+
+                prog->total_calls = total_calls + 1;
+                rtrn = link_call(prog, total_calls);
+            }
+            else
+            {
+                release_test_args(prog->calls[total_calls - 1]);
+                prog->total_calls = total_calls - 1;
+            }
+
+            break;
+    }
+
+    if(rtrn < 0)
+        goto fail;
+
+    return (0);
+
+fail:
+    output->write(ERROR, "Failed to mutate program\n");
+    cleanup_program(prog);
+    return (-1);
+}
+
+int32_t next_program(struct program *prog)
+{
+    if(prog->total_calls == 0)
+        return (generate_program(prog));
+
+    uint32_t number = 0;
+
+    int32_t rtrn = random_gen->range(4, &number);
+    if(rtrn < 0)
+    {
+        output->write(ERROR, "Can't pick random number\n");
+        return (-1);
+    }
+
+    /* Mostly keep the shape of the last program, it's what reaches the deeper paths. */
+    if(number == 0)
+        return (generate_program(prog));
+
+    return (mutate_program(prog));
+}
+
+void link_program_call(struct program *prog, uint32_t call)
+{
+    uint32_t i;
+    struct test_case *test = prog->calls[call];
+    uint64_t *args = get_argument_array(test);
+    uint32_t total_args = get_total_args(test);
+
+    for(i = 0; i < total_args; i++)
+    {
+        uint8_t ref = prog->arg_ref[call][i];
+
+        /* A failed call has no result to pass on, the generated value is used instead. */
+        if(ref == NO_REF || ref >= prog->total_executed || get_error(prog->calls[ref]) != 0)
+            continue;
+
+        args[i] = (uint64_t)get_return_value(prog->calls[ref]);
+    }
+
+    return;
+}
+
+int32_t execute_program_call(struct program *prog, uint32_t call)
+{
+    int32_t rtrn = execute_test(prog->calls[call]);
+
+    prog->total_executed = call + 1;
+
+    return (rtrn);
+}
+
+/* Release the resource a call returned. */
+void cleanup_program(struct program *prog)
+{
+    uint32_t i;
+
+    /* Release results newest first, a later call may hold a mapping of an earlier descriptor. */
+    for(i = prog->total_executed; i > 0; i--)
+        release_test_result(prog->calls[i - 1]);
+
+    for(i = 0; i < prog->total_calls; i++)
+        cleanup_test(prog->calls[i]);
+
+    prog->total_executed = 0;
+
+    return;
+}
+
+void inject_program_deps(struct dependency_context *ctx)
+{
+    uint32_t i;
+
+    for(i = 0; i < ctx->count; i++)
+    {
+        switch((int32_t)ctx->array[i]->name)
+        {
+            case ALLOCATOR:
+                allocator = (struct memory_allocator *)ctx->array[i]->interface;
+                break;
+
+            case OUTPUT:
+                output = (struct output_writter *)ctx->array[i]->interface;
+                break;
+
+            case RANDOM_GEN:
+                random_gen = (struct random_generator *)ctx->array[i]->interface;
+                break;
+        }
+    }
+
+    return;
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2015, Harrison Bowden, Minneapolis, MN
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ **/
+
+/**
+*     @file program.h
+*     @brief A program is a short sequence of syscalls where the resources
+*     earlier calls return, file descriptors, sockets and mappings, are
+*     passed to the arguments of later calls.
+*/
+
+#ifndef NX_PROGRAM_H
+#define NX_PROGRAM_H
+
+#include "syscall.h"
+#include "depend-inject/depend-inject.h"
+
+#include <stdint.h>
+
+/* The most calls a program has. */
+#define NX_MAX_CALLS 8
+
+struct program;
+
+/**
+ * Allocate an empty program, it's meant to be reused for every program a child runs.
+ * @return A program on success and NULL on failure.
+ */
+extern struct program *alloc_program(void);
+
+extern void free_program(struct program **prog);
+
+/**
+ * Generate a new program, picking the calls and wiring the arguments of
+ * later calls to the results of earlier ones.
+ * @param prog An empty or cleaned up program.
+ * @return Zero on success and -1 on failure.
+ */
+extern int32_t generate_program(struct program *prog);
+
+/**
+ * Keep the calls and wiring of the last program but generate fresh
+ * arguments, then change one call or one argument reference.
+ * @param prog A cleaned up program.
+ * @return Zero on success and -1 on failure.
+ */
+extern int32_t mutate_program(struct program *prog);
+
+/**
+ * Setup the next program to run, mostly by mutating the last one and
+ * sometimes by generating a new one.
+ * @param prog A cleaned up program.
+ * @return Zero on success and -1 on failure.
+ */
+extern int32_t next_program(struct program *prog);
+
+/**
+ * Pass the results of earlier calls into a call's arguments. Call it right
+ * before execute_program_call(), once the calls before it have executed.
+ * @param prog The program.
+ * @param call The index of the call to link.
+ */
+extern void link_program_call(struct program *prog, uint32_t call);
+
+/**
+ * Execute a call linked with link_program_call(). Calls must be executed in order.
+ * @param prog The program.
+ * @param call The index of the call to execute.
+ * @return Zero on success and -1 on failure.
+ */
+extern int32_t execute_program_call(struct program *prog, uint32_t call);
+
+/**
+ * Release the resources the executed calls returned and the arguments of every call.
+ * @param prog The program to cleanup.
+ */
+extern void cleanup_program(struct program *prog);
+
+extern uint32_t get_total_calls(struct program *prog);
+
+extern struct test_case *get_program_call(struct program *prog, uint32_t call);
+
+extern void inject_program_deps(struct dependency_context *ctx);
+
+#endif /* End of header file. */
@@ -0,0 +1,408 @@
+/*
+ * Copyright (c) 2015, Harrison Bowden, Minneapolis, MN
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ **/
+
+#include "race.h"
+#include "syscall_table.h"
+#include "io/io.h"
+#include "memory/memory.h"
+#include "utils/utils.h"
+
+#include <ck_barrier.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+
+static struct output_writter *output;
+static struct memory_allocator *allocator;
+
+/* How many picks a racer gets to find a call it can run. */
+#define RACE_PICK_TRIES 32
+
+/* How many of those picks go to finding a call that shares a resource with the leader. */
+#define RACE_SHARE_TRIES 16
+
+struct race;
+
+/* What a racing thread gets handed when it's started. */
+struct racer
+{
+    struct race *race;
+    uint32_t id;
+};
+
+struct race
+{
+    uint32_t total_racers;
+    uint32_t total_threads;
+    uint32_t stop;
+    uint32_t ran;
+
+    /* Racers sleep on the lock between rounds, the round counter says when
+       there is a new one and finished counts the threads done with it. */
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    uint32_t round;
+    uint32_t finished;
+
+    /* Every racer spins here right before it's call, so they all start together. */
+    ck_barrier_centralized_t start_line;
+    ck_barrier_centralized_state_t start_state[NX_MAX_RACERS];
+
+    struct racer racers[NX_MAX_RACERS];
+    struct test_case *calls[NX_MAX_RACERS];
+    uint64_t elapsed[NX_MAX_RACERS];
+    pthread_t threads[NX_MAX_RACERS];
+};
+
+static void wait_at_start_line(struct race *race, uint32_t id)
+{
+    ck_barrier_centralized(&race->start_line, &race->start_state[id], race->total_racers);
+}
+
+static void run_racer(struct race *race, uint32_t id)
+{
+    wait_at_start_line(race, id);
+
+    uint64_t start = get_time_ns();
+
+    (void)execute_test(race->calls[id]);
+
+    race->elapsed[id] = get_time_ns() - start;
+}
+
+static void *racer_thread(void *arg)
+{
+    struct racer *racer = (struct racer *)arg;
+    struct race *race = racer->race;
+    uint32_t seen = 0;
+    uint32_t stop = 0;
+
+    for(;;)
+    {
+        (void)pthread_mutex_lock(&race->lock);
+
+        while(race->round == seen && race->stop == 0)
+            (void)pthread_cond_wait(&race->wake, &race->lock);
+
+        seen = race->round;
+        stop = race->stop;
+
+        (void)pthread_mutex_unlock(&race->lock);
+
+        if(stop == 1)
+            break;
+
+        run_racer(race, racer->id);
+
+        (void)pthread_mutex_lock(&race->lock);
+
+        race->finished++;
+        if(race->finished == race->total_threads)
+            (void)pthread_cond_signal(&race->done);
+
+        (void)pthread_mutex_unlock(&race->lock);
+    }
+
+    return (NULL);
+}
+
+struct race *create_race(uint32_t total_racers)
+{
+    struct race *race = NULL;
+
+    if(total_racers < 2 || total_racers > NX_MAX_RACERS)
+    {
+        output->write(ERROR, "Races need 2 to %u racers\n", NX_MAX_RACERS);
+        return (NULL);
+    }
+
+    race = allocator->alloc(sizeof(struct race));
+    if(race == NULL)
+    {
+        output->write(ERROR, "Failed to allocate race\n");
+        return (NULL);
+    }
+
+    /* Zeroed is the initial state of the barrier and each racer's state. */
+    memset(race, 0, sizeof(struct race));
+
+    (void)pthread_mutex_init(&race->lock, NULL);
+    (void)pthread_cond_init(&race->wake, NULL);
+    (void)pthread_cond_init(&race->done, NULL);
+
+    race->total_racers = total_racers;
+
+    uint32_t i;
+
+    for(i = 0; i < total_racers; i++)
+    {
+        race->calls[i] = alloc_test_case();
+        if(race->calls[i] == NULL)
+        {
+            output->write(ERROR, "Failed to allocate race call\n");
+            destroy_race(&race);
+            return (NULL);
+        }
+
+        race->racers[i].race = race;
+        race->racers[i].id = i;
+    }
+
+    sigset_t mask;
+    sigset_t old_mask;
+
+    /* The jump back from a crashing call only works on the thread that set
+       it up, so racing threads start with every signal blocked. A fault in
+       one of them can't be blocked and takes the whole child down instead. */
+    sigfillset(&mask);
+    (void)pthread_sigmask(SIG_SETMASK, &mask, &old_mask);
+
+    /* The calling thread is racer zero. */
+    for(i = 1; i < total_racers; i++)
+    {
+        if(pthread_create(&race->threads[i], NULL, racer_thread, &race->racers[i]) != 0)
+        {
+            output->write(ERROR, "Failed to start racer thread\n");
+            (void)pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+            destroy_race(&race);
+            return (NULL);
+        }
+
+        race->total_threads++;
+    }
+
+    (void)pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+    return (race);
+}
+
+void destroy_race(struct race **race)
+{
+    uint32_t i;
+
+    if((*race)->total_threads > 0)
+    {
+        /* Wake the sleeping threads so they see the stop flag. */
+        (void)pthread_mutex_lock(&(*race)->lock);
+        (*race)->stop = 1;
+        (void)pthread_cond_broadcast(&(*race)->wake);
+        (void)pthread_mutex_unlock(&(*race)->lock);
+
+        for(i = 1; i <= (*race)->total_threads; i++)
+            (void)pthread_join((*race)->threads[i], NULL);
+    }
+
+    (void)pthread_cond_destroy(&(*race)->done);
+    (void)pthread_cond_destroy(&(*race)->wake);
+    (void)pthread_mutex_destroy(&(*race)->lock);
+
+    for(i = 0; i < NX_MAX_RACERS; i++)
+    {
+        if((*race)->calls[i] != NULL)
+            free_test_case(&(*race)->calls[i]);
+    }
+
+    allocator->free((void **)race);
+}
+
+/* Racing threads can't take the alarm signal, so syscalls that need one are left out. */
+static int32_t is_racer_syscall(struct syscall_table *table, uint32_t index)
+{
+    if((table->hot[index].flags & SYSCALL_ALARM) != 0)
+        return (NX_NO);
+
+    if(in_syscall_lane(index) != 1)
+        return (NX_NO);
+
+    return (NX_YES);
+}
+
+/* Whether two syscalls take at least one kind of resource in common. */
+static int32_t shares_resource(struct syscall_hot *a, struct syscall_hot *b)
+{
+    uint32_t i;
+    uint32_t x;
+
+    for(i = 0; i < a->total_args; i++)
+    {
+        if(a->arg_type[i] == INT || a->arg_type[i] == PID)
+            continue;
+
+        for(x = 0; x < b->total_args; x++)
+        {
+            if(a->arg_type[i] == b->arg_type[x])
+                return (NX_YES);
+        }
+    }
+
+    return (NX_NO);
+}
+
+static int32_t pick_racer_syscall(struct syscall_table *table, struct syscall_hot *leader, uint32_t *index)
+{
+    uint32_t i;
+    uint32_t found = 0;
+    uint32_t fallback = 0;
+    uint32_t candidate = 0;
+
+    for(i = 0; i < RACE_PICK_TRIES; i++)
+    {
+        if(pick_syscall_index(table, &candidate) < 0)
+            return (-1);
+
+        if(is_racer_syscall(table, candidate) != NX_YES)
+            continue;
+
+        if(leader == NULL || shares_resource(leader, &table->hot[candidate]) == NX_YES)
+        {
+            (*index) = candidate;
+            return (0);
+        }
+
+        if(found == 0)
+        {
+            fallback = candidate;
+            found = 1;
+        }
+
+        /* Settle for any call once the sharing picks are used up. */
+        if(i >= RACE_SHARE_TRIES)
+            break;
+    }
+
+    if(found == 0)
+        return (-1);
+
+    (*index) = fallback;
+
+    return (0);
+}
+
+int32_t generate_race(struct race *race)
+{
+    uint32_t i;
+    uint32_t index = 0;
+    struct syscall_table *table = get_table();
+
+    for(i = 0; i < race->total_racers; i++)
+    {
+        struct syscall_hot *leader = (i == 0) ? NULL : &table->hot[get_syscall_index(race->calls[0])];
+
+        if(pick_racer_syscall(table, leader, &index) < 0)
+        {
+            cleanup_race(race);
+            return (-1);
+        }
+
+        if(init_test_case_at(race->calls[i], index) < 0)
+        {
+            output->write(ERROR, "Failed to create race call\n");
+            cleanup_race(race);
+            return (-1);
+        }
+
+        if(i > 0)
+            (void)share_test_resources(race->calls[i], race->calls[0]);
+    }
+
+    return (0);
+}
+
+void run_race(struct race *race)
+{
+    uint32_t i;
+
+    (void)pthread_mutex_lock(&race->lock);
+    race->finished = 0;
+    race->round++;
+    (void)pthread_cond_broadcast(&race->wake);
+    (void)pthread_mutex_unlock(&race->lock);
+
+    /* Coverage is traced per thread, so only the leader's call is covered. */
+    start_coverage();
+    run_racer(race, 0);
+    uint32_t new_edges = stop_coverage();
+
+    /* Sleep until the other racers are done so their results are complete,
+       one of them may be blocked in it's call for a while. */
+    (void)pthread_mutex_lock(&race->lock);
+
+    while(race->finished < race->total_threads)
+        (void)pthread_cond_wait(&race->done, &race->lock);
+
+    (void)pthread_mutex_unlock(&race->lock);
+
+    race->ran = 1;
+
+    record_test_result(race->calls[0], race->elapsed[0], new_edges);
+
+    for(i = 1; i < race->total_racers; i++)
+        record_test_result(race->calls[i], race->elapsed[i], 0);
+}
+
+void cleanup_race(struct race *race)
+{
+    uint32_t i;
+
+    /* Descriptors and mappings the calls returned go before their arguments,
+       a mapping may have been made from a descriptor the leader owns. */
+    if(race->ran == 1)
+    {
+        for(i = race->total_racers; i > 0; i--)
+            release_test_result(race->calls[i - 1]);
+
+        race->ran = 0;
+    }
+
+    /* Borrowed resources are only tagged in the followers, so they go first
+       and leave the leader to free what it owns. */
+    for(i = race->total_racers; i > 0; i--)
+        cleanup_test(race->calls[i - 1]);
+}
+
+struct test_case *get_race_leader(struct race *race)
+{
+    return (race->calls[0]);
+}
+
+struct test_case *get_race_call(struct race *race, uint32_t i)
+{
+    if(i >= race->total_racers)
+        return (NULL);
+
+    return (race->calls[i]);
+}
+
+void inject_race_deps(struct dependency_context *ctx)
+{
+    uint32_t i;
+
+    for(i = 0; i < ctx->count; i++)
+    {
+        switch((int32_t)ctx->array[i]->name)
+        {
+            case ALLOCATOR:
+                allocator = (struct memory_allocator *)ctx->array[i]->interface;
+                break;
+
+            case OUTPUT:
+                output = (struct output_writter *)ctx->array[i]->interface;
+                break;
+        }
+    }
+
+    return;
+}
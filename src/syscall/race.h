@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2015, Harrison Bowden, Minneapolis, MN
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ **/
+
+/**
+*     @file race.h
+*     @brief A race runs a few calls at the same moment from different
+*     threads of one child, all pointed at the same descriptors, sockets,
+*     paths and buffers, to reach the kernel's concurrent paths. The threads
+*     are started once, sleep between rounds and only spin at the start line.
+*/
+
+#ifndef NX_RACE_H
+#define NX_RACE_H
+
+#include "syscall.h"
+#include "depend-inject/depend-inject.h"
+
+#include <stdint.h>
+
+/* The most threads, the calling thread included, a race runs calls on. */
+#define NX_MAX_RACERS 4
+
+struct race;
+
+/**
+ * Create a race and start its threads. The threads sleep until
+ * run_race() is called, so only create races in children.
+ * @param total_racers How many calls run at once, from 2 to NX_MAX_RACERS.
+ * @return A race on success and NULL on failure.
+ */
+extern struct race *create_race(uint32_t total_racers);
+
+/**
+ * Stop and join the threads of a race and free it.
+ * @param race The race to destroy, set to NULL on return.
+ */
+extern void destroy_race(struct race **race);
+
+/**
+ * Pick a call for every racer and share the first call's resources with
+ * the others. Calls that need an alarm or don't belong in this process's
+ * lane are never picked, a racing thread can't be interrupted by a timer.
+ * @param race An empty or cleaned up race.
+ * @return Zero on success and -1 on failure.
+ */
+extern int32_t generate_race(struct race *race);
+
+/**
+ * Release every racer at once, wait for all of them and record their results.
+ * @param race A generated race.
+ */
+extern void run_race(struct race *race);
+
+/**
+ * Free the resources of a race's calls, and the descriptors and mappings
+ * they returned if the race was run, so it can be generated again.
+ * @param race A race that was generated.
+ */
+extern void cleanup_race(struct race *race);
+
+/**
+ * @param race A generated race.
+ * @return The first call of the race, the one the others share resources with.
+ */
+extern struct test_case *get_race_leader(struct race *race);
+
+/**
+ * @param race A generated race.
+ * @param i The racer, zero is the leader.
+ * @return The call of racer i, NULL when the race has fewer racers.
+ */
+extern struct test_case *get_race_call(struct race *race, uint32_t i);
+
+extern void inject_race_deps(struct dependency_context *ctx);
+
+#endif
@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2015, Harrison Bowden, Minneapolis, MN
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ **/
+
+#ifdef LINUX
+/* We need to define _GNU_SOURCE to use
+ strerrorname_np on Linux. We also need to place
+ _GNU_SOURCE at the top of the file before
+ any other includes for it to work properly. */
+#define _GNU_SOURCE
+
+#endif
+
+#include "results.h"
+#include "entry.h"
+#include "concurrent/concurrent.h"
+#include "io/io.h"
+#include "memory/memory.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+static struct output_writter *output;
+static struct memory_allocator *allocator;
+
+/* Calls a syscall needs before is_wasted_syscall() judges it. */
+static const uint64_t WASTE_MIN_CALLS = 1000;
+
+struct result_stats *create_result_stats(void)
+{
+    struct result_stats *stats = NULL;
+
+    stats = allocator->shared(sizeof(struct result_stats));
+    if(stats == NULL)
+    {
+        output->write(ERROR, "Failed to allocate result stats\n");
+        return (NULL);
+    }
+
+    memset(stats, 0, sizeof(struct result_stats));
+
+    return (stats);
+}
+
+void record_return(struct result_stats *stats, uint32_t index, int32_t error)
+{
+    uint32_t bucket = (uint32_t)error;
+
+    if(error < 0 || bucket > NX_ERRNO_OTHER)
+        bucket = NX_ERRNO_OTHER;
+
+    atomic_add_uint64(&stats->results[index].returns[bucket], 1);
+
+    return;
+}
+
+void record_latency(struct result_stats *stats, uint32_t index, uint64_t elapsed_ns)
+{
+    struct syscall_results *results = &stats->results[index];
+    uint64_t max = atomic_load_uint64(&results->max_ns);
+
+    atomic_add_uint64(&results->total_ns, elapsed_ns);
+
+    /* New maximums are rare after warm up, so this is normally just the load. */
+    while(elapsed_ns > max)
+    {
+        if(atomic_cas_uint64(&results->max_ns, max, elapsed_ns, &max) == true)
+            break;
+    }
+
+    return;
+}
+
+void record_timeout(struct result_stats *stats, uint32_t index)
+{
+    atomic_add_uint64(&stats->results[index].timeouts, 1);
+
+    return;
+}
+
+void record_crash(struct result_stats *stats, uint32_t index)
+{
+    atomic_add_uint64(&stats->results[index].crashes, 1);
+
+    return;
+}
+
+uint64_t get_result_calls(struct result_stats *stats, uint32_t index)
+{
+    uint32_t i;
+    uint64_t calls = 0;
+
+    for(i = 0; i < NX_ERRNO_BUCKETS; i++)
+        calls += atomic_load_uint64(&stats->results[index].returns[i]);
+
+    return (calls);
+}
+
+int32_t is_wasted_syscall(struct result_stats *stats, uint32_t index)
+{
+    uint64_t calls = get_result_calls(stats, index);
+
+    if(calls < WASTE_MIN_CALLS)
+        return (0);
+
+    uint64_t rejected = atomic_load_uint64(&stats->results[index].returns[EINVAL]) +
+                        atomic_load_uint64(&stats->results[index].returns[ENOSYS]);
+
+    /* The buckets are read one at a time while the children add to them, calls may be a little stale. */
+    return (rejected >= calls);
+}
+
+/* Name of an errno bucket, ie "EINVAL", for the export. */
+static const char *errno_name(uint32_t bucket, char *buf, size_t size)
+{
+    if(bucket == NX_ERRNO_OTHER)
+        return ("other");
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 32))
+
+    const char *name = strerrorname_np((int)bucket);
+    if(name != NULL)
+        return (name);
+
+#endif
+
+    (void)snprintf(buf, size, "errno%u", bucket);
+
+    return (buf);
+}
+
+int32_t export_result_stats(struct result_stats *stats, struct syscall_table *table, const char *path)
+{
+    char tmp_path[4096];
+
+    /* Write next to the old export and rename over it, so readers never see half a file. */
+    int32_t rtrn = snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    if(rtrn < 0 || (size_t)rtrn >= sizeof(tmp_path))
+    {
+        output->write(ERROR, "Result stats path is too long\n");
+        return (-1);
+    }
+
+    FILE *file = fopen(tmp_path, "w");
+    if(file == NULL)
+    {
+        output->write(ERROR, "Can't create %s: %s\n", tmp_path, strerror(errno));
+        return (-1);
+    }
+
+    uint32_t i, j;
+    char name[32];
+
+    fprintf(file, "# syscall\tcalls\tcrashes\ttimeouts\tavg_us\tmax_us\tsuccess\terrno=count...\n");
+
+    for(i = 0; i < table->total_syscalls; i++)
+    {
+        struct syscall_results *results = &stats->results[i];
+        uint64_t crashes = atomic_load_uint64(&results->crashes);
+        uint64_t timeouts = atomic_load_uint64(&results->timeouts);
+        uint64_t calls = get_result_calls(stats, i);
+        uint64_t avg_ns = 0;
+
+        if(calls == 0 && crashes == 0 && timeouts == 0)
+            continue;
+
+        if(calls > 0)
+            avg_ns = atomic_load_uint64(&results->total_ns) / calls;
+
+        fprintf(file, "%s\t%llu\t%llu\t%llu\t%llu\t%llu\t%llu", table->sys_entry[i]->syscall_name,
+                (unsigned long long)calls, (unsigned long long)crashes, (unsigned long long)timeouts,
+                (unsigned long long)(avg_ns / 1000),
+                (unsigned long long)(atomic_load_uint64(&results->max_ns) / 1000),
+                (unsigned long long)atomic_load_uint64(&results->returns[0]));
+
+        for(j = 1; j < NX_ERRNO_BUCKETS; j++)
+        {
+            uint64_t count = atomic_load_uint64(&results->returns[j]);
+
+            if(count > 0)
+                fprintf(file, "\t%s=%llu", errno_name(j, name, sizeof(name)), (unsigned long long)count);
+        }
+
+        fprintf(file, "\n");
+    }
+
+    if(fclose(file) != 0)
+    {
+        output->write(ERROR, "Can't write %s: %s\n", tmp_path, strerror(errno));
+        (void)unlink(tmp_path);
+        return (-1);
+    }
+
+    rtrn = rename(tmp_path, path);
+    if(rtrn < 0)
+    {
+        output->write(ERROR, "Can't rename %s: %s\n", tmp_path, strerror(errno));
+        (void)unlink(tmp_path);
+        return (-1);
+    }
+
+    return (0);
+}
+
+void inject_results_deps(struct dependency_context *ctx)
+{
+    uint32_t i;
+
+    for(i = 0; i < ctx->count; i++)
+    {
+        switch((int32_t)ctx->array[i]->name)
+        {
+            case ALLOCATOR:
+                allocator = (struct memory_allocator *)ctx->array[i]->interface;
+                break;
+
+            case OUTPUT:
+                output = (struct output_writter *)ctx->array[i]->interface;
+                break;
+        }
+    }
+
+    return;
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2015, Harrison Bowden, Minneapolis, MN
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ **/
+
+#ifndef NX_RESULTS_H
+#define NX_RESULTS_H
+
+#include "syscall_table.h"
+#include "depend-inject/depend-inject.h"
+
+#include <stdint.h>
+
+/* Bucket 0 counts successful calls, bucket n counts calls that failed with
+   errno n and the last bucket counts errno values too large for the rest. */
+#define NX_ERRNO_BUCKETS 136
+
+#define NX_ERRNO_OTHER (NX_ERRNO_BUCKETS - 1)
+
+/* What the calls to one syscall returned and how long they took. The total
+   call count is the sum of the buckets, so recording a return is a single
+   atomic add. total_ns and max_ns only count calls that returned, calls
+   cut short by their timer are counted in timeouts instead. */
+struct syscall_results
+{
+    uint64_t crashes;
+    uint64_t timeouts;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t returns[NX_ERRNO_BUCKETS];
+};
+
+/* Lives in shared memory, indexed like the syscall table. */
+struct result_stats
+{
+    struct syscall_results results[NX_MAX_SYSCALLS];
+};
+
+/**
+ * Create the result histograms in shared memory, so every child adds to the same counters.
+ * @return The histograms on success and NULL on failure.
+ */
+extern struct result_stats *create_result_stats(void);
+
+/**
+ * Count what a syscall returned.
+ * @param stats The histograms to record to.
+ * @param index The syscall table index of the syscall.
+ * @param error Zero when the syscall succeeded, otherwise the errno it failed with.
+ */
+extern void record_return(struct result_stats *stats, uint32_t index, int32_t error);
+
+/**
+ * Record how long a call that returned took.
+ * @param stats The histograms to record to.
+ * @param index The syscall table index of the syscall.
+ * @param elapsed_ns How long the call took.
+ */
+extern void record_latency(struct result_stats *stats, uint32_t index, uint64_t elapsed_ns);
+
+/**
+ * Count a call that was still blocked when it's timer went off, or that
+ * the supervisor gave up on and killed.
+ * @param stats The histograms to record to.
+ * @param index The syscall table index of the syscall.
+ */
+extern void record_timeout(struct result_stats *stats, uint32_t index);
+
+/**
+ * Count a call that raised a fatal signal instead of returning.
+ * @param stats The histograms to record to.
+ * @param index The syscall table index of the syscall.
+ */
+extern void record_crash(struct result_stats *stats, uint32_t index);
+
+/**
+ * @param stats The histograms to read.
+ * @param index The syscall table index of the syscall.
+ * @return How many calls of the syscall returned, successfully or not.
+ */
+extern uint64_t get_result_calls(struct result_stats *stats, uint32_t index);
+
+/**
+ * A syscall is wasted when after enough calls every single one failed
+ * with EINVAL or ENOSYS, the arguments we generate for it never get past
+ * the argument checks or the kernel doesn't have it.
+ * @param stats The histograms to read.
+ * @param index The syscall table index of the syscall.
+ * @return One when the syscall is wasting cycles, zero otherwise.
+ */
+extern int32_t is_wasted_syscall(struct result_stats *stats, uint32_t index);
+
+/**
+ * Write the histograms of every syscall that was called to path, one
+ * tab separated line per syscall with it's name, calls, crashes, timeouts,
+ * average and max latency, successes and each errno it failed with.
+ * The file is replaced atomically.
+ * @param stats The histograms to export.
+ * @param table The syscall table the histograms are indexed by.
+ * @param path Where to write the histograms.
+ * @return Zero on success and -1 on failure.
+ */
+extern int32_t export_result_stats(struct result_stats *stats, struct syscall_table *table, const char *path);
+
+extern void inject_results_deps(struct dependency_context *ctx);
+
+#endif
@@ -48,7 +48,7 @@ static void child_exit_handler(int sig)
             if(child == NULL)
                 return;
 
-            set_child_pid(child, EMPTY);
+            release_syscall_child(child);
         }
     }
 
@@ -121,14 +121,21 @@ static void child_signal_handler(int sig, siginfo_t *info, void *context)
     /* Set context to void to ignore clang warning. Remove
       this caste if we begin using context in this function. */
     (void)context;
+    (void)info;
 
-    /* Grab the child context using the pid
-      that recieved a signal. We need the
-      child context so we can let the child
-      know it's jumping back from a signal
-      handler. */
+    /* Grab the child context of this process so we can let
+      the child know it's jumping back from a signal handler. */
     struct syscall_child *child = NULL;
-    child = get_child_with_pid(info->si_pid);
+    child = get_current_child();
+
+    /* No syscall in flight, so there is nowhere to jump back to.
+       Let the signal take it's default action. */
+    if(child == NULL)
+    {
+        (void)signal(sig, SIG_DFL);
+        (void)raise(sig);
+        return;
+    }
 
     /* Check what kind of signal got us here. */
     switch(sig)
@@ -18,5 +18,8 @@
 
 struct syscall_table *get_table(void)
 {
+	if(freebsd_syscall_table.ready == 0)
+		build_hot_table(&freebsd_syscall_table);
+
 	return (&freebsd_syscall_table);
 }
@@ -14,9 +14,13 @@
  **/
  
 #include "syscall_table.h"
-#include "linux_syscall_table.h"
+
+/* linux_syscall_table is generated at build time by syscall-gen. */
 
 struct syscall_table *get_table(void)
 {
+	if(linux_syscall_table.ready == 0)
+		build_hot_table(&linux_syscall_table);
+
 	return (&linux_syscall_table);
-}
\ No newline at end of file
+}
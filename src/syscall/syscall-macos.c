@@ -18,4 +18,10 @@
 #include "syscall_table.h"
 #include "mac_osx_syscall_table.h"
 
-struct syscall_table *get_table(void) { return (&mac_osx_syscall_table); }
+struct syscall_table *get_table(void)
+{
+	if(mac_osx_syscall_table.ready == 0)
+		build_hot_table(&mac_osx_syscall_table);
+
+	return (&mac_osx_syscall_table);
+}
@@ -18,6 +18,16 @@
 #include "child.h"
 #include "signals.h"
 #include "generate.h"
+#include "weight.h"
+#include "results.h"
+#include "lane.h"
+#include "race.h"
+#include "testlog.h"
+#ifdef LINUX
+#include "uring.h"
+#endif
+#include "program.h"
+#include "coverage/coverage.h"
 #include "crypto/random.h"
 #include "memory/memory.h"
 #include "concurrent/concurrent.h"
@@ -28,19 +38,61 @@
 #include <string.h>
 #include <signal.h>
 #include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 static struct resource_generator *rsrc_gen;
 static struct memory_allocator *allocator;
+static struct memory_allocator *scratch;
 static struct output_writter *output;
 static struct random_generator *random_gen;
 
+/* Weighted selection is only used once setup_weighted_selection() has been
+   called, until then syscalls are picked uniformly from the active list. */
+static struct syscall_selector *selector;
+static struct syscall_table *selector_table;
+
+/* Return value histograms, recorded once setup_result_stats() has been called. */
+static struct result_stats *results;
+
+/* Slow syscall classification, shared once setup_syscall_lanes() has been
+   called. lane is local to each process, set by the worker it runs. */
+static struct lane_state *lanes;
+static enum syscall_lane lane = LANE_ANY;
+
+/* Kernel coverage, collected once setup_coverage() has been called. The
+   map is shared, coverage_open is local and only set once a child has
+   opened the backend in it's own process. */
+static struct coverage_backend *coverage;
+static struct coverage_map *coverage_map;
+static int32_t coverage_open = NX_NO;
+
+/* How many picks a fast worker makes looking for a syscall that isn't slow. */
+static const uint32_t LANE_PICK_TRIES = 32;
+
+/* Per call timers in milliseconds. Calls flagged as needing an alarm get
+   ALARM_TIMEOUT_MS, every call on a slow worker gets SLOW_TIMEOUT_MS. */
+static const uint32_t ALARM_TIMEOUT_MS = 1000;
+static const uint32_t SLOW_TIMEOUT_MS = 250;
+
+/* A test case keeps its arguments in fixed inline slots so it can be
+   allocated once per child and reused for every iteration. arg_copy_array
+   holds the generated values so cleanup isn't fooled by mutation of
+   arg_value_array, and arg_tag_array records the arg type of each slot. */
 struct test_case
 {
-    uint64_t **arg_value_array;
+    const struct syscall_hot *hot;
     struct syscall_entry *entry;
+    uint32_t index;
+    uint32_t total_args;
+    int32_t error;
+    int64_t return_value;
+    int32_t arg_tag_array[NX_ARG_SLOTS];
+    uint64_t arg_value_array[NX_ARG_SLOTS];
+    uint64_t arg_copy_array[NX_ARG_SLOTS];
 };
 
-struct test_case *create_test_case(void)
+struct test_case *alloc_test_case(void)
 {
     struct test_case *test = NULL;
 
@@ -51,24 +103,88 @@ struct test_case *create_test_case(void)
         return (NULL);
     }
 
-    test->arg_value_array = allocator->alloc(sizeof(uint64_t *) * ARG_LIMIT);
-    if(test->arg_value_array == NULL)
-    {
-        output->write(ERROR, "Allocation failed\n");
-        return (NULL);
-    }
+    memset(test, 0, sizeof(struct test_case));
+
+    return (test);
+}
+
+void free_test_case(struct test_case **test)
+{
+    allocator->free((void **)test);
+}
+
+/* Point a test case at the hot and cold halves of a table entry. */
+static void select_syscall(struct test_case *test, struct syscall_table *table, uint32_t index)
+{
+    test->hot = &table->hot[index];
+    test->entry = table->sys_entry[index];
+    test->index = index;
+}
 
-    test->entry = pick_syscall(get_table());
-    if(test->entry == NULL)
+int32_t init_test_case_at(struct test_case *test, uint32_t index)
+{
+    struct syscall_table *table = get_table();
+
+    if(index >= table->total_syscalls)
     {
-        output->write(ERROR, "Can't pick syscall\n");
-        return (NULL);
+        output->write(ERROR, "Syscall index out of range\n");
+        return (-1);
     }
 
+    select_syscall(test, table, index);
+
     int32_t rtrn = generate_args(test);
     if(rtrn < 0)
     {
         output->write(ERROR, "Failed to generate syscall arguments\n");
+
+        /* Other test cases of the same program may still be using the buffer pool. */
+        release_test_args(test);
+        return (-1);
+    }
+
+    return (0);
+}
+
+int32_t init_test_case(struct test_case *test)
+{
+    uint32_t index = 0;
+    struct syscall_table *table = get_table();
+
+    if(pick_syscall_index(table, &index) < 0)
+    {
+        output->write(ERROR, "Can't pick syscall\n");
+        return (-1);
+    }
+
+    return (init_test_case_at(test, index));
+}
+
+int32_t init_test_case_for(struct test_case *test, const char *name)
+{
+    uint32_t index = 0;
+    struct syscall_table *table = get_table();
+
+    if(find_entry_index(name, table, &index) < 0)
+    {
+        output->write(ERROR, "Can't find syscall\n");
+        return (-1);
+    }
+
+    return (init_test_case_at(test, index));
+}
+
+struct test_case *create_test_case(void)
+{
+    struct test_case *test = NULL;
+
+    test = alloc_test_case();
+    if(test == NULL)
+        return (NULL);
+
+    if(init_test_case(test) < 0)
+    {
+        free_test_case(&test);
         return (NULL);
     }
 
@@ -79,172 +195,775 @@ struct test_case *create_test_case_for(const char *name)
 {
     struct test_case *test = NULL;
 
-    test = allocator->alloc(sizeof(struct test_case));
+    test = alloc_test_case();
     if(test == NULL)
-    {
-        output->write(ERROR, "Failed to allocate test case\n");
         return (NULL);
-    }
 
-    test->arg_value_array = allocator->alloc(sizeof(uint64_t *) * ARG_LIMIT);
-    if(test->arg_value_array == NULL)
+    if(init_test_case_for(test, name) < 0)
     {
-        output->write(ERROR, "Allocation failed\n");
+        free_test_case(&test);
         return (NULL);
     }
 
-    test->entry = find_entry(name, get_table());
-    if(test->entry == NULL)
+    return (test);
+}
+
+/* Hand the resource in one argument slot back to it's pool. */
+static void free_test_arg(struct test_case *test, uint32_t slot)
+{
+    int32_t rtrn = 0;
+    uint64_t value = test->arg_copy_array[slot];
+
+    /* Handle args that require special cleanup procedures. */
+    switch(test->arg_tag_array[slot])
     {
-        output->write(ERROR, "Can't find syscall\n");
-        return (NULL);
+        /* Below is the resource types ie they are from the resource module.
+        They must be freed using special functions and the free must be done on
+        the arg_copy_array so the free_* functions don't use the mutated value in arg_value_array. */
+        case FILE_DESC:
+        {
+            int32_t desc = (int32_t)value;
+            rtrn = rsrc_gen->free_desc(&desc);
+            if(rtrn < 0)
+                output->write(ERROR, "Can't free descriptor\n");
+            /* Not fatal, cleanup_test() still frees the other slots. */
+            break;
+        }
+
+        case FILE_PATH:
+        {
+            char *path = (char *)(uintptr_t)value;
+            rtrn = rsrc_gen->free_filepath(&path);
+            if(rtrn < 0)
+                output->write(ERROR, "Can't free filepath\n");
+            /* Not fatal, cleanup_test() still frees the other slots. */
+            break;
+        }
+
+        case DIR_PATH:
+        {
+            char *path = (char *)(uintptr_t)value;
+            rtrn = rsrc_gen->free_dirpath(&path);
+            if(rtrn < 0)
+                output->write(ERROR, "Can't free dirpath\n");
+            /* Not fatal, cleanup_test() still frees the other slots. */
+            break;
+        }
+
+        case SOCKET:
+        {
+            int32_t sock = (int32_t)value;
+            rtrn = rsrc_gen->free_socket(&sock);
+            if(rtrn < 0)
+                output->write(ERROR, "Can't free socket\n");
+            /* Not fatal, cleanup_test() still frees the other slots. */
+            break;
+        }
+
+        /* Hand the sacrificial process back using the copy value
+           so that we don't use the mutated value in arg_value_array[i]. */
+        case PID:
+        {
+            int32_t pid = (int32_t)value;
+            rtrn = rsrc_gen->free_pid(&pid);
+            if(rtrn < 0)
+                output->write(ERROR, "Can't free pid\n");
+            /* Not fatal, cleanup_test() still frees the other slots. */
+            break;
+        }
+        /* End of resource types. */
+
+        default:
+            break;
     }
 
-    int32_t rtrn = generate_args(test);
-    if(rtrn < 0)
+    return;
+}
+
+void release_test_args(struct test_case *test)
+{
+    uint32_t i;
+    uint32_t total_args = test->total_args;
+
+    for(i = 0; i < total_args; i++)
+        free_test_arg(test, i);
+
+    test->total_args = 0;
+}
+
+void release_test_result(struct test_case *test)
+{
+    if(test->error != 0)
+        return;
+
+    switch(test->hot->return_kind)
     {
-        output->write(ERROR, "Failed to generate syscall arguments\n");
-        return (NULL);
+        case KIND_FD:
+        case KIND_SOCKET:
+            /* Never close stdio, whatever handed it out. */
+            if(test->return_value > 2)
+                (void)close((int32_t)test->return_value);
+            break;
+
+        case KIND_PTR:
+            /* Mapping syscalls take the length as their second argument. */
+            (void)munmap((void *)(uintptr_t)test->return_value, (size_t)test->arg_value_array[1]);
+            break;
+
+        default:
+            break;
     }
 
-    return (test);
+    return;
 }
 
 void cleanup_test(struct test_case *test)
 {
-    uint32_t i;
-    int32_t rtrn = 0;
-    uint32_t total_args = test->entry->total_args;
+    release_test_args(test);
 
-    for(i = 0; i < total_args; i++)
+    /* Release every scratch allocation and buffer made since the last
+       reset at once, the slots are reused by the next init_test_case(). */
+    reset_generated_buffers();
+    scratch->reset();
+}
+
+/* Argument types that point at something another call can share. */
+static int32_t is_shareable(int32_t type)
+{
+    switch(type)
     {
-        /* Handle args that require special cleanup procedures. */
-        switch((int32_t)test->entry->arg_type_array[i])
-        {
-            /* Below is the resource types ie they are from the resource module.
-            They must be freed using special functions and the free must be done on
-            the arg_copy_index so the free_* functions don't use the mutated value in arg_value_index. */
-            case FILE_DESC:
-                rtrn = rsrc_gen->free_desc((int32_t *)test->arg_value_array[i]);
-                if(rtrn < 0)
-                    output->write(ERROR, "Can't free descriptor\n");
-                /* Don't return on errors, just keep looping. */
-                break;
+        case FILE_DESC:
+        case FILE_PATH:
+        case DIR_PATH:
+        case SOCKET:
+        case ADDRESS:
+            return (1);
+
+        default:
+            return (0);
+    }
+}
 
-            case FILE_PATH:
-                rtrn = rsrc_gen->free_filepath((char **)&(test->arg_value_array[i]));
-                if(rtrn < 0)
-                    output->write(ERROR, "Can't free filepath\n");
-                /* Don't return on errors, just keep looping. */
-                break;
+uint32_t share_test_resources(struct test_case *dst, struct test_case *src)
+{
+    uint32_t i, j;
+    uint32_t shared = 0;
 
-            case DIR_PATH:
-                rtrn = rsrc_gen->free_dirpath((char **)&(test->arg_value_array[i]));
-                if(rtrn < 0)
-                    output->write(ERROR, "Can't free dirpath\n");
-                /* Don't return on errors, just keep looping. */
-                break;
+    for(i = 0; i < dst->total_args; i++)
+    {
+        int32_t type = dst->arg_tag_array[i];
 
-            case SOCKET:
-                rtrn = rsrc_gen->free_socket((int32_t *)test->arg_value_array[i]);
-                if(rtrn < 0)
-                    output->write(ERROR, "Can't free socket\n");
-                /* Don't return on errors, just keep looping. */
-                break;
-            /* End of resource types. */
-
-            /* Kill the temp process using the copy value
-               so that we don't use the mutated value
-               in arg_value_index[i]. */
-            case PID:
-                rtrn = kill((pid_t)(*test->arg_value_array[i]), SIGKILL);
-                if(rtrn < 0)
-                    output->write(ERROR, "Can't kill child: %s\n", strerror(errno));
-                    /* Don't return on errors, just keep looping. */
-                break;
+        if(is_shareable(type) == 0)
+            continue;
 
-            case ADDRESS:
-                // allocator->free_shared((void **)&test->arg_value_array[i]);
-                break;
+        for(j = 0; j < src->total_args; j++)
+        {
+            if(src->arg_tag_array[j] != type)
+                continue;
 
-            default:
-                /* Free value if non NULL. */
-                //mem_free((void **)&ctx->arg_value_array[i]);
-                break;
+            /* Give dst's own resource back now, the slot is tagged INT so
+               cleanup_test() leaves the borrowed one to src. */
+            free_test_arg(dst, i);
+
+            dst->arg_value_array[i] = src->arg_copy_array[j];
+            dst->arg_copy_array[i] = src->arg_copy_array[j];
+            dst->arg_tag_array[i] = INT;
+            shared++;
+            break;
         }
+    }
+
+    return (shared);
+}
+
+#if defined(LINUX) && defined(__x86_64__)
+
+/* Issue a syscall with six register arguments straight from the argument
+   slots. Linux returns -errno in rax on failure. Syscalls that take fewer
+   arguments ignore the extra registers, so every test goes through here. */
+static inline int64_t raw_syscall(uint64_t number, const uint64_t *args)
+{
+    int64_t ret = 0;
+    register uint64_t r10 __asm__("r10") = args[3];
+    register uint64_t r8 __asm__("r8") = args[4];
+    register uint64_t r9 __asm__("r9") = args[5];
+
+    __asm__ volatile("syscall"
+                     : "=a"(ret)
+                     : "a"(number), "D"(args[0]), "S"(args[1]), "d"(args[2]),
+                       "r"(r10), "r"(r8), "r"(r9)
+                     : "rcx", "r11", "memory");
+
+    return (ret);
+}
+
+#else
+
+/* Fallback for platforms without a raw dispatcher, go through libc. */
+static inline int64_t raw_syscall(uint64_t number, const uint64_t *args)
+{
+    int64_t ret = syscall((int32_t)number, args[0], args[1], args[2],
+                          args[3], args[4], args[5]);
+    if(ret == -1)
+        return (-errno);
+
+    return (ret);
+}
 
-        // allocator->free((void **)&test->arg_value_array[i]);
+#endif
+
+int32_t set_test_return(struct test_case *test, int64_t ret)
+{
+    /* Values in [-4095, -1] are errno values, anything else is a result. */
+    if(ret < 0 && ret > -4096)
+    {
+        test->error = (int32_t)-ret;
+        test->return_value = -1;
+        return (-1);
     }
 
-    allocator->free((void **)&test);
+    test->error = 0;
+    test->return_value = ret;
+
+    return (0);
+}
+
+int32_t execute_test(struct test_case *test)
+{
+    return (set_test_return(test, raw_syscall(test->hot->number, test->arg_value_array)));
+}
+
+int64_t get_return_value(struct test_case *test)
+{
+    return (test->return_value);
 }
 
- 
-uint64_t **get_argument_array(struct test_case *test)
+int32_t get_error(struct test_case *test)
+{
+    return (test->error);
+}
+
+uint64_t *get_argument_array(struct test_case *test)
 {
     return (test->arg_value_array);
 }
 
 uint32_t get_total_args(struct test_case *test)
 {
-    return (test->entry->total_args);
+    return (test->hot->total_args);
 }
 
-inline struct syscall_entry *get_entry(struct test_case *test)
+uint32_t get_argument_data(struct test_case *test, uint32_t slot, const void **data)
+{
+    uint64_t value = test->arg_value_array[slot];
+
+    *data = NULL;
+
+    /* A mutated value may not point at anything readable. */
+    if(value == 0 || value != test->arg_copy_array[slot])
+        return (0);
+
+    switch(test->hot->arg_type[slot])
+    {
+        case FILE_PATH:
+        case DIR_PATH:
+            *data = (const void *)(uintptr_t)value;
+            return ((uint32_t)strnlen((const char *)*data, NX_MAX_ARG_DATA));
+    }
+
+    const struct arg_desc *desc = test->entry->arg_desc_array[slot];
+
+    if(test->hot->arg_kind[slot] == KIND_STRUCT && desc != NULL)
+    {
+        *data = (const void *)(uintptr_t)value;
+        return ((uint32_t)((desc->max < NX_MAX_ARG_DATA) ? desc->max : NX_MAX_ARG_DATA));
+    }
+
+    return (0);
+}
+
+uint32_t get_syscall_index(struct test_case *test)
+{
+    return (test->index);
+}
+
+int32_t needs_alarm(struct test_case *test)
+{
+    return ((test->hot->flags & SYSCALL_ALARM) != 0);
+}
+
+uint32_t get_call_timeout(struct test_case *test)
+{
+    if(lane == LANE_SLOW)
+        return (SLOW_TIMEOUT_MS);
+
+    if(needs_alarm(test))
+        return (ALARM_TIMEOUT_MS);
+
+    return (0);
+}
+
+struct syscall_entry *get_entry(struct test_case *test)
 {
     return (test->entry);
 }
 
-struct syscall_entry *pick_syscall(struct syscall_table *table)
+/* Build the name and number indexes for tables syscall-gen didn't generate them for. */
+static void build_table_index(struct syscall_table *table)
+{
+    uint32_t i;
+    const char *names[NX_MAX_SYSCALLS];
+
+    for(i = 0; i < table->total_syscalls; i++)
+        names[i] = table->sys_entry[i]->syscall_name;
+
+    if(build_name_hash(names, table->total_syscalls, table->name_seed,
+                       table->name_slot_index, table->name_slot_hash) < 0)
+    {
+        /* Not fatal, find_entry() falls back to a linear scan. */
+        output->write(ERROR, "Failed to build syscall name index\n");
+        return;
+    }
+
+    memset(table->number_index, 0, sizeof(table->number_index));
+
+    for(i = 0; i < table->total_syscalls; i++)
+    {
+        uint32_t number = table->sys_entry[i]->syscall_number;
+
+        if(number < NX_MAX_SYSCALL_NUMBER && table->number_index[number] == 0)
+            table->number_index[number] = (uint16_t)(i + 1);
+    }
+
+    table->indexed = 1;
+
+    return;
+}
+
+void build_hot_table(struct syscall_table *table)
 {
+    uint32_t i, j;
+
+    if(table->ready == 1)
+        return;
+
+    table->total_active = 0;
+
+    for(i = 0; i < table->total_syscalls; i++)
+    {
+        struct syscall_entry *entry = table->sys_entry[i];
+        struct syscall_hot *hot = &table->hot[i];
+
+        memset(hot, 0, sizeof(struct syscall_hot));
+
+        hot->number = (uint16_t)entry->syscall_number;
+        hot->total_args = (uint8_t)entry->total_args;
+        hot->return_kind = (uint8_t)entry->return_kind;
+
+        if(entry->need_alarm == NX_YES)
+            hot->flags |= SYSCALL_ALARM;
+
+        if(entry->requires_root == NX_YES)
+            hot->flags |= SYSCALL_ROOT;
+
+        if(entry->damages_buffers == NX_YES)
+            hot->flags |= SYSCALL_REMAP;
+
+        for(j = 0; j < entry->total_args; j++)
+        {
+            if(entry->arg_desc_array[j] != NULL)
+                hot->arg_kind[j] = (uint8_t)entry->arg_desc_array[j]->kind;
+            else
+                hot->arg_kind[j] = (uint8_t)get_arg_kind(entry->get_arg_array[j]);
+            hot->arg_type[j] = (uint8_t)entry->arg_type_array[j];
+        }
+
+        if(entry->status == OFF)
+            continue;
+
+        hot->flags |= SYSCALL_ON;
+        table->active[table->total_active++] = (uint16_t)i;
+    }
+
+    if(table->indexed == 0)
+        build_table_index(table);
+
+    table->ready = 1;
+
+    return;
+}
+
+static int32_t pick_any_index(struct syscall_table *table, uint32_t *index)
+{
+    if(selector != NULL && table == selector_table)
+        return (select_weighted(selector, index));
+
     uint32_t offset = 0;
 
-    int32_t rtrn = random_gen->range(table->total_syscalls, &offset);
+    /* Only switched on syscalls are in the active list, so one pick is enough. */
+    int32_t rtrn = random_gen->range(table->total_active, &offset);
     if(rtrn < 0)
     {
         output->write(ERROR, "Failed to calculate offset\n");
-        return (NULL);
+        return (-1);
+    }
+
+    (*index) = table->active[offset];
+
+    return (0);
+}
+
+int32_t pick_syscall_index(struct syscall_table *table, uint32_t *index)
+{
+    if(lanes == NULL || lane == LANE_ANY)
+        return (pick_any_index(table, index));
+
+    /* Slow workers run nothing else, unless nothing is slow right now. */
+    if(lane == LANE_SLOW && pick_slow_syscall(lanes, index) == 0)
+        return (0);
+
+    uint32_t i;
+
+    for(i = 0; i < LANE_PICK_TRIES; i++)
+    {
+        if(pick_any_index(table, index) < 0)
+            return (-1);
+
+        if(lane == LANE_SLOW || is_slow_syscall(lanes, (*index)) == 0)
+            return (0);
     }
 
-    return (atomic_load_ptr(&table->sys_entry[offset]));
+    output->write(ERROR, "Only found slow syscalls to run on a fast worker\n");
+
+    return (-1);
+}
+
+int32_t in_syscall_lane(uint32_t index)
+{
+    if(lanes == NULL || lane != LANE_FAST)
+        return (1);
+
+    return (is_slow_syscall(lanes, index) == 0);
+}
+
+int32_t setup_syscall_lanes(void)
+{
+    if(results == NULL)
+    {
+        output->write(ERROR, "Syscall lanes need the result stats setup first\n");
+        return (-1);
+    }
+
+    lanes = create_lane_state(get_table());
+    if(lanes == NULL)
+    {
+        output->write(ERROR, "Failed to create lane state\n");
+        return (-1);
+    }
+
+    return (0);
+}
+
+void set_syscall_lane(uint32_t worker_lane)
+{
+    lane = (enum syscall_lane)worker_lane;
+
+    return;
+}
+
+int32_t update_syscall_lanes(void)
+{
+    if(lanes == NULL)
+        return (0);
+
+    classify_syscalls(lanes, get_table(), results);
+
+    return (0);
+}
+
+int32_t setup_weighted_selection(void)
+{
+    struct syscall_table *table = get_table();
+
+    selector = create_syscall_selector(table);
+    if(selector == NULL)
+    {
+        output->write(ERROR, "Failed to create syscall selector\n");
+        return (-1);
+    }
+
+    selector_table = table;
+
+    return (0);
+}
+
+int32_t update_syscall_weights(void)
+{
+    if(selector == NULL)
+        return (0);
+
+    uint32_t i;
+
+    /* Syscalls that only ever fail argument checks get the least weight possible. */
+    if(results != NULL)
+    {
+        for(i = 0; i < selector_table->total_active; i++)
+        {
+            uint16_t index = selector_table->active[i];
+
+            set_syscall_wasted(index, (uint32_t)is_wasted_syscall(results, index));
+        }
+    }
+
+    return (rebuild_selector(selector, selector_table));
+}
+
+int32_t setup_result_stats(void)
+{
+    results = create_result_stats();
+    if(results == NULL)
+    {
+        output->write(ERROR, "Failed to create result stats\n");
+        return (-1);
+    }
+
+    return (0);
+}
+
+int32_t export_results(const char *path)
+{
+    if(results == NULL)
+        return (0);
+
+    return (export_result_stats(results, get_table(), path));
+}
+
+int32_t setup_coverage(struct coverage_backend *backend)
+{
+    if(backend->available() != NX_YES)
+    {
+        output->write(ERROR, "Coverage backend %s is not available\n", backend->name);
+        return (-1);
+    }
+
+    coverage_map = create_coverage_map();
+    if(coverage_map == NULL)
+    {
+        output->write(ERROR, "Failed to create coverage map\n");
+        return (-1);
+    }
+
+    coverage = backend;
+
+    return (0);
+}
+
+int32_t open_coverage(void)
+{
+    if(coverage == NULL)
+        return (0);
+
+    if(coverage->open() < 0)
+    {
+        output->write(ERROR, "Can't open %s coverage, running this child without it\n", coverage->name);
+        return (-1);
+    }
+
+    coverage_open = NX_YES;
+
+    return (0);
+}
+
+void close_coverage(void)
+{
+    if(coverage_open != NX_YES)
+        return;
+
+    coverage->close();
+    coverage_open = NX_NO;
+}
+
+void start_coverage(void)
+{
+    if(coverage_open == NX_YES)
+        coverage->start();
+}
+
+uint32_t stop_coverage(void)
+{
+    if(coverage_open != NX_YES)
+        return (0);
+
+    const uint64_t *pcs = NULL;
+    uint64_t count = coverage->stop(&pcs);
+
+    return (merge_coverage(coverage_map, pcs, count));
+}
+
+uint64_t get_coverage_edges(void)
+{
+    if(coverage_map == NULL)
+        return (0);
+
+    return (get_total_edges(coverage_map));
+}
+
+void record_test_result(struct test_case *test, uint64_t elapsed_ns, uint32_t new_coverage)
+{
+    if(results != NULL)
+    {
+        record_return(results, test->index, test->error);
+        record_latency(results, test->index, elapsed_ns);
+    }
+
+    if(selector != NULL)
+        record_feedback(selector, test->index, (test->error == 0), new_coverage, elapsed_ns);
+
+    return;
+}
+
+void record_test_crash(struct test_case *test)
+{
+    if(results != NULL)
+        record_crash(results, test->index);
+
+    return;
+}
+
+void record_syscall_timeout(uint32_t index)
+{
+    if(results != NULL)
+        record_timeout(results, index);
+
+    return;
+}
+
+struct syscall_entry *pick_syscall(struct syscall_table *table)
+{
+    uint32_t index = 0;
+
+    if(pick_syscall_index(table, &index) < 0)
+        return (NULL);
+
+    return (atomic_load_ptr(&table->sys_entry[index]));
 }
 
 int32_t generate_args(struct test_case *test)
 {
     uint32_t i;
     int32_t rtrn = 0;
-    struct syscall_entry *entry = test->entry;
-    uint32_t total_args = test->entry->total_args;
+    const struct syscall_hot *hot = test->hot;
+    uint32_t total_args = hot->total_args;
+    uint64_t buffer_size[NX_ARG_SLOTS];
+    uint32_t has_length = 0;
+
+    test->total_args = 0;
+
+    /* The buffers this call gets are mapped again when the pool is reset. */
+    if((hot->flags & SYSCALL_REMAP) != 0)
+        damage_generated_buffers();
 
     for(i = 0; i < total_args; i++)
     {
-        rtrn = entry->get_arg_array[i](&test->arg_value_array[i]);
+        uint8_t kind = hot->arg_kind[i];
+
+        /* The cold entry is only touched for described and custom arguments. */
+        if(kind < NX_PLAIN_KINDS)
+            rtrn = generator_table[kind](&test->arg_value_array[i]);
+        else if(kind == KIND_CUSTOM)
+            rtrn = test->entry->get_arg_array[i](&test->arg_value_array[i]);
+        else if(kind == KIND_LEN)
+            has_length = 1;
+        else
+            rtrn = generate_described(test->entry->arg_desc_array[i], &test->arg_value_array[i]);
+
         if(rtrn < 0)
         {
             output->write(ERROR, "Failed to generate syscall argument\n");
             return (-1);
         }
+
+        if(kind == KIND_PTR || kind == KIND_BUF || kind == KIND_STRUCT)
+            buffer_size[i] = get_generated_buffer_size();
+
+        /* Record the slot so release_test_args() frees the args generated so far. */
+        test->arg_tag_array[i] = hot->arg_type[i];
+        test->arg_copy_array[i] = test->arg_value_array[i];
+        test->total_args = i + 1;
+    }
+
+    if(has_length == 0)
+        return (0);
+
+    /* Lengths go last, the buffer they describe may come after them. */
+    for(i = 0; i < total_args; i++)
+    {
+        if(hot->arg_kind[i] != KIND_LEN)
+            continue;
+
+        rtrn = generate_length(buffer_size[test->entry->arg_desc_array[i]->min], &test->arg_value_array[i]);
+        if(rtrn < 0)
+        {
+            output->write(ERROR, "Failed to generate syscall argument\n");
+            return (-1);
+        }
+
+        test->arg_copy_array[i] = test->arg_value_array[i];
     }
 
     return (0);
 }
 
-struct syscall_entry *find_entry(const char *name, struct syscall_table *table)
+int32_t find_entry_index(const char *name, struct syscall_table *table, uint32_t *index)
 {
     uint32_t i;
-    struct syscall_entry *entry = NULL;
-    uint32_t total_syscalls = table->total_syscalls;
 
-    for(i = 0; i < total_syscalls; i++)
+    if(table->indexed == 1)
+    {
+        uint64_t hash = hash_syscall_name(name);
+        uint32_t slot = name_slot(hash, table->name_seed[name_bucket(hash)]);
+
+        /* Every name maps to exactly one slot, so a hash mismatch means it's not in the table. */
+        if(table->name_slot_index[slot] == 0 || table->name_slot_hash[slot] != hash)
+            return (-1);
+
+        (*index) = (uint32_t)table->name_slot_index[slot] - 1;
+
+        return (0);
+    }
+
+    for(i = 0; i < table->total_syscalls; i++)
     {
         if(strcmp(name, table->sys_entry[i]->syscall_name) == 0)
         {
-            entry = table->sys_entry[i];
-            break;
+            (*index) = i;
+            return (0);
         }
     }
 
-    return (entry);
+    return (-1);
+}
+
+struct syscall_entry *find_entry(const char *name, struct syscall_table *table)
+{
+    uint32_t index = 0;
+
+    if(find_entry_index(name, table, &index) < 0)
+        return (NULL);
+
+    return (table->sys_entry[index]);
+}
+
+struct syscall_entry *find_entry_by_number(uint32_t number, struct syscall_table *table)
+{
+    if(table->indexed != 1 || number >= NX_MAX_SYSCALL_NUMBER)
+        return (NULL);
+
+    uint16_t index = table->number_index[number];
+    if(index == 0)
+        return (NULL);
+
+    return (table->sys_entry[index - 1]);
 }
 
 void inject_syscall_deps(struct dependency_context *ctx)
@@ -253,6 +972,16 @@ void inject_syscall_deps(struct dependency_context *ctx)
     inject_child_deps(ctx);
     inject_signal_deps(ctx);
     inject_generate_deps(ctx);
+    inject_weight_deps(ctx);
+    inject_results_deps(ctx);
+    inject_lane_deps(ctx);
+    inject_race_deps(ctx);
+    inject_testlog_deps(ctx);
+    inject_coverage_deps(ctx);
+#ifdef LINUX
+    inject_uring_deps(ctx);
+#endif
+    inject_program_deps(ctx);
 
     uint32_t i;
 
@@ -264,6 +993,10 @@ void inject_syscall_deps(struct dependency_context *ctx)
                 allocator = (struct memory_allocator *)ctx->array[i]->interface;
                 break;
 
+            case SCRATCH_ALLOCATOR:
+                scratch = (struct memory_allocator *)ctx->array[i]->interface;
+                break;
+
             case OUTPUT:
                 output = (struct output_writter *)ctx->array[i]->interface;
                 break;
@@ -271,6 +1004,10 @@ void inject_syscall_deps(struct dependency_context *ctx)
             case RANDOM_GEN:
                 random_gen = (struct random_generator *)ctx->array[i]->interface;
                 break;
+
+            case RESOURCE_GEN:
+                rsrc_gen = (struct resource_generator *)ctx->array[i]->interface;
+                break;
         }
     }
 
@@ -27,6 +27,10 @@
 #include "depend-inject/depend-inject.h"
 
 struct test_case;
+struct coverage_backend;
+
+/* The most bytes get_argument_data() reports for one argument. */
+#define NX_MAX_ARG_DATA 256
 
 /**
  *
@@ -35,6 +39,43 @@ extern struct syscall_table *get_table(void);
 
 extern struct test_case *create_test_case(void);
 
+/**
+ * Allocate an empty test case. The test case is meant to be reused,
+ * fill it with init_test_case() and release its arguments with cleanup_test().
+ * @return An empty test case on success and NULL on failure.
+ */
+extern struct test_case *alloc_test_case(void);
+
+/**
+ * Free a test case allocated with alloc_test_case() or create_test_case().
+ * @param test A pointer to the test case pointer to free.
+ */
+extern void free_test_case(struct test_case **test);
+
+/**
+ * Pick a syscall at random and generate arguments for it into the
+ * inline argument slots of test. No heap allocation is done.
+ * @param test The test case to fill in.
+ * @return Zero on success and -1 on failure.
+ */
+extern int32_t init_test_case(struct test_case *test);
+
+/**
+ * Setup an allocated test case for the syscall at a table index and generate it's arguments.
+ * @param test The test case to setup.
+ * @param index The syscall table index of the syscall to test.
+ * @return Zero on success and -1 on failure.
+ */
+extern int32_t init_test_case_at(struct test_case *test, uint32_t index);
+
+/**
+ * Like init_test_case() but for the syscall specified by name.
+ * @param test The test case to fill in.
+ * @param name The name of the syscall to generate a test case for.
+ * @return Zero on success and -1 on failure.
+ */
+extern int32_t init_test_case_for(struct test_case *test, const char *name);
+
 /**
  * Create a system call test case for the syscall specified by name.
  * @param name The name of the syscall to generate a test case for.
@@ -54,7 +95,7 @@ extern struct test_case *create_test_case_for(const char *name);
  * @param test A pointer to a test case struct/object.
  * @return An array of syscall arguments.
  */
-extern uint64_t **get_argument_array(struct test_case *test);
+extern uint64_t *get_argument_array(struct test_case *test);
 
 /**
  * Picks and returns a syscall entry at random.
@@ -63,12 +104,163 @@ extern uint64_t **get_argument_array(struct test_case *test);
  */
 extern struct syscall_entry *pick_syscall(struct syscall_table *table);
 
+/**
+ * Picks the table index of a switched on syscall at random.
+ * @param table A system call table to pick from.
+ * @param index Where the picked index is stored.
+ * @return Zero on success and -1 on failure.
+ */
+extern int32_t pick_syscall_index(struct syscall_table *table, uint32_t *index);
+
+/**
+ * Switch pick_syscall_index() over to weighted selection. The selector lives
+ * in shared memory, so call this in the supervisor before forking children.
+ * @return Zero on success and -1 on failure.
+ */
+extern int32_t setup_weighted_selection(void);
+
+/**
+ * Rebuild the syscall weights from the feedback the children recorded.
+ * Does nothing when weighted selection isn't setup.
+ * @return Zero on success and -1 on failure.
+ */
+extern int32_t update_syscall_weights(void);
+
+/**
+ * Start recording per syscall return value and errno histograms. They live
+ * in shared memory, so call this in the supervisor before forking children.
+ * @return Zero on success and -1 on failure.
+ */
+extern int32_t setup_result_stats(void);
+
+/**
+ * Write the return value histograms to path. Does nothing when
+ * setup_result_stats() wasn't called.
+ * @param path Where to write the histograms.
+ * @return Zero on success and -1 on failure.
+ */
+extern int32_t export_results(const char *path);
+
+/**
+ * Start classifying syscalls into fast and slow lanes by their measured
+ * latency. Needs setup_result_stats() first, and like it must be called
+ * in the supervisor before forking children.
+ * @return Zero on success and -1 on failure.
+ */
+extern int32_t setup_syscall_lanes(void);
+
+/**
+ * Set which syscalls pick_syscall_index() picks in this process. Fast
+ * workers never pick slow syscalls and slow workers only pick slow ones.
+ * @param worker_lane The enum syscall_lane of the worker this process runs.
+ */
+extern void set_syscall_lane(uint32_t worker_lane);
+
+/**
+ * Reclassify syscalls from the latency and timeouts the children recorded.
+ * Does nothing when the lanes aren't setup.
+ * @return Zero on success and -1 on failure.
+ */
+extern int32_t update_syscall_lanes(void);
+
+/**
+ * @param index A syscall table index.
+ * @return One when this process's lane may run the syscall, zero otherwise.
+ */
+extern int32_t in_syscall_lane(uint32_t index);
+
+/**
+ * Record how a test went so the next weight update can use it.
+ * @param test The test case that was executed.
+ * @param elapsed_ns How long the syscall took.
+ * @param new_coverage One when the test found new coverage.
+ */
+extern void record_test_result(struct test_case *test, uint64_t elapsed_ns, uint32_t new_coverage);
+
+/**
+ * Record that a test raised a fatal signal instead of returning.
+ * @param test The test case that crashed.
+ */
+extern void record_test_crash(struct test_case *test);
+
+/**
+ * Collect kernel coverage with backend and feed it to the syscall weights.
+ * The edge map is shared, so this must be called in the supervisor before
+ * forking children.
+ * @param backend The coverage backend to use.
+ * @return Zero on success and -1 when the backend is unavailable or the map can't be created.
+ */
+extern int32_t setup_coverage(struct coverage_backend *backend);
+
+/**
+ * Open the coverage backend in the calling process, children call this
+ * once before their first test. Does nothing without setup_coverage().
+ * @return Zero on success and -1 when the child has to run without coverage.
+ */
+extern int32_t open_coverage(void);
+
+/**
+ * Close the coverage backend opened with open_coverage().
+ */
+extern void close_coverage(void);
+
+/**
+ * Start tracing the test about to execute.
+ */
+extern void start_coverage(void);
+
+/**
+ * Stop tracing and merge the trace into the shared edge map.
+ * @return The number of edges never hit before, pass it to record_test_result().
+ */
+extern uint32_t stop_coverage(void);
+
+/**
+ * @return The number of different kernel edges hit by all children so far.
+ */
+extern uint64_t get_coverage_edges(void);
+
+/**
+ * Record that a call timed out, either it's timer went off or the supervisor killed it's worker.
+ * @param index The syscall table index of the call's syscall.
+ */
+extern void record_syscall_timeout(uint32_t index);
+
+/**
+ * Find the bytes an argument points at that are worth keeping with a record
+ * of the test, the string of a path or the buffer of a described struct.
+ * @param test A generated test case.
+ * @param slot The argument slot.
+ * @param data Set to the bytes, or NULL when the argument has none.
+ * @return The number of bytes at data, at most NX_MAX_ARG_DATA.
+ */
+extern uint32_t get_argument_data(struct test_case *test, uint32_t slot, const void **data);
+
+/**
+ * @param test A test case.
+ * @return The syscall table index of the test case's syscall.
+ */
+extern uint32_t get_syscall_index(struct test_case *test);
+
+/**
+ * @param test A test case.
+ * @return One when the test case's syscall can block and needs an alarm, zero otherwise.
+ */
+extern int32_t needs_alarm(struct test_case *test);
+
+/**
+ * @param test A test case.
+ * @return How many milliseconds the test case's call may run before it's
+ * timer goes off, or zero when it doesn't need a timer.
+ */
+extern uint32_t get_call_timeout(struct test_case *test);
+
 /**
  * Returns the syscall entry for the syscall selected in a test case.
  * @param test A test case object from which you want the selected syscall entry.
  * @return A syscall entry on success and NULL on failure.
  */
-extern inline struct syscall_entry *get_entry(struct test_case *test);
+extern struct syscall_entry *get_entry(struct test_case *test);
 
 /**
  * Generates system call arguments for a test case. generate_args()
@@ -81,10 +273,69 @@ extern inline struct syscall_entry *get_entry(struct test_case *test);
 
  /**
   * Free's resources such as descriptors and memory associated to a test case.
+  * The test case itself is not freed so it can be reused. This also recycles
+  * every buffer and scratch allocation handed out since the last cleanup, so
+  * only call it once no other test case is using them, ie after a program.
   * @param test The test case to free resources for. 
   */
 extern void cleanup_test(struct test_case *test);
 
+/**
+ * Hand the pooled resources in the argument slots of a test case back,
+ * without touching the buffer pool or the scratch arena. Use this to drop
+ * one call of a program while the other calls still hold their buffers.
+ * @param test The test case to release the arguments of.
+ */
+extern void release_test_args(struct test_case *test);
+
+/**
+ * Close the descriptor or unmap the mapping an executed test case returned.
+ * Calls that failed or return anything else are left alone.
+ * @param test A test case that was executed.
+ */
+extern void release_test_result(struct test_case *test);
+
+/**
+ * Make dst use the same descriptors, sockets, paths and buffers as src
+ * wherever both have an argument of the same type, so the two calls race
+ * on one resource. dst's own resources in those slots are freed, and the
+ * borrowed ones are left for src's cleanup to free.
+ * @param dst The test case to point at src's resources.
+ * @param src The test case that owns the resources.
+ * @return The number of argument slots now shared.
+ */
+extern uint32_t share_test_resources(struct test_case *dst, struct test_case *src);
+
+/**
+ * Execute the syscall of a test case with the values currently in it's
+ * argument slots, including any mutations. The syscall is issued directly
+ * with a single trap, no libc wrapper is involved on Linux x86_64.
+ * @param test The test case to execute.
+ * @return Zero when the syscall succeeded and -1 when it returned an error.
+ */
+extern int32_t execute_test(struct test_case *test);
+
+/**
+ * Store a raw syscall result in a test case, for syscalls that were issued
+ * some other way than execute_test(), ie as an io_uring submission.
+ * @param test The test case the result belongs to.
+ * @param ret The result, -errno on failure like the kernel returns it.
+ * @return Zero when ret is a success and -1 when it's an error.
+ */
+extern int32_t set_test_return(struct test_case *test, int64_t ret);
+
+/**
+ * @param test A test case that has been executed with execute_test().
+ * @return The value returned by the syscall, -1 when it failed.
+ */
+extern int64_t get_return_value(struct test_case *test);
+
+/**
+ * @param test A test case that has been executed with execute_test().
+ * @return The errno value the syscall failed with, zero on success.
+ */
+extern int32_t get_error(struct test_case *test);
+
 /**
  * Grab a specific syscall entry by syscall name.
  * @param name The name of the syscall to find.
@@ -93,6 +344,23 @@ extern void cleanup_test(struct test_case *test);
  */
 extern struct syscall_entry *find_entry(const char *name, struct syscall_table *table);
 
+/**
+ * Find a syscall entry by it's syscall number.
+ * @param number The syscall number.
+ * @param table The system call table to search for entries in.
+ * @return The entry on success and NULL when there is no syscall with that number.
+ */
+extern struct syscall_entry *find_entry_by_number(uint32_t number, struct syscall_table *table);
+
+/**
+ * Like find_entry() but gives the table index of the entry.
+ * @param name The name of the syscall to find.
+ * @param table The system call table to search for entries in.
+ * @param index Where the index of the entry is stored.
+ * @return Zero on success and -1 when the entry can not be found.
+ */
+extern int32_t find_entry_index(const char *name, struct syscall_table *table, uint32_t *index);
+
 extern void inject_syscall_deps(struct dependency_context *ctx);
 
 #endif
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2015, Harrison Bowden, Minneapolis, MN
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ **/
+
+#include "syscall_hash.h"
+
+#include <string.h>
+
+/* Give up on a bucket after this many seeds. */
+#define MAX_SEED UINT16_MAX
+
+/* Try to place every name in bucket with seed, claiming the slots on success. */
+static int32_t place_bucket(const uint64_t *hashes, const uint16_t *members, uint32_t total_members,
+                            uint16_t seed, uint16_t *slot_index, uint64_t *slot_hash)
+{
+    uint32_t i, j;
+    uint32_t slots[NX_NAME_SLOTS];
+
+    for(i = 0; i < total_members; i++)
+    {
+        slots[i] = name_slot(hashes[members[i]], seed);
+
+        if(slot_index[slots[i]] != 0)
+            return (-1);
+
+        /* Two names of the same bucket can't share a slot either. */
+        for(j = 0; j < i; j++)
+        {
+            if(slots[j] == slots[i])
+                return (-1);
+        }
+    }
+
+    for(i = 0; i < total_members; i++)
+    {
+        slot_index[slots[i]] = (uint16_t)(members[i] + 1);
+        slot_hash[slots[i]] = hashes[members[i]];
+    }
+
+    return (0);
+}
+
+int32_t build_name_hash(const char **names, uint32_t count, uint16_t *seeds,
+                        uint16_t *slot_index, uint64_t *slot_hash)
+{
+    if(count > NX_NAME_SLOTS / 2)
+        return (-1);
+
+    uint32_t i, j;
+    uint32_t largest = 0;
+    uint64_t hashes[NX_NAME_SLOTS];
+    uint32_t bucket_size[NX_NAME_BUCKETS];
+    uint16_t members[NX_NAME_SLOTS];
+
+    memset(seeds, 0, sizeof(uint16_t) * NX_NAME_BUCKETS);
+    memset(slot_index, 0, sizeof(uint16_t) * NX_NAME_SLOTS);
+    memset(slot_hash, 0, sizeof(uint64_t) * NX_NAME_SLOTS);
+    memset(bucket_size, 0, sizeof(bucket_size));
+
+    for(i = 0; i < count; i++)
+    {
+        hashes[i] = hash_syscall_name(names[i]);
+
+        uint32_t bucket = name_bucket(hashes[i]);
+
+        bucket_size[bucket]++;
+        if(bucket_size[bucket] > largest)
+            largest = bucket_size[bucket];
+    }
+
+    uint32_t size;
+
+    /* Place the largest buckets first while most slots are still free. */
+    for(size = largest; size > 0; size--)
+    {
+        for(i = 0; i < NX_NAME_BUCKETS; i++)
+        {
+            if(bucket_size[i] != size)
+                continue;
+
+            uint32_t total_members = 0;
+
+            for(j = 0; j < count; j++)
+            {
+                if(name_bucket(hashes[j]) != i)
+                    continue;
+
+                /* Only the first of duplicate names is indexed. */
+                uint32_t k;
+                for(k = 0; k < total_members; k++)
+                {
+                    if(hashes[members[k]] == hashes[j])
+                        break;
+                }
+
+                if(k == total_members)
+                    members[total_members++] = (uint16_t)j;
+            }
+
+            uint32_t seed;
+
+            for(seed = 1; seed <= MAX_SEED; seed++)
+            {
+                if(place_bucket(hashes, members, total_members, (uint16_t)seed, slot_index, slot_hash) == 0)
+                    break;
+            }
+
+            if(seed > MAX_SEED)
+                return (-1);
+
+            seeds[i] = (uint16_t)seed;
+        }
+    }
+
+    return (0);
+}
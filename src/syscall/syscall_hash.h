@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2015, Harrison Bowden, Minneapolis, MN
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ **/
+
+#ifndef NX_SYSCALL_HASH_H
+#define NX_SYSCALL_HASH_H
+
+/* The syscall name index is shared by syscall-gen, which runs on the
+   build host, and the syscall module, so this only depends on libc. */
+
+#include <stdint.h>
+
+/* Sizes of the name and number indexes in struct syscall_table. Both
+   NX_NAME_BUCKETS and NX_NAME_SLOTS must be powers of two. */
+#define NX_NAME_BUCKETS 256
+#define NX_NAME_SLOTS 1024
+#define NX_MAX_SYSCALL_NUMBER 1024
+
+/**
+ * FNV-1a hash of a syscall name. Lookups hash the name once and derive
+ * the bucket and slot from the result with mix_name_hash().
+ */
+static inline uint64_t hash_syscall_name(const char *name)
+{
+    uint64_t hash = UINT64_C(14695981039346656037);
+
+    while(*name != '\0')
+    {
+        hash ^= (uint8_t)*name++;
+        hash *= UINT64_C(1099511628211);
+    }
+
+    return (hash);
+}
+
+/* Seeded 64 bit finalizer, so every seed spreads the names differently. */
+static inline uint64_t mix_name_hash(uint64_t hash, uint32_t seed)
+{
+    hash ^= (uint64_t)seed * UINT64_C(0x9e3779b97f4a7c15);
+    hash ^= hash >> 33;
+    hash *= UINT64_C(0xff51afd7ed558ccd);
+    hash ^= hash >> 33;
+    hash *= UINT64_C(0xc4ceb9fe1a85ec53);
+    hash ^= hash >> 33;
+
+    return (hash);
+}
+
+static inline uint32_t name_bucket(uint64_t hash)
+{
+    return ((uint32_t)mix_name_hash(hash, 0) & (NX_NAME_BUCKETS - 1));
+}
+
+static inline uint32_t name_slot(uint64_t hash, uint16_t seed)
+{
+    return ((uint32_t)mix_name_hash(hash, seed) & (NX_NAME_SLOTS - 1));
+}
+
+/**
+ * Build a perfect hash over a set of syscall names with hash and displace.
+ * Names are grouped into buckets, and each bucket gets the first seed that
+ * puts all of it's names in free slots. A lookup is then one hash of the
+ * name, one seed read and one slot read.
+ * @param names The syscall names, in syscall table order.
+ * @param count The number of names, at most NX_NAME_SLOTS / 2.
+ * @param seeds NX_NAME_BUCKETS seeds, one per bucket.
+ * @param slot_index NX_NAME_SLOTS table indexes plus one, zero marks a free slot.
+ * @param slot_hash NX_NAME_SLOTS name hashes, lookups compare these instead of strings.
+ * @return Zero on success and -1 when no seeds could be found.
+ */
+extern int32_t build_name_hash(const char **names, uint32_t count, uint16_t *seeds,
+                               uint16_t *slot_index, uint64_t *slot_hash);
+
+#endif /* End of header file. */
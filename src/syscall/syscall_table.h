@@ -17,17 +17,67 @@
 #define SYSCALL_TABLE_H
 
 #include "entry.h"
+#include "syscall_hash.h"
 #include <stdint.h>
 
+/* Room for every syscall number on the largest table we generate. */
+#define NX_MAX_SYSCALLS 512
+
+enum syscall_flag { SYSCALL_ON = 1, SYSCALL_ALARM = 2, SYSCALL_ROOT = 4, SYSCALL_REMAP = 8 };
+
+/* The part of a syscall entry that is touched on every test, packed into
+   32 bytes so an entry never straddles a cache line. The cold syscall_entry
+   is only needed for names, logging and custom generators. */
+struct syscall_hot
+{
+    uint16_t number;
+    uint8_t total_args;
+    uint8_t flags;
+    uint8_t arg_kind[NX_ARG_SLOTS];
+    uint8_t arg_type[NX_ARG_SLOTS];
+    uint8_t return_kind;
+    const char padding[9];
+};
+
 struct syscall_table
 {
     uint32_t total_syscalls;
-    const char padding[4];
-    struct syscall_entry *sys_entry[400];
+
+    /* The number of indexes in active, ie the syscalls that are switched on. */
+    uint32_t total_active;
+
+    /* Set once build_hot_table() has filled in the hot part of the table. */
+    uint32_t ready;
+
+    /* Set once the name and number indexes below are filled in, syscall-gen
+       generates them, otherwise build_hot_table() builds them at startup. */
+    uint32_t indexed;
+
+    /* Indexes of the entries pick_syscall() chooses from. */
+    uint16_t active[NX_MAX_SYSCALLS];
+
+    struct syscall_hot hot[NX_MAX_SYSCALLS];
+
+    struct syscall_entry *sys_entry[NX_MAX_SYSCALLS];
+
+    /* Perfect hash over the syscall names, see build_name_hash(). */
+    uint16_t name_seed[NX_NAME_BUCKETS];
+    uint16_t name_slot_index[NX_NAME_SLOTS];
+    uint64_t name_slot_hash[NX_NAME_SLOTS];
+
+    /* Table index plus one of each syscall number, zero when there is no entry. */
+    uint16_t number_index[NX_MAX_SYSCALL_NUMBER];
 };
 
 extern struct syscall_table *get_table(void);
 
+/**
+ * Fill in the hot part of a syscall table from it's entries. get_table()
+ * calls this, calling it again on a built table does nothing.
+ * @param table The syscall table to build.
+ */
+extern void build_hot_table(struct syscall_table *table);
+
 #ifdef FREEBSD
 
 extern struct syscall_table freebsd_syscall_table;
@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2015, Harrison Bowden, Minneapolis, MN
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ **/
+
+#include "testlog.h"
+#include "syscall_table.h"
+#include "syscall.h"
+#include "io/io.h"
+#include "memory/memory.h"
+#include "utils/utils.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static struct output_writter *output;
+static struct memory_allocator *allocator;
+
+/* Typed ring functions that copy whole records in and out of the buffer. */
+CK_RING_PROTOTYPE(test_record, test_record)
+
+struct test_log *create_test_log(void)
+{
+    struct test_log *log = NULL;
+
+    log = allocator->shared(sizeof(struct test_log));
+    if(log == NULL)
+    {
+        output->write(ERROR, "Failed to allocate test log\n");
+        return (NULL);
+    }
+
+    reset_test_log(log);
+
+    return (log);
+}
+
+void reset_test_log(struct test_log *log)
+{
+    ck_ring_init(&log->ring, NX_TEST_LOG_SIZE);
+    log->sequence = 0;
+}
+
+void log_test_record(struct test_log *log, uint32_t number, const uint64_t *args,
+                     const void *const *data, const uint32_t *data_size, uint32_t total_args)
+{
+    uint32_t i;
+    uint32_t used = 0;
+    struct test_record record;
+
+    if(total_args > NX_ARG_SLOTS)
+        total_args = NX_ARG_SLOTS;
+
+    record.sequence = log->sequence++;
+    record.timestamp = get_time_ns();
+    record.number = number;
+    record.total_args = total_args;
+    memset(record.args, 0, sizeof(record.args));
+    memcpy(record.args, args, total_args * sizeof(uint64_t));
+    memset(record.data_size, 0, sizeof(record.data_size));
+
+    /* Arguments later in the call get whatever space is left. */
+    for(i = 0; data != NULL && i < total_args; i++)
+    {
+        uint32_t size = data_size[i];
+
+        if(data[i] == NULL || size == 0)
+            continue;
+
+        if(size > NX_TEST_RECORD_DATA - used)
+            size = NX_TEST_RECORD_DATA - used;
+
+        memcpy(&record.data[used], data[i], size);
+        record.data_size[i] = (uint16_t)size;
+        used += size;
+    }
+
+    if(ck_ring_enqueue_spsc_test_record(&log->ring, log->buffer, &record) == true)
+        return;
+
+    /* Full, the oldest record is the least interesting one. */
+    struct test_record oldest;
+
+    (void)ck_ring_dequeue_spsc_test_record(&log->ring, log->buffer, &oldest);
+    (void)ck_ring_enqueue_spsc_test_record(&log->ring, log->buffer, &record);
+}
+
+uint32_t drain_test_log(struct test_log *log, struct test_record *records, uint32_t max)
+{
+    uint32_t total = 0;
+
+    while(total < max && ck_ring_dequeue_spsc_test_record(&log->ring, log->buffer, &records[total]) == true)
+        total++;
+
+    return (total);
+}
+
+/* Print the bytes of an argument as a quoted string, escaping the unprintable ones. */
+static void write_arg_data(FILE *file, const uint8_t *data, uint32_t size)
+{
+    uint32_t i;
+
+    fputc('"', file);
+
+    for(i = 0; i < size; i++)
+    {
+        if(data[i] >= 0x20 && data[i] < 0x7f && data[i] != '"' && data[i] != '\\')
+            fputc(data[i], file);
+        else
+            fprintf(file, "\\x%02x", data[i]);
+    }
+
+    fputc('"', file);
+
+    return;
+}
+
+static const char *get_syscall_name(uint32_t number)
+{
+    struct syscall_table *table = get_table();
+
+    if(table == NULL || number >= NX_MAX_SYSCALL_NUMBER || table->number_index[number] == 0)
+        return ("unknown");
+
+    return (table->sys_entry[table->number_index[number] - 1]->syscall_name);
+}
+
+int32_t write_test_log(struct test_log *log, const char *path, pid_t pid, int32_t sig)
+{
+    struct test_record *records = NULL;
+
+    records = allocator->alloc(sizeof(struct test_record) * NX_TEST_LOG_SIZE);
+    if(records == NULL)
+    {
+        output->write(ERROR, "Failed to allocate test records\n");
+        return (-1);
+    }
+
+    uint32_t total = drain_test_log(log, records, NX_TEST_LOG_SIZE);
+
+    FILE *file = fopen(path, "w");
+    if(file == NULL)
+    {
+        output->write(ERROR, "Can't create %s: %s\n", path, strerror(errno));
+        allocator->free((void **)&records);
+        return (-1);
+    }
+
+    uint32_t i, j, used;
+
+    fprintf(file, "# pid %d killed by signal %d, last %u tests oldest first\n", (int)pid, sig, total);
+    fprintf(file, "# sequence\ttime_ns\tsyscall\tnumber\targs... with what they point at as value:\"bytes\"\n");
+
+    for(i = 0; i < total; i++)
+    {
+        fprintf(file, "%llu\t%llu\t%s\t%u", (unsigned long long)records[i].sequence,
+                (unsigned long long)records[i].timestamp, get_syscall_name(records[i].number),
+                records[i].number);
+
+        for(j = 0, used = 0; j < records[i].total_args; j++)
+        {
+            fprintf(file, "\t0x%llx", (unsigned long long)records[i].args[j]);
+
+            if(records[i].data_size[j] == 0)
+                continue;
+
+            fputc(':', file);
+            write_arg_data(file, &records[i].data[used], records[i].data_size[j]);
+            used += records[i].data_size[j];
+        }
+
+        fprintf(file, "\n");
+    }
+
+    allocator->free((void **)&records);
+
+    if(fclose(file) != 0)
+    {
+        output->write(ERROR, "Can't write %s: %s\n", path, strerror(errno));
+        (void)unlink(path);
+        return (-1);
+    }
+
+    return (0);
+}
+
+void inject_testlog_deps(struct dependency_context *ctx)
+{
+    uint32_t i;
+
+    for(i = 0; i < ctx->count; i++)
+    {
+        switch((int32_t)ctx->array[i]->name)
+        {
+            case ALLOCATOR:
+                allocator = (struct memory_allocator *)ctx->array[i]->interface;
+                break;
+
+            case OUTPUT:
+                output = (struct output_writter *)ctx->array[i]->interface;
+                break;
+        }
+    }
+
+    return;
+}
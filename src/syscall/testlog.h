@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2015, Harrison Bowden, Minneapolis, MN
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ **/
+
+/**
+*     @file testlog.h
+*     @brief Every child writes a compact record of each test into it's own
+*     ring in shared memory right before executing it. When a child dies the
+*     supervisor still has the calls that led up to it, without the child
+*     doing any disk I/O per test. The ring is a ck_ring with the records
+*     stored inline, the child is the only producer and, since it drops the
+*     oldest record when the ring is full, also the only consumer until it
+*     dies. Only then does the supervisor drain it.
+*/
+
+#ifndef NX_TESTLOG_H
+#define NX_TESTLOG_H
+
+#include "entry.h"
+#include "depend-inject/depend-inject.h"
+
+#include <ck_ring.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Slots in a ring, a power of two. A ck_ring holds one less record than that. */
+#define NX_TEST_LOG_SIZE 256
+
+/* Bytes a record keeps of what it's arguments point at, shared by all of them. */
+#define NX_TEST_RECORD_DATA 256
+
+struct test_record
+{
+    /* Counts the tests of the child, gaps mean records were dropped. */
+    uint64_t sequence;
+    uint64_t timestamp;
+    uint64_t args[NX_ARG_SLOTS];
+    uint32_t number;
+    uint32_t total_args;
+    /* How many bytes of data belong to each argument, in argument order. */
+    uint16_t data_size[NX_ARG_SLOTS];
+    uint8_t data[NX_TEST_RECORD_DATA];
+};
+
+struct test_log
+{
+    ck_ring_t ring;
+    uint64_t sequence;
+    struct test_record buffer[NX_TEST_LOG_SIZE];
+};
+
+/**
+ * Create an empty test log in shared memory.
+ * @return A test log on success and NULL on failure.
+ */
+extern struct test_log *create_test_log(void);
+
+/**
+ * Empty a test log for the next child in it's slot. Only call this while no process writes to it.
+ * @param log The test log to reset.
+ */
+extern void reset_test_log(struct test_log *log);
+
+/**
+ * Append a record to the log, dropping the oldest record when it's full.
+ * Called by the child right before it executes a test.
+ * @param log The child's test log.
+ * @param number The syscall number of the test.
+ * @param args The argument values the syscall is about to be called with.
+ * @param data The bytes each argument points at, NULL entries or a NULL array for none.
+ * @param data_size The number of bytes in each entry of data.
+ * @param total_args How many of the args are used.
+ */
+extern void log_test_record(struct test_log *log, uint32_t number, const uint64_t *args,
+                            const void *const *data, const uint32_t *data_size, uint32_t total_args);
+
+/**
+ * Take the records out of the log of a child that is no longer running, oldest first.
+ * @param log The test log to drain.
+ * @param records Where to copy the records to.
+ * @param max How many records fit in records.
+ * @return The number of records copied.
+ */
+extern uint32_t drain_test_log(struct test_log *log, struct test_record *records, uint32_t max);
+
+/**
+ * Drain the log of a dead child and write it out as a tab separated file.
+ * @param log The test log of the dead child.
+ * @param path The file to write.
+ * @param pid The pid the child had.
+ * @param sig The signal that killed it.
+ * @return Zero on success and -1 on failure.
+ */
+extern int32_t write_test_log(struct test_log *log, const char *path, pid_t pid, int32_t sig);
+
+extern void inject_testlog_deps(struct dependency_context *ctx);
+
+#endif
@@ -0,0 +1,747 @@
+/*
+ * Copyright (c) 2015, Harrison Bowden, Minneapolis, MN
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ **/
+
+/* We need to define _GNU_SOURCE to use
+ syscall() for the io_uring calls, glibc has no
+ wrappers for them. We also need to place
+ _GNU_SOURCE at the top of the file before
+ any other includes for it to work properly. */
+#define _GNU_SOURCE
+
+#include "uring.h"
+#include "syscall_table.h"
+#include "io/io.h"
+#include "memory/memory.h"
+#include "utils/utils.h"
+#include "concurrent/concurrent.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+static struct output_writter *output;
+static struct memory_allocator *allocator;
+
+/* Room for a full batch with a linked timeout behind every call. */
+#define URING_ENTRIES (NX_URING_BATCH * 2)
+
+/* How many picks each slot of a batch gets to find a syscall io_uring supports. */
+#define URING_PICK_TRIES 32
+
+/* How long a call may run before it's linked timeout cancels it. */
+#define URING_TIMEOUT_MS 100
+
+/* user_data of a call's linked timeout, calls use their queue slot. */
+#define URING_TIMEOUT_DATA(i) (NX_URING_BATCH + (i))
+
+struct uring_batch
+{
+    int32_t fd;
+    uint32_t sq_tail;
+
+    /* The shared ring state, mapped from the kernel. */
+    uint32_t *sq_head_ptr;
+    uint32_t *sq_tail_ptr;
+    uint32_t *sq_mask_ptr;
+    uint32_t *sq_array;
+    uint32_t *cq_head_ptr;
+    uint32_t *cq_tail_ptr;
+    uint32_t *cq_mask_ptr;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    size_t sqes_size;
+
+    struct __kernel_timespec timeout;
+
+    uint32_t total_generated;
+    uint32_t total_queued;
+
+    /* Set for every table index the running kernel has an opcode for. */
+    uint8_t supported[NX_MAX_SYSCALLS];
+
+    /* Calls that ran to completion and whose results need releasing. */
+    uint8_t done[NX_URING_BATCH];
+    uint8_t cancelled[NX_URING_BATCH];
+    struct test_case *calls[NX_URING_BATCH];
+    struct test_case *queued[NX_URING_BATCH];
+};
+
+/* Translate a syscall and it's arguments into an SQE. Arguments are taken
+   as the syscall would see them, io_uring just keeps them in other fields.
+   Offsets of -1 mean the file position, like read() and write() use. */
+static int32_t fill_sqe(struct io_uring_sqe *sqe, uint32_t number, const uint64_t *args)
+{
+    sqe->fd = (int32_t)args[0];
+
+    switch(number)
+    {
+        case __NR_read:
+        case __NR_write:
+            sqe->opcode = (number == __NR_read) ? IORING_OP_READ : IORING_OP_WRITE;
+            sqe->addr = args[1];
+            sqe->len = (uint32_t)args[2];
+            sqe->off = UINT64_MAX;
+            break;
+
+        case __NR_pread64:
+        case __NR_pwrite64:
+            sqe->opcode = (number == __NR_pread64) ? IORING_OP_READ : IORING_OP_WRITE;
+            sqe->addr = args[1];
+            sqe->len = (uint32_t)args[2];
+            sqe->off = args[3];
+            break;
+
+        case __NR_readv:
+        case __NR_writev:
+            sqe->opcode = (number == __NR_readv) ? IORING_OP_READV : IORING_OP_WRITEV;
+            sqe->addr = args[1];
+            sqe->len = (uint32_t)args[2];
+            sqe->off = UINT64_MAX;
+            break;
+
+        case __NR_preadv:
+        case __NR_pwritev:
+            sqe->opcode = (number == __NR_preadv) ? IORING_OP_READV : IORING_OP_WRITEV;
+            sqe->addr = args[1];
+            sqe->len = (uint32_t)args[2];
+            sqe->off = args[3];
+            break;
+
+        case __NR_fsync:
+        case __NR_fdatasync:
+            sqe->opcode = IORING_OP_FSYNC;
+            sqe->fsync_flags = (number == __NR_fdatasync) ? IORING_FSYNC_DATASYNC : 0;
+            break;
+
+        case __NR_sync_file_range:
+            sqe->opcode = IORING_OP_SYNC_FILE_RANGE;
+            sqe->off = args[1];
+            sqe->len = (uint32_t)args[2];
+            sqe->sync_range_flags = (uint32_t)args[3];
+            break;
+
+        case __NR_fallocate:
+            sqe->opcode = IORING_OP_FALLOCATE;
+            sqe->len = (uint32_t)args[1];
+            sqe->off = args[2];
+            sqe->addr = args[3];
+            break;
+
+        case __NR_fadvise64:
+            sqe->opcode = IORING_OP_FADVISE;
+            sqe->off = args[1];
+            sqe->len = (uint32_t)args[2];
+            sqe->fadvise_advice = (uint32_t)args[3];
+            break;
+
+        case __NR_madvise:
+            sqe->opcode = IORING_OP_MADVISE;
+            sqe->fd = -1;
+            sqe->addr = args[0];
+            sqe->len = (uint32_t)args[1];
+            sqe->fadvise_advice = (uint32_t)args[2];
+            break;
+
+        case __NR_open:
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = args[0];
+            sqe->open_flags = (uint32_t)args[1];
+            sqe->len = (uint32_t)args[2];
+            break;
+
+        case __NR_openat:
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->addr = args[1];
+            sqe->open_flags = (uint32_t)args[2];
+            sqe->len = (uint32_t)args[3];
+            break;
+
+        case __NR_close:
+            sqe->opcode = IORING_OP_CLOSE;
+            break;
+
+        case __NR_statx:
+            sqe->opcode = IORING_OP_STATX;
+            sqe->addr = args[1];
+            sqe->statx_flags = (uint32_t)args[2];
+            sqe->len = (uint32_t)args[3];
+            sqe->addr2 = args[4];
+            break;
+
+        case __NR_sendmsg:
+        case __NR_recvmsg:
+            sqe->opcode = (number == __NR_sendmsg) ? IORING_OP_SENDMSG : IORING_OP_RECVMSG;
+            sqe->addr = args[1];
+            sqe->len = 1;
+            sqe->msg_flags = (uint32_t)args[2];
+            break;
+
+        case __NR_accept:
+        case __NR_accept4:
+            sqe->opcode = IORING_OP_ACCEPT;
+            sqe->addr = args[1];
+            sqe->addr2 = args[2];
+            sqe->accept_flags = (number == __NR_accept4) ? (uint32_t)args[3] : 0;
+            break;
+
+        case __NR_connect:
+            sqe->opcode = IORING_OP_CONNECT;
+            sqe->addr = args[1];
+            sqe->addr2 = args[2];
+            break;
+
+        case __NR_shutdown:
+            sqe->opcode = IORING_OP_SHUTDOWN;
+            sqe->len = (uint32_t)args[1];
+            break;
+
+        case __NR_socket:
+            sqe->opcode = IORING_OP_SOCKET;
+            sqe->fd = (int32_t)args[0];
+            sqe->off = args[1];
+            sqe->len = (uint32_t)args[2];
+            break;
+
+        /* The offset pointers of splice() can't be followed here without
+           risking a fault, so the pipe and file positions are always used. */
+        case __NR_splice:
+            sqe->opcode = IORING_OP_SPLICE;
+            sqe->splice_fd_in = (int32_t)args[0];
+            sqe->splice_off_in = UINT64_MAX;
+            sqe->fd = (int32_t)args[2];
+            sqe->off = UINT64_MAX;
+            sqe->len = (uint32_t)args[4];
+            sqe->splice_flags = (uint32_t)args[5];
+            break;
+
+        case __NR_tee:
+            sqe->opcode = IORING_OP_TEE;
+            sqe->splice_fd_in = (int32_t)args[0];
+            sqe->fd = (int32_t)args[1];
+            sqe->len = (uint32_t)args[2];
+            sqe->splice_flags = (uint32_t)args[3];
+            break;
+
+        case __NR_renameat:
+        case __NR_renameat2:
+            sqe->opcode = IORING_OP_RENAMEAT;
+            sqe->addr = args[1];
+            sqe->len = (uint32_t)args[2];
+            sqe->addr2 = args[3];
+            sqe->rename_flags = (number == __NR_renameat2) ? (uint32_t)args[4] : 0;
+            break;
+
+        case __NR_unlinkat:
+            sqe->opcode = IORING_OP_UNLINKAT;
+            sqe->addr = args[1];
+            sqe->unlink_flags = (uint32_t)args[2];
+            break;
+
+        case __NR_mkdirat:
+            sqe->opcode = IORING_OP_MKDIRAT;
+            sqe->addr = args[1];
+            sqe->len = (uint32_t)args[2];
+            break;
+
+        case __NR_symlinkat:
+            sqe->opcode = IORING_OP_SYMLINKAT;
+            sqe->addr = args[0];
+            sqe->fd = (int32_t)args[1];
+            sqe->addr2 = args[2];
+            break;
+
+        case __NR_linkat:
+            sqe->opcode = IORING_OP_LINKAT;
+            sqe->addr = args[1];
+            sqe->len = (uint32_t)args[2];
+            sqe->addr2 = args[3];
+            sqe->hardlink_flags = (uint32_t)args[4];
+            break;
+
+        case __NR_epoll_ctl:
+            sqe->opcode = IORING_OP_EPOLL_CTL;
+            sqe->len = (uint32_t)args[1];
+            sqe->off = args[2];
+            sqe->addr = args[3];
+            break;
+
+        default:
+            return (-1);
+    }
+
+    return (0);
+}
+
+/* Ask the kernel which opcodes it has and mark the syscalls they cover. */
+static int32_t probe_uring_ops(struct uring_batch *batch)
+{
+    uint32_t i;
+    struct io_uring_probe *probe = NULL;
+    size_t probe_size = sizeof(struct io_uring_probe) + (256 * sizeof(struct io_uring_probe_op));
+
+    probe = allocator->alloc(probe_size);
+    if(probe == NULL)
+    {
+        output->write(ERROR, "Failed to allocate io_uring probe\n");
+        return (-1);
+    }
+
+    memset(probe, 0, probe_size);
+
+    if(syscall(__NR_io_uring_register, batch->fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+    {
+        output->write(ERROR, "Can't probe io_uring opcodes: %s\n", strerror(errno));
+        allocator->free((void **)&probe);
+        return (-1);
+    }
+
+    /* Every call is bounded by a linked timeout, without them a blocked call hangs the batch. */
+    if(IORING_OP_LINK_TIMEOUT >= probe->ops_len ||
+       (probe->ops[IORING_OP_LINK_TIMEOUT].flags & IO_URING_OP_SUPPORTED) == 0)
+    {
+        output->write(ERROR, "io_uring has no linked timeouts\n");
+        allocator->free((void **)&probe);
+        return (-1);
+    }
+
+    struct syscall_table *table = get_table();
+    uint64_t args[NX_ARG_SLOTS] = {0};
+
+    for(i = 0; i < table->total_syscalls; i++)
+    {
+        struct io_uring_sqe sqe;
+
+        memset(&sqe, 0, sizeof(struct io_uring_sqe));
+
+        if(fill_sqe(&sqe, table->hot[i].number, args) < 0)
+            continue;
+
+        if(sqe.opcode < probe->ops_len && (probe->ops[sqe.opcode].flags & IO_URING_OP_SUPPORTED) != 0)
+            batch->supported[i] = 1;
+    }
+
+    allocator->free((void **)&probe);
+
+    return (0);
+}
+
+static int32_t map_rings(struct uring_batch *batch, struct io_uring_params *params)
+{
+    batch->sq_ring_size = params->sq_off.array + (params->sq_entries * sizeof(uint32_t));
+    batch->cq_ring_size = params->cq_off.cqes + (params->cq_entries * sizeof(struct io_uring_cqe));
+    batch->sqes_size = params->sq_entries * sizeof(struct io_uring_sqe);
+
+    /* Newer kernels map both rings with one mmap. */
+    if((params->features & IORING_FEAT_SINGLE_MMAP) != 0)
+    {
+        if(batch->cq_ring_size > batch->sq_ring_size)
+            batch->sq_ring_size = batch->cq_ring_size;
+
+        batch->cq_ring_size = batch->sq_ring_size;
+    }
+
+    batch->sq_ring = mmap(NULL, batch->sq_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, batch->fd, IORING_OFF_SQ_RING);
+    if(batch->sq_ring == MAP_FAILED)
+    {
+        output->write(ERROR, "Can't map submission ring: %s\n", strerror(errno));
+        batch->sq_ring = NULL;
+        return (-1);
+    }
+
+    if((params->features & IORING_FEAT_SINGLE_MMAP) != 0)
+    {
+        batch->cq_ring = batch->sq_ring;
+    }
+    else
+    {
+        batch->cq_ring = mmap(NULL, batch->cq_ring_size, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, batch->fd, IORING_OFF_CQ_RING);
+        if(batch->cq_ring == MAP_FAILED)
+        {
+            output->write(ERROR, "Can't map completion ring: %s\n", strerror(errno));
+            batch->cq_ring = NULL;
+            return (-1);
+        }
+    }
+
+    batch->sqes = mmap(NULL, batch->sqes_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, batch->fd, IORING_OFF_SQES);
+    if(batch->sqes == MAP_FAILED)
+    {
+        output->write(ERROR, "Can't map submission entries: %s\n", strerror(errno));
+        batch->sqes = NULL;
+        return (-1);
+    }
+
+    char *sq = (char *)batch->sq_ring;
+    char *cq = (char *)batch->cq_ring;
+
+    batch->sq_head_ptr = (uint32_t *)(void *)(sq + params->sq_off.head);
+    batch->sq_tail_ptr = (uint32_t *)(void *)(sq + params->sq_off.tail);
+    batch->sq_mask_ptr = (uint32_t *)(void *)(sq + params->sq_off.ring_mask);
+    batch->sq_array = (uint32_t *)(void *)(sq + params->sq_off.array);
+    batch->cq_head_ptr = (uint32_t *)(void *)(cq + params->cq_off.head);
+    batch->cq_tail_ptr = (uint32_t *)(void *)(cq + params->cq_off.tail);
+    batch->cq_mask_ptr = (uint32_t *)(void *)(cq + params->cq_off.ring_mask);
+    batch->cqes = (struct io_uring_cqe *)(void *)(cq + params->cq_off.cqes);
+
+    batch->sq_tail = atomic_load_uint32(batch->sq_tail_ptr);
+
+    return (0);
+}
+
+struct uring_batch *create_uring_batch(void)
+{
+    struct uring_batch *batch = NULL;
+
+    batch = allocator->alloc(sizeof(struct uring_batch));
+    if(batch == NULL)
+    {
+        output->write(ERROR, "Failed to allocate io_uring batch\n");
+        return (NULL);
+    }
+
+    memset(batch, 0, sizeof(struct uring_batch));
+
+    struct io_uring_params params;
+
+    memset(&params, 0, sizeof(struct io_uring_params));
+
+    batch->fd = (int32_t)syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if(batch->fd < 0)
+    {
+        output->write(ERROR, "Can't setup io_uring: %s\n", strerror(errno));
+        allocator->free((void **)&batch);
+        return (NULL);
+    }
+
+    if(map_rings(batch, &params) < 0 || probe_uring_ops(batch) < 0)
+    {
+        destroy_uring_batch(&batch);
+        return (NULL);
+    }
+
+    uint32_t i;
+
+    for(i = 0; i < NX_URING_BATCH; i++)
+    {
+        batch->calls[i] = alloc_test_case();
+        if(batch->calls[i] == NULL)
+        {
+            output->write(ERROR, "Failed to allocate io_uring call\n");
+            destroy_uring_batch(&batch);
+            return (NULL);
+        }
+    }
+
+    batch->timeout.tv_sec = URING_TIMEOUT_MS / 1000;
+    batch->timeout.tv_nsec = (URING_TIMEOUT_MS % 1000) * 1000000;
+
+    return (batch);
+}
+
+void destroy_uring_batch(struct uring_batch **batch)
+{
+    uint32_t i;
+
+    for(i = 0; i < NX_URING_BATCH; i++)
+    {
+        if((*batch)->calls[i] != NULL)
+            free_test_case(&(*batch)->calls[i]);
+    }
+
+    if((*batch)->sqes != NULL)
+        (void)munmap((*batch)->sqes, (*batch)->sqes_size);
+
+    if((*batch)->cq_ring != NULL && (*batch)->cq_ring != (*batch)->sq_ring)
+        (void)munmap((*batch)->cq_ring, (*batch)->cq_ring_size);
+
+    if((*batch)->sq_ring != NULL)
+        (void)munmap((*batch)->sq_ring, (*batch)->sq_ring_size);
+
+    (void)close((*batch)->fd);
+
+    allocator->free((void **)batch);
+}
+
+int32_t has_uring_op(struct uring_batch *batch, uint32_t index)
+{
+    if(index >= NX_MAX_SYSCALLS || batch->supported[index] == 0)
+        return (NX_NO);
+
+    return (NX_YES);
+}
+
+/* Take the next free SQE, the ring always has room since a batch never
+   queues more than URING_ENTRIES entries between submissions. */
+static struct io_uring_sqe *get_sqe(struct uring_batch *batch)
+{
+    uint32_t slot = batch->sq_tail & (*batch->sq_mask_ptr);
+    struct io_uring_sqe *sqe = &batch->sqes[slot];
+
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+    batch->sq_array[slot] = slot;
+    batch->sq_tail++;
+
+    return (sqe);
+}
+
+/* Publish the new SQEs and enter the kernel, retrying if a signal interrupts the wait. */
+static int32_t enter_ring(struct uring_batch *batch, uint32_t to_submit, uint32_t min_complete)
+{
+    ck_pr_fence_store();
+    atomic_store_uint32(batch->sq_tail_ptr, batch->sq_tail);
+
+    for(;;)
+    {
+        long ret = syscall(__NR_io_uring_enter, batch->fd, to_submit, min_complete,
+                           IORING_ENTER_GETEVENTS, NULL, 0);
+        if(ret >= 0)
+            return (0);
+
+        if(errno != EINTR)
+        {
+            output->write(ERROR, "io_uring_enter: %s\n", strerror(errno));
+            return (-1);
+        }
+
+        /* Whatever was submitted before the signal is in the kernel now. */
+        to_submit = 0;
+    }
+}
+
+/* Hand every completion waiting in the ring to it's test case, and mark
+   the calls whose linked timeout fired instead of being cancelled itself. */
+static void reap_completions(struct uring_batch *batch, uint32_t *completed)
+{
+    uint32_t head = atomic_load_uint32(batch->cq_head_ptr);
+    uint32_t tail = atomic_load_uint32(batch->cq_tail_ptr);
+
+    ck_pr_fence_load();
+
+    while(head != tail)
+    {
+        struct io_uring_cqe *cqe = &batch->cqes[head & (*batch->cq_mask_ptr)];
+
+        if(cqe->user_data < batch->total_queued)
+        {
+            (void)set_test_return(batch->queued[cqe->user_data], cqe->res);
+            (*completed)++;
+        }
+        else if(cqe->user_data < URING_TIMEOUT_DATA(batch->total_queued))
+        {
+            /* A timeout whose call finished first comes back as -ECANCELED. */
+            if(cqe->res != -ECANCELED)
+                batch->cancelled[cqe->user_data - NX_URING_BATCH] = 1;
+
+            (*completed)++;
+        }
+
+        head++;
+    }
+
+    ck_pr_fence_store();
+    atomic_store_uint32(batch->cq_head_ptr, head);
+
+    return;
+}
+
+int32_t generate_uring_batch(struct uring_batch *batch)
+{
+    uint32_t i;
+    uint32_t tries;
+    uint32_t index = 0;
+    struct syscall_table *table = get_table();
+
+    for(i = 0; i < NX_URING_BATCH; i++)
+    {
+        for(tries = 0; tries < URING_PICK_TRIES; tries++)
+        {
+            if(pick_syscall_index(table, &index) < 0)
+                return (-1);
+
+            if(batch->supported[index] == 1)
+                break;
+        }
+
+        /* Selection is weighted away from these, stop with what we have. */
+        if(tries == URING_PICK_TRIES)
+            break;
+
+        if(init_test_case_at(batch->calls[i], index) < 0)
+        {
+            output->write(ERROR, "Failed to create io_uring call\n");
+            cleanup_uring_batch(batch);
+            return (-1);
+        }
+
+        batch->total_generated++;
+
+        (void)queue_uring_test(batch, batch->calls[i]);
+    }
+
+    if(batch->total_queued == 0)
+        return (-1);
+
+    return (0);
+}
+
+int32_t queue_uring_test(struct uring_batch *batch, struct test_case *test)
+{
+    if(batch->total_queued == NX_URING_BATCH)
+        return (-1);
+
+    if(has_uring_op(batch, get_syscall_index(test)) != NX_YES)
+        return (-1);
+
+    batch->queued[batch->total_queued] = test;
+    batch->total_queued++;
+
+    return (0);
+}
+
+int32_t run_uring_batch(struct uring_batch *batch)
+{
+    uint32_t i;
+    uint32_t completed = 0;
+    uint32_t timeouts = 0;
+    uint32_t total = batch->total_queued;
+    struct syscall_table *table = get_table();
+
+    if(total == 0)
+        return (0);
+
+    memset(batch->cancelled, 0, sizeof(batch->cancelled));
+
+    /* Link a timeout behind every call, the kernel cancels the call when it
+       fires. A call the kernel can't cancel keeps the child here until the
+       watchdog kills it. */
+    for(i = 0; i < total; i++)
+    {
+        struct io_uring_sqe *sqe = get_sqe(batch);
+        uint32_t index = get_syscall_index(batch->queued[i]);
+
+        (void)fill_sqe(sqe, table->hot[index].number, get_argument_array(batch->queued[i]));
+        sqe->flags |= IOSQE_IO_LINK;
+        sqe->user_data = i;
+
+        sqe = get_sqe(batch);
+        sqe->opcode = IORING_OP_LINK_TIMEOUT;
+        sqe->fd = -1;
+        sqe->addr = (uint64_t)(uintptr_t)&batch->timeout;
+        sqe->len = 1;
+        sqe->user_data = URING_TIMEOUT_DATA(i);
+    }
+
+    uint64_t start = get_time_ns();
+
+    if(enter_ring(batch, total * 2, 1) < 0)
+        return (-1);
+
+    /* Each call and each timeout completes once, wait for all of them so
+       nothing of this batch lands in the next one's completions. */
+    for(;;)
+    {
+        reap_completions(batch, &completed);
+
+        if(completed == total * 2)
+            break;
+
+        if(enter_ring(batch, 0, 1) < 0)
+            return (-1);
+    }
+
+    /* The calls ran side by side, so each is charged an equal share of the batch. */
+    uint64_t elapsed = (get_time_ns() - start) / total;
+
+    for(i = 0; i < total; i++)
+    {
+        struct test_case *test = batch->queued[i];
+
+        /* A call can still finish on it's own before the cancel reaches it. */
+        if(batch->cancelled[i] == 1 && (get_error(test) == ECANCELED || get_error(test) == EINTR))
+        {
+            record_syscall_timeout(get_syscall_index(test));
+            timeouts++;
+            continue;
+        }
+
+        batch->done[i] = 1;
+        record_test_result(test, elapsed, 0);
+    }
+
+    return ((int32_t)(total - timeouts));
+}
+
+void cleanup_uring_batch(struct uring_batch *batch)
+{
+    uint32_t i;
+
+    /* Close the descriptors that opens, accepts and sockets returned. */
+    for(i = 0; i < batch->total_queued; i++)
+    {
+        if(batch->done[i] == 1)
+            release_test_result(batch->queued[i]);
+    }
+
+    memset(batch->done, 0, sizeof(batch->done));
+
+    for(i = 0; i < batch->total_generated; i++)
+        cleanup_test(batch->calls[i]);
+
+    batch->total_generated = 0;
+    batch->total_queued = 0;
+}
+
+struct test_case *get_uring_test(struct uring_batch *batch, uint32_t i)
+{
+    if(i >= batch->total_queued)
+        return (NULL);
+
+    return (batch->queued[i]);
+}
+
+void inject_uring_deps(struct dependency_context *ctx)
+{
+    uint32_t i;
+
+    for(i = 0; i < ctx->count; i++)
+    {
+        switch((int32_t)ctx->array[i]->name)
+        {
+            case ALLOCATOR:
+                allocator = (struct memory_allocator *)ctx->array[i]->interface;
+                break;
+
+            case OUTPUT:
+                output = (struct output_writter *)ctx->array[i]->interface;
+                break;
+        }
+    }
+
+    return;
+}
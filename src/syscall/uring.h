@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2015, Harrison Bowden, Minneapolis, MN
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ **/
+
+/**
+*     @file uring.h
+*     @brief Batches test cases into io_uring submissions. Syscalls io_uring
+*     has an opcode for are packed one per SQE and a whole batch goes to the
+*     kernel with a single io_uring_enter(), which skips the per test trap
+*     and runs the calls through io_uring's own async paths. Linux only.
+*/
+
+#ifndef NX_URING_H
+#define NX_URING_H
+
+#include "syscall.h"
+#include "depend-inject/depend-inject.h"
+
+#include <stdint.h>
+
+/* The most test cases submitted in one batch. */
+#define NX_URING_BATCH 64
+
+struct uring_batch;
+
+/**
+ * Set up an io_uring instance and allocate the test cases of a batch.
+ * @return A batch on success and NULL when io_uring can't be used.
+ */
+extern struct uring_batch *create_uring_batch(void);
+
+/**
+ * Tear down the ring and free the batch.
+ * @param batch The batch to destroy, set to NULL on return.
+ */
+extern void destroy_uring_batch(struct uring_batch **batch);
+
+/**
+ * @param batch A batch from create_uring_batch().
+ * @param index The syscall table index to check.
+ * @return NX_YES when the running kernel can issue the syscall through io_uring.
+ */
+extern int32_t has_uring_op(struct uring_batch *batch, uint32_t index);
+
+/**
+ * Fill the batch with test cases for syscalls that have an io_uring opcode.
+ * @param batch An empty or cleaned up batch.
+ * @return Zero on success and -1 when no test case could be generated.
+ */
+extern int32_t generate_uring_batch(struct uring_batch *batch);
+
+/**
+ * Add a test case to the next submission of a batch.
+ * @param batch The batch to add the test case to.
+ * @param test A test case for a syscall with an io_uring opcode.
+ * @return Zero on success and -1 when the batch is full or the syscall isn't supported.
+ */
+extern int32_t queue_uring_test(struct uring_batch *batch, struct test_case *test);
+
+/**
+ * Submit every queued test case with one io_uring_enter(), wait for the
+ * completions and record them like directly executed tests. Every call
+ * has a linked timeout, calls still running when it fires are cancelled
+ * and recorded as timeouts.
+ * @param batch A batch with queued test cases.
+ * @return The number of test cases that completed, or -1 on failure.
+ */
+extern int32_t run_uring_batch(struct uring_batch *batch);
+
+/**
+ * Close the descriptors the completed calls returned, free the arguments
+ * of the generated test cases and empty the queue.
+ * @param batch The batch to clean up.
+ */
+extern void cleanup_uring_batch(struct uring_batch *batch);
+
+/**
+ * @param batch A batch with queued test cases.
+ * @param i Position of the test case in the queue.
+ * @return The test case queued at i, NULL when fewer are queued.
+ */
+extern struct test_case *get_uring_test(struct uring_batch *batch, uint32_t i);
+
+extern void inject_uring_deps(struct dependency_context *ctx);
+
+#endif
@@ -0,0 +1,325 @@
+/*
+ * Copyright (c) 2015, Harrison Bowden, Minneapolis, MN
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ **/
+
+#include "weight.h"
+#include "crypto/random.h"
+#include "concurrent/concurrent.h"
+#include "io/io.h"
+#include "memory/memory.h"
+
+#include <unistd.h>
+#include <string.h>
+
+static struct output_writter *output;
+static struct memory_allocator *allocator;
+static struct random_generator *random_gen;
+
+/* Every active syscall keeps at least this much weight so a syscall that
+   always fails is still tried now and then, arguments change after all. */
+static const double WEIGHT_FLOOR = 0.05;
+
+/* How much more a test that found new coverage counts than a successful one. */
+static const double COVERAGE_WEIGHT = 16.0;
+
+/* Tests slower than this have their weight divided by their latency in these units. */
+static const double LATENCY_UNIT_NS = 1000000.0;
+
+/* Weight of a syscall whose calls all fail argument checks, well under WEIGHT_FLOOR. */
+static const double WASTED_WEIGHT = 0.005;
+
+/* Supervisor side state, the children never read these. score is a
+   moving average of each syscall's weight and last is the feedback
+   counters as of the last rebuild. */
+static double score[NX_MAX_SYSCALLS];
+static struct syscall_feedback last[NX_MAX_SYSCALLS];
+static uint8_t wasted[NX_MAX_SYSCALLS];
+
+/* Vose's method, O(n) to build and O(1) to sample. */
+static void build_alias_table(struct alias_table *alias_tbl, const double *weights,
+                              const uint16_t *index, uint32_t count)
+{
+    uint32_t i;
+    uint32_t total_small = 0;
+    uint32_t total_large = 0;
+    uint16_t small[NX_MAX_SYSCALLS];
+    uint16_t large[NX_MAX_SYSCALLS];
+    double scaled[NX_MAX_SYSCALLS];
+    double total = 0.0;
+
+    for(i = 0; i < count; i++)
+        total += weights[i];
+
+    for(i = 0; i < count; i++)
+    {
+        scaled[i] = (weights[i] * (double)count) / total;
+        alias_tbl->index[i] = index[i];
+
+        if(scaled[i] < 1.0)
+            small[total_small++] = (uint16_t)i;
+        else
+            large[total_large++] = (uint16_t)i;
+    }
+
+    while(total_small > 0 && total_large > 0)
+    {
+        uint16_t less = small[--total_small];
+        uint16_t more = large[--total_large];
+
+        alias_tbl->prob[less] = (uint32_t)(scaled[less] * (double)ALIAS_ONE);
+        alias_tbl->alias[less] = more;
+
+        /* The large column gives away what the small one was missing. */
+        scaled[more] = (scaled[more] + scaled[less]) - 1.0;
+
+        if(scaled[more] < 1.0)
+            small[total_small++] = more;
+        else
+            large[total_large++] = more;
+    }
+
+    /* Whatever is left is full, give or take rounding errors. */
+    while(total_large > 0)
+    {
+        uint16_t column = large[--total_large];
+        alias_tbl->prob[column] = ALIAS_ONE;
+        alias_tbl->alias[column] = column;
+    }
+
+    while(total_small > 0)
+    {
+        uint16_t column = small[--total_small];
+        alias_tbl->prob[column] = ALIAS_ONE;
+        alias_tbl->alias[column] = column;
+    }
+
+    alias_tbl->count = count;
+
+    return;
+}
+
+/* Weight of a syscall over one feedback window. */
+static double window_weight(struct syscall_feedback *window)
+{
+    double execs = (double)window->execs;
+    double success_rate = ((double)window->successes + 1.0) / (execs + 2.0);
+    double coverage_rate = (double)window->new_coverage / execs;
+    double latency = ((double)window->total_ns / execs) / LATENCY_UNIT_NS;
+
+    return ((WEIGHT_FLOOR + success_rate + (COVERAGE_WEIGHT * coverage_rate)) / (1.0 + latency));
+}
+
+/* Build the alias table that isn't live from the current scores and make it live. */
+static void publish_alias_table(struct syscall_selector *selector, struct syscall_table *table)
+{
+    uint32_t i;
+    double weights[NX_MAX_SYSCALLS];
+    uint16_t index[NX_MAX_SYSCALLS];
+    uint32_t generation = atomic_load_uint32(&selector->generation);
+
+    for(i = 0; i < table->total_active; i++)
+    {
+        index[i] = table->active[i];
+        weights[i] = score[index[i]];
+    }
+
+    build_alias_table(&selector->tables[(generation + 1) & 1], weights, index, table->total_active);
+
+    /* The new table must be visible before the generation that points to it. */
+    ck_pr_fence_store();
+    atomic_store_uint32(&selector->generation, generation + 1);
+
+    return;
+}
+
+struct syscall_selector *create_syscall_selector(struct syscall_table *table)
+{
+    if(table->total_active == 0)
+    {
+        output->write(ERROR, "No active syscalls to select from\n");
+        return (NULL);
+    }
+
+    struct syscall_selector *selector = NULL;
+
+    selector = allocator->shared(sizeof(struct syscall_selector));
+    if(selector == NULL)
+    {
+        output->write(ERROR, "Failed to allocate syscall selector\n");
+        return (NULL);
+    }
+
+    memset(selector, 0, sizeof(struct syscall_selector));
+    memset(last, 0, sizeof(last));
+    memset(wasted, 0, sizeof(wasted));
+
+    uint32_t i;
+    uid_t uid = geteuid();
+
+    for(i = 0; i < table->total_syscalls; i++)
+    {
+        /* Root only syscalls would just fail with EPERM. */
+        if(uid != 0 && (table->hot[i].flags & SYSCALL_ROOT) != 0)
+            score[i] = WEIGHT_FLOOR;
+        else
+            score[i] = 1.0;
+    }
+
+    publish_alias_table(selector, table);
+
+    return (selector);
+}
+
+int32_t select_weighted(struct syscall_selector *selector, uint32_t *index)
+{
+    int32_t rtrn = 0;
+    uint32_t generation = 0;
+    uint32_t column = 0;
+    uint32_t coin = 0;
+    struct alias_table *alias_tbl = NULL;
+
+    /* The supervisor only rewrites the table that isn't live, so a pick
+       that raced a rebuild is simply retried with the new generation. */
+    do
+    {
+        generation = atomic_load_uint32(&selector->generation);
+        ck_pr_fence_load();
+
+        alias_tbl = &selector->tables[generation & 1];
+
+        rtrn = random_gen->range(alias_tbl->count, &column);
+        if(rtrn < 0)
+        {
+            output->write(ERROR, "Failed to pick alias column\n");
+            return (-1);
+        }
+
+        rtrn = random_gen->range(ALIAS_ONE, &coin);
+        if(rtrn < 0)
+        {
+            output->write(ERROR, "Failed to flip alias coin\n");
+            return (-1);
+        }
+
+        if(coin < alias_tbl->prob[column])
+            (*index) = alias_tbl->index[column];
+        else
+            (*index) = alias_tbl->index[alias_tbl->alias[column]];
+
+        ck_pr_fence_load();
+
+    } while(atomic_load_uint32(&selector->generation) != generation);
+
+    return (0);
+}
+
+void record_feedback(struct syscall_selector *selector, uint32_t index,
+                     uint32_t success, uint32_t new_coverage, uint64_t elapsed_ns)
+{
+    struct syscall_feedback *feedback = &selector->feedback[index];
+
+    atomic_add_uint64(&feedback->execs, 1);
+    atomic_add_uint64(&feedback->total_ns, elapsed_ns);
+
+    if(success == 1)
+        atomic_add_uint64(&feedback->successes, 1);
+
+    if(new_coverage == 1)
+        atomic_add_uint64(&feedback->new_coverage, 1);
+
+    return;
+}
+
+int32_t rebuild_selector(struct syscall_selector *selector, struct syscall_table *table)
+{
+    if(table->total_active == 0)
+    {
+        output->write(ERROR, "No active syscalls to select from\n");
+        return (-1);
+    }
+
+    uint32_t i;
+
+    for(i = 0; i < table->total_active; i++)
+    {
+        uint16_t index = table->active[i];
+        struct syscall_feedback *feedback = &selector->feedback[index];
+        struct syscall_feedback now;
+        struct syscall_feedback window;
+
+        now.execs = atomic_load_uint64(&feedback->execs);
+        now.successes = atomic_load_uint64(&feedback->successes);
+        now.new_coverage = atomic_load_uint64(&feedback->new_coverage);
+        now.total_ns = atomic_load_uint64(&feedback->total_ns);
+
+        window.execs = now.execs - last[index].execs;
+        window.successes = now.successes - last[index].successes;
+        window.new_coverage = now.new_coverage - last[index].new_coverage;
+        window.total_ns = now.total_ns - last[index].total_ns;
+
+        last[index] = now;
+
+        if(wasted[index] == 1)
+        {
+            score[index] = WASTED_WEIGHT;
+            continue;
+        }
+
+        /* Keep the old score for syscalls that weren't picked this window. */
+        if(window.execs == 0)
+            continue;
+
+        score[index] = (score[index] + window_weight(&window)) / 2.0;
+    }
+
+    publish_alias_table(selector, table);
+
+    return (0);
+}
+
+void set_syscall_wasted(uint32_t index, uint32_t is_wasted)
+{
+    /* A syscall that stops being wasted starts over from the floor. */
+    if(wasted[index] == 1 && is_wasted == 0)
+        score[index] = WEIGHT_FLOOR;
+
+    wasted[index] = (is_wasted != 0);
+
+    return;
+}
+
+void inject_weight_deps(struct dependency_context *ctx)
+{
+    uint32_t i;
+
+    for(i = 0; i < ctx->count; i++)
+    {
+        switch((int32_t)ctx->array[i]->name)
+        {
+            case ALLOCATOR:
+                allocator = (struct memory_allocator *)ctx->array[i]->interface;
+                break;
+
+            case OUTPUT:
+                output = (struct output_writter *)ctx->array[i]->interface;
+                break;
+
+            case RANDOM_GEN:
+                random_gen = (struct random_generator *)ctx->array[i]->interface;
+                break;
+        }
+    }
+
+    return;
+}
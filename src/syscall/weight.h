@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2015, Harrison Bowden, Minneapolis, MN
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ **/
+
+#ifndef NX_WEIGHT_H
+#define NX_WEIGHT_H
+
+#include "syscall_table.h"
+#include "depend-inject/depend-inject.h"
+
+#include <stdint.h>
+
+/* Alias table probabilities are fixed point fractions of ALIAS_ONE. */
+#define ALIAS_ONE (UINT32_C(1) << 24)
+
+/* A Walker alias table over the active syscalls. Column i is kept with
+   probability prob[i] / ALIAS_ONE, otherwise it's alias is used. Both
+   resolve to a syscall table index through index[]. */
+struct alias_table
+{
+    uint32_t count;
+    uint32_t prob[NX_MAX_SYSCALLS];
+    uint16_t alias[NX_MAX_SYSCALLS];
+    uint16_t index[NX_MAX_SYSCALLS];
+};
+
+/* Counters the children bump after every test, indexed like the syscall table. */
+struct syscall_feedback
+{
+    uint64_t execs;
+    uint64_t successes;
+    uint64_t new_coverage;
+    uint64_t total_ns;
+};
+
+/* Lives in shared memory. The supervisor builds the table the children
+   aren't using and then bumps generation, generation & 1 is the live table. */
+struct syscall_selector
+{
+    uint32_t generation;
+    const char padding[4];
+    struct alias_table tables[2];
+    struct syscall_feedback feedback[NX_MAX_SYSCALLS];
+};
+
+/**
+ * Create a selector in shared memory and build it's first alias table.
+ * Until there is feedback every active syscall has the same weight, except
+ * root only syscalls when we are not root.
+ * @param table The syscall table to select from.
+ * @return A selector on success and NULL on failure.
+ */
+extern struct syscall_selector *create_syscall_selector(struct syscall_table *table);
+
+/**
+ * Pick a syscall table index in O(1) from the live alias table.
+ * @param selector The selector to pick with.
+ * @param index Where the picked index is stored.
+ * @return Zero on success and -1 on failure.
+ */
+extern int32_t select_weighted(struct syscall_selector *selector, uint32_t *index);
+
+/**
+ * Record the result of a test for the next rebuild.
+ * @param selector The selector to record to.
+ * @param index The syscall table index of the test's syscall.
+ * @param success One when the syscall didn't return an error.
+ * @param new_coverage One when the test found new coverage.
+ * @param elapsed_ns How long the syscall took.
+ */
+extern void record_feedback(struct syscall_selector *selector, uint32_t index,
+                            uint32_t success, uint32_t new_coverage, uint64_t elapsed_ns);
+
+/**
+ * Recompute the weights from the feedback gathered since the last rebuild
+ * and swap in a new alias table. Only the supervisor should call this.
+ * @param selector The selector to rebuild.
+ * @param table The syscall table the selector was created with.
+ * @return Zero on success and -1 on failure.
+ */
+extern int32_t rebuild_selector(struct syscall_selector *selector, struct syscall_table *table);
+
+/**
+ * Mark a syscall as wasting cycles, rebuilds then give it almost no weight
+ * until it's unmarked. Only the supervisor should call this.
+ * @param index The syscall table index of the syscall.
+ * @param is_wasted One to mark the syscall and zero to unmark it.
+ */
+extern void set_syscall_wasted(uint32_t index, uint32_t is_wasted);
+
+extern void inject_weight_deps(struct dependency_context *ctx);
+
+#endif
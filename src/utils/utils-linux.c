@@ -15,18 +15,18 @@
 
 #include "utils.h"
 
-int32_t syscall(int32_t number, ...)
-{
-    (void)number;
-    __asm__ ( "movl $10, %eax;"
-              "movl $20, %ebx;"
-              "addl %ebx, %eax;"
-    );
-    return (0);
-}
+#include <unistd.h>
 
 int32_t get_core_count(uint32_t *core_count)
 {
     (*core_count) = (uint32_t) sysconf(_SC_NPROCESSORS_ONLN);
     return (0);
 }
+
+void inject_utils_os_deps(struct dependency_context *ctx)
+{
+    /* Nothing in the Linux utilities takes a dependency. */
+    (void)ctx;
+
+    return;
+}
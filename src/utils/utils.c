@@ -46,6 +46,7 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <time.h>
 
 static struct memory_allocator *allocator;
 static struct output_writter *output;
@@ -188,6 +189,15 @@ int32_t copy_file_to(char *src, char *dst)
     return (0);
 }
 
+uint64_t get_time_ns(void)
+{
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (((uint64_t)ts.tv_sec * 1000000000) + (uint64_t)ts.tv_nsec);
+}
+
 int32_t check_root(void)
 {
     output->write(STD, "Making sure nextgen has root privileges\n");
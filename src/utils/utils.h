@@ -78,6 +78,9 @@ extern int32_t get_extension(char *path, char **extension);
 /* Get the core count of the system we are on. This will include virtual cores on hyperthreaded systems. */
 extern int32_t get_core_count(uint32_t *core_count);
 
+/* Returns a monotonic timestamp in nanoseconds, for measuring intervals. */
+extern uint64_t get_time_ns(void);
+
 /* Grabs the path to the user's home directory. */
 extern int32_t get_home(char **home);
 
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2015, Harrison Bowden, Minneapolis, MN
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+ * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "unity.h"
+#include "io/io.h"
+#include "memory/memory.h"
+#include "coverage/coverage.h"
+
+#include <unistd.h>
+
+static void test_merge_coverage(void)
+{
+    struct coverage_map *map = NULL;
+
+    map = create_coverage_map();
+    TEST_ASSERT_NOT_NULL(map);
+    TEST_ASSERT(get_total_edges(map) == 0);
+
+    uint64_t first[] = {0xffffffff81000010, 0xffffffff81000020, 0xffffffff81000030};
+    uint64_t second[] = {0xffffffff81000010, 0xffffffff81000020, 0xffffffff81000040};
+
+    TEST_ASSERT(merge_coverage(map, first, 3) == 3);
+    TEST_ASSERT(get_total_edges(map) == 3);
+
+    /* The same trace again finds nothing new. */
+    TEST_ASSERT(merge_coverage(map, first, 3) == 0);
+
+    /* Only the last edge differs. */
+    TEST_ASSERT(merge_coverage(map, second, 3) == 1);
+    TEST_ASSERT(get_total_edges(map) == 4);
+
+    TEST_ASSERT(merge_coverage(map, first, 0) == 0);
+}
+
+static void test_mock_backend(void)
+{
+    struct coverage_backend *mock = NULL;
+
+    mock = get_mock_backend();
+    TEST_ASSERT_NOT_NULL(mock);
+    TEST_ASSERT(mock->available() == NX_YES);
+    TEST_ASSERT(mock->open() == 0);
+
+    uint64_t trace[] = {1, 2, 3, 4};
+    const uint64_t *pcs = NULL;
+
+    set_mock_coverage(trace, 4);
+
+    /* Every test gets the same trace, so runs are repeatable. */
+    mock->start();
+    TEST_ASSERT(mock->stop(&pcs) == 4);
+    TEST_ASSERT(pcs[3] == 4);
+
+    mock->start();
+    TEST_ASSERT(mock->stop(&pcs) == 4);
+    TEST_ASSERT(pcs[0] == 1);
+
+    mock->close();
+}
+
+static void test_kcov_backend(void)
+{
+    struct coverage_backend *kcov = NULL;
+
+    kcov = get_kcov_backend();
+    TEST_ASSERT_NOT_NULL(kcov);
+
+    /* Most kernels aren't built with KCOV, there's nothing more to check then. */
+    if(kcov->available() != NX_YES)
+        return;
+
+    TEST_ASSERT(kcov->open() == 0);
+
+    const uint64_t *pcs = NULL;
+
+    kcov->start();
+    (void)getppid();
+    TEST_ASSERT(kcov->stop(&pcs) > 0);
+    TEST_ASSERT_NOT_NULL(pcs);
+
+    kcov->close();
+}
+
+static void setup_tests(void)
+{
+    struct dependency_context *ctx = NULL;
+    struct output_writter *output = NULL;
+
+    output = get_console_writter();
+    TEST_ASSERT_NOT_NULL(output);
+
+    struct memory_allocator *allocator = NULL;
+
+    allocator = get_default_allocator();
+    TEST_ASSERT_NOT_NULL(allocator);
+
+    ctx = create_dependency_ctx(create_dependency(output, OUTPUT),
+                                create_dependency(allocator, ALLOCATOR),
+                                NULL);
+    TEST_ASSERT_NOT_NULL(ctx);
+
+    inject_coverage_deps(ctx);
+}
+
+int main(void)
+{
+    setup_tests();
+    test_merge_coverage();
+    test_mock_backend();
+    test_kcov_backend();
+
+    return (0);
+}
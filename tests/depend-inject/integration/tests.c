@@ -67,6 +67,7 @@ static void test_create_dependency_array(void)
 
     void (*write)(enum out_type type, const char *format, ...);
     write = (void (*)(enum out_type type, const char *format, ...)) ctx->array[0]->interface;
+    TEST_ASSERT_NOT_NULL(write);
 
     return;
 }
@@ -17,6 +17,8 @@
 #include "memory/memory.c"
 #include "concurrent/concurrent.h"
 #include <pthread.h>
+#include <signal.h>
+#include <sys/wait.h>
 
 static uint32_t count = 1024;
 static uint32_t iterations = 100000;
@@ -161,10 +163,231 @@ static void test_shared_pool(void)
 	return;
 }
 
+static void test_shared_pool_keys(void)
+{
+    struct shared_pool *pool = NULL;
+
+    struct memory_allocator *allocator = NULL;
+    allocator = get_default_allocator();
+    TEST_ASSERT_NOT_NULL(allocator);
+
+    pool = allocator->shared_pool(4, sizeof(uint32_t));
+    TEST_ASSERT_NOT_NULL(pool);
+
+    struct memory_block *m_blk = NULL;
+    struct memory_block *taken[4];
+    uint32_t i;
+
+    init_shared_pool(pool, m_blk)
+    {
+        TEST_ASSERT(set_block_key(pool, m_blk, 100 + m_blk->index) == 0);
+    }
+
+    TEST_ASSERT(find_block(pool, 102) == &pool->blocks[2]);
+    TEST_ASSERT_NULL(find_block(pool, 99));
+
+    /* Rekeying moves the block to the new key. */
+    TEST_ASSERT(set_block_key(pool, &pool->blocks[2], 7) == 0);
+    TEST_ASSERT_NULL(find_block(pool, 102));
+    TEST_ASSERT(find_block(pool, 7) == &pool->blocks[2]);
+
+    for(i = 0; i < 4; i++)
+    {
+        taken[i] = allocator->get_block(pool);
+        TEST_ASSERT_NOT_NULL(taken[i]);
+    }
+
+    /* One block per shard, so all but the first were stolen. */
+    TEST_ASSERT(pool->shard_count == 4);
+    TEST_ASSERT(pool->steals == 3);
+
+    /* An empty pool gives up after a bounded wait instead of spinning forever. */
+    TEST_ASSERT_NULL(allocator->get_block(pool));
+    TEST_ASSERT(pool->waits == 1);
+    TEST_ASSERT(pool->exhausted == 1);
+
+    allocator->free_block(find_block(pool, 7), pool);
+    TEST_ASSERT(allocator->get_block(pool) == &pool->blocks[2]);
+}
+
+static void test_reclaim_blocks(void)
+{
+    struct shared_pool *pool = NULL;
+
+    struct memory_allocator *allocator = NULL;
+    allocator = get_default_allocator();
+    TEST_ASSERT_NOT_NULL(allocator);
+
+    pool = allocator->shared_pool(2, sizeof(uint32_t));
+    TEST_ASSERT_NOT_NULL(pool);
+
+    /* A child that dies holding every block. */
+    pid_t pid = fork();
+    if(pid == 0)
+    {
+        set_pool_shard(0);
+
+        if(allocator->get_block(pool) == NULL || allocator->get_block(pool) == NULL)
+            _exit(1);
+
+        _exit(0);
+    }
+    TEST_ASSERT(pid > 0);
+
+    int status = 0;
+    TEST_ASSERT(waitpid(pid, &status, 0) == pid);
+    TEST_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    TEST_ASSERT(pool->blocks[0].owner == pid);
+    TEST_ASSERT(reclaim_blocks(pool, getpid()) == 0);
+    TEST_ASSERT(reclaim_blocks(pool, pid) == 2);
+
+    TEST_ASSERT_NOT_NULL(allocator->get_block(pool));
+    TEST_ASSERT_NOT_NULL(allocator->get_block(pool));
+}
+
+static void test_arena_allocator(void)
+{
+    struct memory_allocator *arena = NULL;
+
+    arena = get_arena_allocator(4096);
+    TEST_ASSERT_NOT_NULL(arena);
+    TEST_ASSERT(arena == get_arena_allocator(4096));
+
+    void *buf = arena->alloc(0);
+    TEST_ASSERT_NULL(buf);
+
+    void *first = arena->alloc(10);
+    TEST_ASSERT_NOT_NULL(first);
+    TEST_ASSERT(((uintptr_t)first % ARENA_ALIGN) == 0);
+
+    void *second = arena->alloc(10);
+    TEST_ASSERT_NOT_NULL(second);
+    TEST_ASSERT((char *)second == (char *)first + ARENA_ALIGN);
+
+    /* Free is a no-op, the memory is only released on reset. */
+    arena->free(&second);
+    TEST_ASSERT_NULL(second);
+
+    TEST_ASSERT_NULL(arena->alloc(4096));
+
+    arena->reset();
+
+    /* After a reset allocation starts over at the beginning of the region. */
+    buf = arena->alloc(4096);
+    TEST_ASSERT(buf == first);
+    TEST_ASSERT_NULL(arena->alloc(1));
+
+    /* A bigger arena can't be mapped under live allocations. */
+    TEST_ASSERT_NULL(get_arena_allocator(8192));
+
+    arena->reset();
+
+    /* Once it's empty a later caller asking for more gets a bigger region. */
+    TEST_ASSERT(arena == get_arena_allocator(8192));
+    TEST_ASSERT_NOT_NULL(arena->alloc(8192));
+    TEST_ASSERT_NULL(arena->alloc(1));
+
+    arena->reset();
+}
+
+static void test_buffer_pool(void)
+{
+    struct buffer_pool *pool = NULL;
+
+    TEST_ASSERT_NULL(create_buffer_pool(0));
+
+    pool = create_buffer_pool(48);
+    TEST_ASSERT_NOT_NULL(pool);
+    TEST_ASSERT(pool->per_class == 16);
+
+    uint64_t page = pool->page_size;
+
+    TEST_ASSERT_NULL(get_pool_buffer(pool, 0, BUFFER_RW));
+    TEST_ASSERT_NULL(get_pool_buffer(pool, 1, BUFFER_PROTS));
+
+    /* Buffers end right where the guard page starts. */
+    char *buf = get_pool_buffer(pool, 100, BUFFER_RW);
+    TEST_ASSERT_NOT_NULL(buf);
+    TEST_ASSERT(((uintptr_t)(buf + 100) % page) == 0);
+    memset(buf, 'a', 100);
+
+    char *ro = get_pool_buffer(pool, 10, BUFFER_RO);
+    TEST_ASSERT_NOT_NULL(ro);
+    TEST_ASSERT(ro[0] == 0);
+
+    /* Writing past the end of a buffer must hit the guard page. */
+    pid_t pid = fork();
+    if(pid == 0)
+    {
+        buf[100] = 'a';
+        _exit(0);
+    }
+    TEST_ASSERT(pid > 0);
+
+    int status = 0;
+    TEST_ASSERT(waitpid(pid, &status, 0) == pid);
+    TEST_ASSERT(WIFSIGNALED(status));
+    TEST_ASSERT(WTERMSIG(status) == SIGSEGV || WTERMSIG(status) == SIGBUS);
+
+    /* Large buffers go to a bigger class. */
+    char *large = get_pool_buffer(pool, page * 2, BUFFER_WO);
+    TEST_ASSERT_NOT_NULL(large);
+    TEST_ASSERT(((uintptr_t)(large + (page * 2)) % page) == 0);
+    TEST_ASSERT_NULL(get_pool_buffer(pool, page * 17, BUFFER_WO));
+
+    uint32_t i;
+    uint32_t count = 0;
+
+    /* Drain the pool, the classes together hold the 48 buffers asked for. */
+    while(get_pool_buffer(pool, 1, BUFFER_RW) != NULL)
+        count++;
+
+    TEST_ASSERT(count == 48 - 1);
+
+    /* Damage a buffer the way a fuzzed munmap() or mprotect() would. */
+    TEST_ASSERT(munmap(buf - (page - 100), page) == 0);
+    TEST_ASSERT(mprotect(ro - (page - 10), page, PROT_NONE) == 0);
+
+    damage_buffer_pool(pool);
+    TEST_ASSERT(reset_buffer_pool(pool) == 0);
+
+    /* The reset mapped them again with their own protection. */
+    TEST_ASSERT(get_pool_buffer(pool, 100, BUFFER_RW) == buf);
+    memset(buf, 'a', 100);
+    TEST_ASSERT(get_pool_buffer(pool, 10, BUFFER_RO) == ro);
+    TEST_ASSERT(ro[0] == 0);
+
+    /* Without damage a reset only rewinds the pool, the pages are kept. */
+    TEST_ASSERT(reset_buffer_pool(pool) == 0);
+    TEST_ASSERT(get_pool_buffer(pool, 100, BUFFER_RW) == buf);
+    TEST_ASSERT(buf[0] == 'a');
+
+    damage_buffer_pool(pool);
+    TEST_ASSERT(reset_buffer_pool(pool) == 0);
+    TEST_ASSERT(get_pool_buffer(pool, 100, BUFFER_RW) == buf);
+    TEST_ASSERT(buf[0] == 0);
+
+    TEST_ASSERT(reset_buffer_pool(pool) == 0);
+
+    /* After a reset the same buffers are handed out again. */
+    for(i = 0; i < iterations; i++)
+    {
+        TEST_ASSERT(get_pool_buffer(pool, 100, BUFFER_RW) == buf);
+        TEST_ASSERT(reset_buffer_pool(pool) == 0);
+    }
+
+    destroy_buffer_pool(pool);
+}
+
 int main()
 {
     test_default_memory_allocator();
+    test_arena_allocator();
+    test_buffer_pool();
     test_shared_pool();
+    test_shared_pool_keys();
+    test_reclaim_blocks();
 
 	return (0);
 }
@@ -79,6 +79,134 @@ static void test_resource_generator(void)
 	  return;
 }
 
+static void test_pid_generator(void)
+{
+    uint32_t i;
+    int32_t pid = 0;
+    struct resource_generator *rsrc_gen = NULL;
+
+    rsrc_gen = get_resource_generator();
+    TEST_ASSERT_NOT_NULL(rsrc_gen);
+
+    for(i = 0; i < 10; i++)
+    {
+        pid = rsrc_gen->get_pid();
+        TEST_ASSERT(pid > 0);
+        TEST_ASSERT(kill(pid, 0) == 0);
+
+        TEST_ASSERT(rsrc_gen->free_pid(&pid) == 0);
+        TEST_ASSERT(kill(pid, 0) == -1);
+    }
+
+    pid_pool = create_pid_pool();
+    TEST_ASSERT_NOT_NULL(pid_pool);
+
+    /* Handing a pid back leaves the process running. */
+    pid = get_pid_cached();
+    TEST_ASSERT(pid > 0);
+    TEST_ASSERT(free_pid_cached(&pid) == 0);
+    TEST_ASSERT(kill(pid, 0) == 0);
+
+    for(i = 0; i < iterations; i++)
+    {
+        int32_t next = get_pid_cached();
+        TEST_ASSERT(next == pid);
+        TEST_ASSERT(free_pid_cached(&next) == 0);
+    }
+
+    /* Taking a pid never forks, a dead process is replaced by whoever reaps it. */
+    TEST_ASSERT(kill(pid, SIGKILL) == 0);
+    TEST_ASSERT(waitpid(pid, NULL, 0) == pid);
+    TEST_ASSERT(replace_sacrificial_process(pid) == 1);
+    TEST_ASSERT(replace_sacrificial_process(pid) == 0);
+    TEST_ASSERT(replace_sacrificial_process(getpid()) == 0);
+
+    int32_t replacement = get_pid_cached();
+    TEST_ASSERT(replacement > 0);
+    TEST_ASSERT(replacement != pid);
+    TEST_ASSERT(kill(replacement, 0) == 0);
+    TEST_ASSERT(free_pid_cached(&replacement) == 0);
+
+    /* A process that dies while handed out is released by the pid it was taken as. */
+    int32_t held = get_pid_cached();
+    TEST_ASSERT(held == replacement);
+    TEST_ASSERT(kill(held, SIGKILL) == 0);
+    TEST_ASSERT(waitpid(held, NULL, 0) == held);
+    TEST_ASSERT(replace_sacrificial_process(held) == 1);
+    TEST_ASSERT(free_pid_cached(&held) == 0);
+
+    int32_t next = get_pid_cached();
+    TEST_ASSERT(next != held);
+    TEST_ASSERT(kill(next, 0) == 0);
+    TEST_ASSERT(free_pid_cached(&next) == 0);
+}
+
+static void test_resource_maintainer(void)
+{
+    size_fd_pools();
+    TEST_ASSERT(fd_pool_size > 0 && fd_pool_size <= POOL_SIZE);
+
+    desc_pool = create_fd_pool("/tmp");
+    TEST_ASSERT_NOT_NULL(desc_pool);
+
+    file_pool = create_file_pool("/tmp");
+    TEST_ASSERT_NOT_NULL(file_pool);
+
+    /* Nothing to repair in fresh pools. */
+    sweep_pool(desc_pool, RSRC_DESC);
+    sweep_pool(file_pool, RSRC_FILE);
+    TEST_ASSERT(get_resource_replacements(RSRC_DESC) == 0);
+    TEST_ASSERT(get_resource_replacements(RSRC_FILE) == 0);
+
+    int32_t fd = get_desc_cached();
+    TEST_ASSERT(fd > 0);
+    TEST_ASSERT(fcntl(fd, F_SETFL, O_NONBLOCK) == 0);
+    TEST_ASSERT(free_desc_cached(&fd) == 0);
+
+    /* Paths are created on first use. */
+    char *file = get_filepath_cached();
+    TEST_ASSERT_NOT_NULL(file);
+    TEST_ASSERT(unlink(file) == 0);
+    TEST_ASSERT(free_filepath_cached(&file) == 0);
+
+    sweep_pool(desc_pool, RSRC_DESC);
+    sweep_pool(file_pool, RSRC_FILE);
+    TEST_ASSERT(get_resource_replacements(RSRC_DESC) == 1);
+    TEST_ASSERT(get_resource_replacements(RSRC_FILE) == 1);
+
+    TEST_ASSERT((fcntl(fd, F_GETFL) & O_NONBLOCK) == 0);
+    TEST_ASSERT(access(file, R_OK | W_OK) == 0);
+
+    TEST_ASSERT(start_resource_maintainer() == 0);
+    stop_resource_maintainer();
+}
+
+static void test_check_pooled_desc(void)
+{
+    struct stat sb;
+    int32_t fds[2];
+
+    int32_t fd = get_desc_cached();
+    TEST_ASSERT(fd > 0);
+    TEST_ASSERT(free_desc_cached(&fd) == 0);
+
+    /* A pooled descriptor the child closed is put back on it's number. */
+    TEST_ASSERT(close(fd) == 0);
+    check_pooled_desc(fd);
+    TEST_ASSERT(fstat(fd, &sb) == 0);
+    TEST_ASSERT(S_ISREG(sb.st_mode) != 0);
+
+    /* So is one something else was put on with dup2(). */
+    TEST_ASSERT(pipe(fds) == 0);
+    TEST_ASSERT(dup2(fds[0], fd) == fd);
+    (void)close(fds[0]);
+    (void)close(fds[1]);
+
+    check_pooled_desc(fd);
+    TEST_ASSERT(fstat(fd, &sb) == 0);
+    TEST_ASSERT(S_ISREG(sb.st_mode) != 0);
+}
+
 static void test_inject_resource_deps(void)
 {
 	  struct dependency_context *ctx = NULL;
@@ -124,6 +252,9 @@ int main(void)
 
 	  test_inject_resource_deps();
     test_resource_generator();
+    test_pid_generator();
+    test_resource_maintainer();
+    test_check_pooled_desc();
 
 	  _exit(0);
 }
@@ -140,6 +140,10 @@ static void setup_tests(void)
     output_writter = get_console_writter();
     TEST_ASSERT_NOT_NULL(output_writter);
 
+    /* The syscall fuzzer's setup builds the resource pools, so the
+       runtime needs every dependency main() gives it. */
+    TEST_ASSERT(inject_deps(output_writter) == 0);
+
     mem_allocator = get_default_allocator();
     TEST_ASSERT_NOT_NULL(mem_allocator);
 
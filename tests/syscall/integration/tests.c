@@ -18,24 +18,38 @@
 #include "memory/memory.h"
 #include "crypto/crypto.h"
 #include "crypto/random.h"
+#include "crypto/hash.h"
+#include "utils/utils.h"
+#include "resource/resource.h"
 #include "syscall/syscall.c"
 #include "syscall/generate.h"
 #include "syscall/child.c"
+#include "syscall/program.c"
+#include "syscall/results.h"
+#include "syscall/lane.h"
+#include "syscall/race.h"
+#include "syscall/testlog.h"
+#ifdef LINUX
+#include "syscall/uring.h"
+#endif
 
 #include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
 
 static const uint32_t iterations = 1000;
 
 static void check_entry(struct syscall_entry *entry)
 {
     TEST_ASSERT_NOT_NULL(entry);
-    TEST_ASSERT(entry->total_args >= 0);
+    TEST_ASSERT(entry->total_args <= NX_ARG_SLOTS);
     TEST_ASSERT_NOT_NULL(entry->syscall_name);
     TEST_ASSERT_NOT_NULL(entry->return_type);
 
     uint32_t i;
     int32_t rtrn = 0;
-    uint64_t *arg = NULL;
+    uint64_t arg = 0;
 
     if(entry->total_args == 0)
         return;
@@ -44,10 +58,9 @@ static void check_entry(struct syscall_entry *entry)
     {
         rtrn = entry->get_arg_array[i](&arg);
         TEST_ASSERT(rtrn == 0);
-        TEST_ASSERT_NOT_NULL(arg);
         if(entry->arg_type_array[i] == PID)
         {
-            TEST_ASSERT(kill((pid_t)(*arg), SIGKILL) == 0);
+            TEST_ASSERT(kill((pid_t)arg, SIGKILL) == 0);
         }
     }
 }
@@ -95,6 +108,31 @@ static void setup_tests(void)
 
     add_dep(ctx, create_dependency(random_gen, RANDOM_GEN));
 
+    struct hasher *hasher = NULL;
+
+    hasher = get_hasher();
+    TEST_ASSERT_NOT_NULL(hasher);
+
+    add_dep(ctx, create_dependency(hasher, HASHER));
+
+    /* The resource pools create their files through the utils module. */
+    inject_utils_deps(ctx);
+    inject_resource_deps(ctx);
+
+    struct resource_generator *rsrc = NULL;
+
+    rsrc = get_resource_generator();
+    TEST_ASSERT_NOT_NULL(rsrc);
+
+    add_dep(ctx, create_dependency(rsrc, RESOURCE_GEN));
+
+    struct memory_allocator *scratch = NULL;
+
+    scratch = get_arena_allocator(1024 * 1024);
+    TEST_ASSERT_NOT_NULL(scratch);
+
+    add_dep(ctx, create_dependency(scratch, SCRATCH_ALLOCATOR));
+
     inject_syscall_deps(ctx);
 }
 
@@ -106,11 +144,11 @@ static void test_get_total_args(void)
     test = malloc(sizeof(struct test_case));
     TEST_ASSERT_NOT_NULL(test);
 
-    struct syscall_entry entry = {
+    struct syscall_hot hot = {
       .total_args = total_args
     };
 
-    test->entry = &entry;
+    test->hot = &hot;
 
     TEST_ASSERT(get_total_args(test) == total_args);
 }
@@ -124,7 +162,7 @@ static void test_create_test_case(void)
     TEST_ASSERT_NOT_NULL(get_argument_array(test));
 
     uint32_t total_args = get_total_args(test);
-    TEST_ASSERT(total_args >= 0);
+    TEST_ASSERT(total_args <= NX_ARG_SLOTS);
 
     struct syscall_entry *entry = NULL;
     entry = get_entry(test);
@@ -134,9 +172,13 @@ static void test_create_test_case(void)
 
     for(i = 0; i < total_args; i++)
     {
-        TEST_ASSERT_NOT_NULL(test->arg_value_array[i]);
+        TEST_ASSERT(test->arg_copy_array[i] == test->arg_value_array[i]);
     }
 
+    cleanup_test(test);
+    free_test_case(&test);
+    TEST_ASSERT_NULL(test);
+
     return;
 }
 
@@ -153,7 +195,7 @@ static void test_create_test_case_for(void)
     TEST_ASSERT_NOT_NULL(get_argument_array(test));
 
     uint32_t total_args = get_total_args(test);
-    TEST_ASSERT(total_args >= 0);
+    TEST_ASSERT(total_args <= NX_ARG_SLOTS);
 
     struct syscall_entry *entry = NULL;
     entry = get_entry(test);
@@ -163,8 +205,11 @@ static void test_create_test_case_for(void)
 
     for(i = 0; i < total_args; i++)
     {
-        TEST_ASSERT_NOT_NULL(test->arg_value_array[i]);
+        TEST_ASSERT(test->arg_copy_array[i] == test->arg_value_array[i]);
     }
+
+    cleanup_test(test);
+    free_test_case(&test);
 }
 
 static void test_get_argument_array(void)
@@ -173,16 +218,10 @@ static void test_get_argument_array(void)
 
     test = malloc(sizeof(struct test_case));
     TEST_ASSERT_NOT_NULL(test);
-    test->arg_value_array = NULL;
 
-    uint64_t **args = get_argument_array(test);
-    TEST_ASSERT_NULL(args);
-
-    test->arg_value_array = malloc(sizeof(struct test_case) * 8);
-    TEST_ASSERT_NOT_NULL(test->arg_value_array);
-
-    args = get_argument_array(test);
-    TEST_ASSERT_NOT_NULL(args);
+    /* The argument slots live inside the test case. */
+    uint64_t *args = get_argument_array(test);
+    TEST_ASSERT(args == test->arg_value_array);
 }
 
 static void test_get_entry(void)
@@ -197,13 +236,17 @@ static void test_get_entry(void)
     table = get_table();
     TEST_ASSERT_NOT_NULL(table);
 
-    test->entry = pick_syscall(table);
+    uint32_t index = 0;
+
+    TEST_ASSERT(pick_syscall_index(table, &index) == 0);
+    select_syscall(test, table, index);
     TEST_ASSERT_NOT_NULL(test->entry);
 
     struct syscall_entry *entry = NULL;
 
     entry = get_entry(test);
     check_entry(entry);
+    TEST_ASSERT(entry == table->sys_entry[index]);
 }
 
 static void test_get_table(void)
@@ -222,30 +265,524 @@ static void test_get_table(void)
     }
 }
 
+static void test_build_hot_table(void)
+{
+    struct syscall_table *table = NULL;
+
+    table = get_table();
+    TEST_ASSERT_NOT_NULL(table);
+    TEST_ASSERT(table->ready == 1);
+    TEST_ASSERT(table->total_active > 0);
+    TEST_ASSERT(table->total_active <= table->total_syscalls);
+    TEST_ASSERT(sizeof(struct syscall_hot) == 32);
+
+    uint32_t i, j;
+
+    for(i = 0; i < table->total_syscalls; i++)
+    {
+        struct syscall_entry *entry = table->sys_entry[i];
+        struct syscall_hot *hot = &table->hot[i];
+
+        TEST_ASSERT(hot->number == entry->syscall_number);
+        TEST_ASSERT(hot->total_args == entry->total_args);
+        TEST_ASSERT(((hot->flags & SYSCALL_ON) != 0) == (entry->status == ON));
+        TEST_ASSERT(((hot->flags & SYSCALL_ALARM) != 0) == (entry->need_alarm == NX_YES));
+        TEST_ASSERT(((hot->flags & SYSCALL_REMAP) != 0) == (entry->damages_buffers == NX_YES));
+
+        for(j = 0; j < entry->total_args; j++)
+        {
+            TEST_ASSERT(hot->arg_type[j] == entry->arg_type_array[j]);
+
+            /* Described and custom kinds have no entry in the generator table. */
+            if(hot->arg_kind[j] < NX_PLAIN_KINDS)
+            {
+                TEST_ASSERT(generator_table[hot->arg_kind[j]] == entry->get_arg_array[j]);
+            }
+        }
+    }
+
+    /* Only switched on syscalls are in the active list. */
+    for(i = 0; i < table->total_active; i++)
+        TEST_ASSERT(table->sys_entry[table->active[i]]->status == ON);
+}
+
+static void test_weighted_selection(void)
+{
+    struct syscall_table *table = NULL;
+
+    table = get_table();
+    TEST_ASSERT_NOT_NULL(table);
+
+    struct syscall_selector *weighted = NULL;
+
+    weighted = create_syscall_selector(table);
+    TEST_ASSERT_NOT_NULL(weighted);
+
+    uint32_t i, j;
+    struct alias_table *alias_tbl = &weighted->tables[weighted->generation & 1];
+
+    TEST_ASSERT(alias_tbl->count == table->total_active);
+
+    for(i = 0; i < alias_tbl->count; i++)
+    {
+        TEST_ASSERT(alias_tbl->prob[i] <= ALIAS_ONE);
+        TEST_ASSERT(alias_tbl->alias[i] < alias_tbl->count);
+    }
+
+    uint32_t index = 0;
+    uint32_t target = 0;
+
+    TEST_ASSERT(find_entry_index("getpid", table, &target) == 0);
+
+    /* Make getpid the only syscall that succeeds and finds coverage. */
+    for(i = 0; i < table->total_active; i++)
+    {
+        uint32_t success = (table->active[i] == target);
+
+        for(j = 0; j < 100; j++)
+            record_feedback(weighted, table->active[i], success, success, 1000);
+    }
+
+    uint32_t generation = weighted->generation;
+
+    TEST_ASSERT(rebuild_selector(weighted, table) == 0);
+    TEST_ASSERT(weighted->generation == generation + 1);
+
+    uint32_t hits = 0;
+
+    for(i = 0; i < iterations * 10; i++)
+    {
+        TEST_ASSERT(select_weighted(weighted, &index) == 0);
+        TEST_ASSERT(table->sys_entry[index]->status == ON);
+
+        if(index == target)
+            hits++;
+    }
+
+    /* Uniform selection would give getpid about iterations * 10 / total_active hits. */
+    TEST_ASSERT(hits > ((iterations * 10) / table->total_active) * 3);
+}
+
+static void test_result_stats(void)
+{
+    struct syscall_table *table = NULL;
+
+    table = get_table();
+    TEST_ASSERT_NOT_NULL(table);
+
+    struct result_stats *stats = NULL;
+
+    stats = create_result_stats();
+    TEST_ASSERT_NOT_NULL(stats);
+
+    uint32_t i;
+    uint32_t index = 0;
+
+    TEST_ASSERT(find_entry_index("getpid", table, &index) == 0);
+
+    for(i = 0; i < iterations; i++)
+        record_return(stats, index, (i % 2) ? EINVAL : ENOSYS);
+
+    TEST_ASSERT(get_result_calls(stats, index) == iterations);
+    TEST_ASSERT(is_wasted_syscall(stats, index) == 1);
+
+    /* One success is enough to show the arguments can get through. */
+    record_return(stats, index, 0);
+    record_return(stats, index, 100000);
+    record_crash(stats, index);
+
+    TEST_ASSERT(is_wasted_syscall(stats, index) == 0);
+    TEST_ASSERT(stats->results[index].returns[0] == 1);
+    TEST_ASSERT(stats->results[index].returns[NX_ERRNO_OTHER] == 1);
+    TEST_ASSERT(stats->results[index].crashes == 1);
+
+    char path[] = "/tmp/nextgen-results-XXXXXX";
+    int32_t fd = mkstemp(path);
+    TEST_ASSERT(fd > -1);
+    close(fd);
+
+    TEST_ASSERT(export_result_stats(stats, table, path) == 0);
+
+    char line[512];
+    FILE *file = fopen(path, "r");
+    TEST_ASSERT_NOT_NULL(file);
+
+    /* A header, then getpid as the only syscall that was called. */
+    TEST_ASSERT_NOT_NULL(fgets(line, sizeof(line), file));
+    TEST_ASSERT_NOT_NULL(fgets(line, sizeof(line), file));
+    const char *expected = "getpid\t1002\t1\t0\t0\t0\t1\t";
+    TEST_ASSERT(strncmp(line, expected, strlen(expected)) == 0);
+    TEST_ASSERT_NULL(fgets(line, sizeof(line), file));
+
+    fclose(file);
+    unlink(path);
+}
+
+static void test_syscall_lanes(void)
+{
+    struct syscall_table *table = NULL;
+
+    table = get_table();
+    TEST_ASSERT_NOT_NULL(table);
+
+    struct result_stats *stats = NULL;
+    struct lane_state *state = NULL;
+
+    stats = create_result_stats();
+    TEST_ASSERT_NOT_NULL(stats);
+
+    state = create_lane_state(table);
+    TEST_ASSERT_NOT_NULL(state);
+
+    uint32_t i;
+    uint32_t read_index = 0;
+    uint32_t getpid_index = 0;
+
+    TEST_ASSERT(find_entry_index("read", table, &read_index) == 0);
+    TEST_ASSERT(find_entry_index("getpid", table, &getpid_index) == 0);
+
+    /* Syscalls that need an alarm start out slow. */
+    TEST_ASSERT(is_slow_syscall(state, read_index) == 1);
+    TEST_ASSERT(is_slow_syscall(state, getpid_index) == 0);
+
+    /* getpid turns slow once it's calls take 20ms, and read fast once it's take 1us. */
+    for(i = 0; i < 100; i++)
+    {
+        record_return(stats, getpid_index, 0);
+        record_latency(stats, getpid_index, 20000000);
+        record_return(stats, read_index, 0);
+        record_latency(stats, read_index, 1000);
+    }
+
+    classify_syscalls(state, table, stats);
+
+    TEST_ASSERT(is_slow_syscall(state, getpid_index) == 1);
+    TEST_ASSERT(is_slow_syscall(state, read_index) == 0);
+
+    uint32_t index = 0;
+
+    for(i = 0; i < iterations; i++)
+    {
+        TEST_ASSERT(pick_slow_syscall(state, &index) == 0);
+        TEST_ASSERT(is_slow_syscall(state, index) == 1);
+    }
+
+    /* A single timeout is enough to make a syscall slow again. */
+    record_timeout(stats, read_index);
+    classify_syscalls(state, table, stats);
+
+    TEST_ASSERT(is_slow_syscall(state, read_index) == 1);
+}
+
+static void test_race(void)
+{
+    struct test_case *leader = NULL;
+    struct test_case *follower = NULL;
+
+    leader = alloc_test_case();
+    TEST_ASSERT_NOT_NULL(leader);
+
+    follower = alloc_test_case();
+    TEST_ASSERT_NOT_NULL(follower);
+
+    TEST_ASSERT(init_test_case_for(leader, "dup") == 0);
+    TEST_ASSERT(init_test_case_for(follower, "fstat") == 0);
+
+    /* fstat borrows dup's descriptor instead of keeping it's own. */
+    TEST_ASSERT(share_test_resources(follower, leader) == 1);
+    TEST_ASSERT(get_argument_array(follower)[0] == get_argument_array(leader)[0]);
+
+    int32_t fd = (int32_t)get_argument_array(leader)[0];
+
+    /* The borrowed descriptor is only closed with the test that owns it. */
+    cleanup_test(follower);
+    TEST_ASSERT(fcntl(fd, F_GETFD) != -1);
+
+    cleanup_test(leader);
+    free_test_case(&follower);
+    free_test_case(&leader);
+
+    TEST_ASSERT_NULL(create_race(1));
+    TEST_ASSERT_NULL(create_race(NX_MAX_RACERS + 1));
+
+    struct race *race = NULL;
+
+    race = create_race(NX_MAX_RACERS);
+    TEST_ASSERT_NOT_NULL(race);
+
+    uint32_t i;
+
+    for(i = 0; i < 100; i++)
+    {
+        TEST_ASSERT(generate_race(race) == 0);
+
+        /* Racing threads can't be interrupted, so nothing needing an alarm races. */
+        uint32_t index = get_syscall_index(get_race_leader(race));
+        TEST_ASSERT((get_table()->hot[index].flags & SYSCALL_ALARM) == 0);
+
+        /* The picks are random, so they are only generated and never run here. */
+        cleanup_race(race);
+    }
+
+    /* Destroying the race has to get every waiting thread out of the barrier. */
+    destroy_race(&race);
+    TEST_ASSERT_NULL(race);
+}
+
+#ifdef LINUX
+
+static void test_uring_batch(void)
+{
+    struct uring_batch *batch = NULL;
+
+    batch = create_uring_batch();
+    TEST_ASSERT_NOT_NULL(batch);
+
+    struct test_case *ready = NULL;
+    struct test_case *blocked = NULL;
+    struct test_case *direct = NULL;
+
+    ready = create_test_case_for("read");
+    TEST_ASSERT_NOT_NULL(ready);
+
+    blocked = create_test_case_for("read");
+    TEST_ASSERT_NOT_NULL(blocked);
+
+    direct = create_test_case_for("getpid");
+    TEST_ASSERT_NOT_NULL(direct);
+
+    TEST_ASSERT(has_uring_op(batch, get_syscall_index(ready)) == NX_YES);
+    TEST_ASSERT(has_uring_op(batch, get_syscall_index(direct)) == NX_NO);
+
+    int32_t full[2];
+    int32_t empty[2];
+    char buf[16] = {0};
+
+    TEST_ASSERT(pipe(full) == 0);
+    TEST_ASSERT(pipe(empty) == 0);
+    TEST_ASSERT(write(full[1], "abc", 3) == 3);
+
+    /* One read has data waiting, the other would block forever. */
+    get_argument_array(ready)[0] = (uint64_t)full[0];
+    get_argument_array(ready)[1] = (uint64_t)(uintptr_t)buf;
+    get_argument_array(ready)[2] = sizeof(buf);
+    get_argument_array(blocked)[0] = (uint64_t)empty[0];
+    get_argument_array(blocked)[1] = (uint64_t)(uintptr_t)buf;
+    get_argument_array(blocked)[2] = sizeof(buf);
+
+    TEST_ASSERT(queue_uring_test(batch, ready) == 0);
+    TEST_ASSERT(queue_uring_test(batch, blocked) == 0);
+    TEST_ASSERT(queue_uring_test(batch, direct) == -1);
+    TEST_ASSERT(get_uring_test(batch, 0) == ready);
+    TEST_ASSERT_NULL(get_uring_test(batch, 2));
+
+    /* The blocked read is cancelled when it's linked timeout fires. */
+    TEST_ASSERT(run_uring_batch(batch) == 1);
+    TEST_ASSERT(get_return_value(ready) == 3);
+    TEST_ASSERT(memcmp(buf, "abc", 3) == 0);
+    TEST_ASSERT(get_error(blocked) == ECANCELED || get_error(blocked) == EINTR);
+
+    cleanup_uring_batch(batch);
+    TEST_ASSERT_NULL(get_uring_test(batch, 0));
+
+    (void)close(full[0]);
+    (void)close(full[1]);
+    (void)close(empty[0]);
+    (void)close(empty[1]);
+
+    cleanup_test(ready);
+    cleanup_test(blocked);
+    cleanup_test(direct);
+    free_test_case(&ready);
+    free_test_case(&blocked);
+    free_test_case(&direct);
+
+    struct test_case *opened = NULL;
+
+    opened = create_test_case_for("openat");
+    TEST_ASSERT_NOT_NULL(opened);
+
+    get_argument_array(opened)[0] = (uint64_t)AT_FDCWD;
+    get_argument_array(opened)[1] = (uint64_t)(uintptr_t)"/dev/null";
+    get_argument_array(opened)[2] = O_RDONLY;
+    get_argument_array(opened)[3] = 0;
+
+    TEST_ASSERT(queue_uring_test(batch, opened) == 0);
+    TEST_ASSERT(run_uring_batch(batch) == 1);
+
+    int32_t fd = (int32_t)get_return_value(opened);
+    TEST_ASSERT(fd > 2);
+
+    /* The descriptor the batch opened is closed with the batch. */
+    cleanup_uring_batch(batch);
+    TEST_ASSERT(fcntl(fd, F_GETFD) == -1);
+
+    cleanup_test(opened);
+    free_test_case(&opened);
+
+    destroy_uring_batch(&batch);
+    TEST_ASSERT_NULL(batch);
+}
+
+#endif
+
+static void test_test_log(void)
+{
+    struct test_log *log = NULL;
+
+    log = create_test_log();
+    TEST_ASSERT_NOT_NULL(log);
+
+    uint32_t i;
+    uint64_t args[NX_ARG_SLOTS] = {0};
+
+    /* Log more tests than fit, the oldest ones get dropped. */
+    for(i = 0; i < NX_TEST_LOG_SIZE + 44; i++)
+    {
+        args[0] = i;
+        args[2] = 0xdeadbeef;
+        log_test_record(log, SYS_getpid, args, NULL, NULL, 3);
+    }
+
+    struct test_record records[NX_TEST_LOG_SIZE];
+    uint32_t total = drain_test_log(log, records, NX_TEST_LOG_SIZE);
+
+    TEST_ASSERT(total == NX_TEST_LOG_SIZE - 1);
+
+    for(i = 0; i < total; i++)
+    {
+        TEST_ASSERT(records[i].sequence == i + 45);
+        TEST_ASSERT(records[i].args[0] == i + 45);
+        TEST_ASSERT(records[i].args[2] == 0xdeadbeef);
+        TEST_ASSERT(records[i].number == SYS_getpid);
+        TEST_ASSERT(records[i].total_args == 3);
+        TEST_ASSERT(records[i].data_size[0] == 0);
+    }
+
+    TEST_ASSERT(drain_test_log(log, records, NX_TEST_LOG_SIZE) == 0);
+
+    /* The bytes arguments point at are copied in order until the record is full. */
+    char big[NX_TEST_RECORD_DATA];
+    uint8_t bytes[] = {0x01, '"', 'a'};
+    const void *data[NX_ARG_SLOTS] = {"/tmp/x", NULL, bytes, big};
+    uint32_t data_size[NX_ARG_SLOTS] = {6, 0, sizeof(bytes), sizeof(big)};
+
+    memset(big, 'b', sizeof(big));
+    log_test_record(log, SYS_getpid, args, data, data_size, 4);
+
+    TEST_ASSERT(drain_test_log(log, records, NX_TEST_LOG_SIZE) == 1);
+    TEST_ASSERT(records[0].data_size[0] == 6);
+    TEST_ASSERT(records[0].data_size[1] == 0);
+    TEST_ASSERT(records[0].data_size[2] == sizeof(bytes));
+    TEST_ASSERT(records[0].data_size[3] == NX_TEST_RECORD_DATA - 6 - sizeof(bytes));
+    TEST_ASSERT(memcmp(records[0].data, "/tmp/x\x01\"a", 9) == 0);
+
+    log_test_record(log, SYS_getpid, args, data, data_size, 3);
+
+    char path[] = "/tmp/nextgen-test-log-XXXXXX";
+    int32_t fd = mkstemp(path);
+    TEST_ASSERT(fd > -1);
+    (void)close(fd);
+
+    TEST_ASSERT(write_test_log(log, path, 1234, SIGSEGV) == 0);
+
+    char line[256];
+    FILE *file = fopen(path, "r");
+    TEST_ASSERT_NOT_NULL(file);
+
+    /* Two comment lines, then the one record left. */
+    TEST_ASSERT_NOT_NULL(fgets(line, sizeof(line), file));
+    TEST_ASSERT(strstr(line, "pid 1234 killed by signal") != NULL);
+    TEST_ASSERT_NOT_NULL(fgets(line, sizeof(line), file));
+    TEST_ASSERT_NOT_NULL(fgets(line, sizeof(line), file));
+    TEST_ASSERT(strncmp(line, "301\t", 4) == 0);
+    TEST_ASSERT(strstr(line, "\tgetpid\t") != NULL);
+    TEST_ASSERT(strstr(line, ":\"/tmp/x\"\t") != NULL);
+    TEST_ASSERT(strstr(line, "\t0xdeadbeef:\"\\x01\\x22a\"\n") != NULL);
+    TEST_ASSERT_NULL(fgets(line, sizeof(line), file));
+
+    (void)fclose(file);
+    (void)unlink(path);
+
+    reset_test_log(log);
+    TEST_ASSERT(drain_test_log(log, records, NX_TEST_LOG_SIZE) == 0);
+}
+
 static void test_generate_ptr(void)
 {
-    void *ptr = NULL;
+    uint64_t ptr = 0;
 
-    int32_t rtrn = generate_ptr((uint64_t **)&ptr);
+    int32_t rtrn = generate_ptr(&ptr);
     TEST_ASSERT(rtrn == 0);
-    TEST_ASSERT_NOT_NULL(ptr);
+    TEST_ASSERT(ptr != 0);
+
+    reset_generated_buffers();
 }
 
 static void test_generate_int(void)
 {
-    int64_t *num = NULL;
-    int32_t rtrn = generate_int((uint64_t **)&num);
+    uint64_t num = UINT64_MAX;
+    int32_t rtrn = generate_int(&num);
     TEST_ASSERT(rtrn == 0);
-    TEST_ASSERT_NOT_NULL(num);
+    TEST_ASSERT(num <= INT32_MAX);
 }
 
 static void test_generate_pid(void)
 {
-    pid_t *pid = NULL;
-    int32_t rtrn = generate_pid((uint64_t **)&pid);
+    uint64_t pid = 0;
+    int32_t rtrn = generate_pid(&pid);
     TEST_ASSERT(rtrn == 0);
-    TEST_ASSERT_NOT_NULL(pid);
-    TEST_ASSERT(kill((*pid), SIGKILL) == 0);
+    TEST_ASSERT(pid > 0);
+    TEST_ASSERT(kill((pid_t)pid, SIGKILL) == 0);
+}
+
+static void test_generate_described(void)
+{
+    static const uint64_t modes[] = {1, 2};
+    static const uint64_t bits[] = {0x10, 0x20, 0x40};
+    static const struct arg_desc mode = {.kind = KIND_ENUM, .count = 2, .values = modes};
+    static const struct arg_desc flags = {.kind = KIND_FLAGS, .count = 3, .values = bits, .base = &mode};
+    static const struct arg_desc range = {.kind = KIND_RANGE, .min = 10, .max = 20};
+    static const struct struct_field fields[] = {
+        {.offset = 0, .size = 2, .desc = &mode},
+        {.offset = 4, .size = 4, .desc = &range}
+    };
+    static const struct arg_desc st = {.kind = KIND_STRUCT, .count = 2, .fields = fields, .max = 8};
+
+    uint32_t i;
+    uint64_t value = 0;
+
+    for(i = 0; i < iterations; i++)
+    {
+        TEST_ASSERT(generate_described(&flags, &value) == 0);
+        TEST_ASSERT((value & ~UINT64_C(0x73)) == 0);
+        TEST_ASSERT((value & 3) == 1 || (value & 3) == 2);
+
+        TEST_ASSERT(generate_described(&range, &value) == 0);
+        TEST_ASSERT(value >= 10 && value <= 20);
+
+        TEST_ASSERT(generate_length(64, &value) == 0);
+        TEST_ASSERT(value <= 64);
+    }
+
+    TEST_ASSERT(generate_described(&st, &value) == 0);
+    TEST_ASSERT(get_generated_buffer_size() == 8);
+
+    uint16_t field = 0;
+    uint32_t number = 0;
+
+    memcpy(&field, (char *)(uintptr_t)value, sizeof(field));
+    memcpy(&number, (char *)(uintptr_t)value + 4, sizeof(number));
+    TEST_ASSERT(field == 1 || field == 2);
+    TEST_ASSERT(number >= 10 && number <= 20);
+
+    /* The generated table describes open's flags. */
+    struct syscall_entry *entry = find_entry("open", get_table());
+    TEST_ASSERT_NOT_NULL(entry);
+    TEST_ASSERT_NOT_NULL(entry->arg_desc_array[1]);
+    TEST_ASSERT(entry->arg_desc_array[1]->kind == KIND_FLAGS);
+
+    reset_generated_buffers();
 }
 
 static void test_pick_syscall(void)
@@ -269,30 +806,66 @@ static void test_generate_args(void)
 {
     struct test_case *test = NULL;
 
-    test = malloc(sizeof(struct test_case));
+    test = alloc_test_case();
     TEST_ASSERT_NOT_NULL(test);
 
-    test->arg_value_array = allocator->alloc(sizeof(uint64_t *) * ARG_LIMIT);
-    TEST_ASSERT_NOT_NULL(test->arg_value_array);
-   
-    test->entry = pick_syscall(get_table());
-    TEST_ASSERT_NOT_NULL(test->entry);
-
     struct syscall_table *table = NULL;
 
     table = get_table();
     TEST_ASSERT_NOT_NULL(table);
 
+    uint32_t index = 0;
+
+    TEST_ASSERT(pick_syscall_index(table, &index) == 0);
+    select_syscall(test, table, index);
+    TEST_ASSERT_NOT_NULL(test->entry);
+
     int32_t rtrn = generate_args(test);
     TEST_ASSERT(rtrn == 0);
-    TEST_ASSERT_NOT_NULL(test->arg_value_array);
+    TEST_ASSERT(test->total_args == test->entry->total_args);
 
     uint32_t i;
 
     for(i = 0; i < test->entry->total_args; i++)
     {
-        TEST_ASSERT_NOT_NULL(test->arg_value_array[i]);
+        TEST_ASSERT(test->arg_tag_array[i] == test->entry->arg_type_array[i]);
+        TEST_ASSERT(test->arg_copy_array[i] == test->arg_value_array[i]);
     }
+
+    cleanup_test(test);
+    free_test_case(&test);
+}
+
+static void test_get_argument_data(void)
+{
+    struct test_case *test = NULL;
+    const void *data = NULL;
+
+    test = create_test_case_for("open");
+    TEST_ASSERT_NOT_NULL(test);
+
+    /* The path's string, but nothing for the flags. */
+    const char *path = (const char *)(uintptr_t)test->arg_value_array[0];
+    TEST_ASSERT(get_argument_data(test, 0, &data) == strlen(path));
+    TEST_ASSERT(data == path);
+    TEST_ASSERT(get_argument_data(test, 1, &data) == 0);
+    TEST_ASSERT_NULL(data);
+
+    /* A mutated path may point anywhere, so it's not read. */
+    test->arg_value_array[0] ^= 1;
+    TEST_ASSERT(get_argument_data(test, 0, &data) == 0);
+    TEST_ASSERT_NULL(data);
+    test->arg_value_array[0] ^= 1;
+
+    cleanup_test(test);
+    TEST_ASSERT(init_test_case_for(test, "bind") == 0);
+
+    /* A described struct's whole buffer. */
+    TEST_ASSERT(get_argument_data(test, 1, &data) == test->entry->arg_desc_array[1]->max);
+    TEST_ASSERT(data == (const void *)(uintptr_t)test->arg_value_array[1]);
+
+    cleanup_test(test);
+    free_test_case(&test);
 }
 
 static void test_cleanup_test(void)
@@ -310,7 +883,36 @@ static void test_cleanup_test(void)
     TEST_ASSERT_NOT_NULL(test);
 
     cleanup_test(test);
-    // TEST_ASSERT_NULL(test);
+    TEST_ASSERT(test->total_args == 0);
+
+    free_test_case(&test);
+    TEST_ASSERT_NULL(test);
+}
+
+static void test_init_test_case(void)
+{
+    struct test_case *test = NULL;
+
+    test = alloc_test_case();
+    TEST_ASSERT_NOT_NULL(test);
+
+    TEST_ASSERT(init_test_case_for(test, "invalid") == -1);
+
+    uint32_t i;
+
+    /* The same test case is reused for every iteration. */
+    for(i = 0; i < iterations; i++)
+    {
+        TEST_ASSERT(init_test_case_for(test, "close") == 0);
+        TEST_ASSERT(get_total_args(test) == test->total_args);
+        TEST_ASSERT(get_argument_array(test) == test->arg_value_array);
+
+        cleanup_test(test);
+        TEST_ASSERT(test->total_args == 0);
+    }
+
+    free_test_case(&test);
+    TEST_ASSERT_NULL(test);
 }
 
 static void test_find_entry(void)
@@ -329,6 +931,179 @@ static void test_find_entry(void)
     entry = find_entry("getpid", table);
     check_entry(entry);
     TEST_ASSERT(strcmp(entry->syscall_name, "getpid") == 0);
+
+    TEST_ASSERT_NULL(find_entry("invalid", table));
+    TEST_ASSERT_NULL(find_entry("", table));
+
+    /* Every entry is reachable through the name and number indexes. */
+    TEST_ASSERT(table->indexed == 1);
+
+    uint32_t i;
+    uint32_t index = 0;
+
+    for(i = 0; i < table->total_syscalls; i++)
+    {
+        entry = table->sys_entry[i];
+
+        TEST_ASSERT(find_entry_index(entry->syscall_name, table, &index) == 0);
+        TEST_ASSERT(index == i);
+        TEST_ASSERT(find_entry_by_number(entry->syscall_number, table) == entry);
+    }
+
+    entry = find_entry_by_number(SYS_getpid, table);
+    TEST_ASSERT_NOT_NULL(entry);
+    TEST_ASSERT(strcmp(entry->syscall_name, "getpid") == 0);
+    TEST_ASSERT_NULL(find_entry_by_number(NX_MAX_SYSCALL_NUMBER, table));
+}
+
+static void test_generate_program(void)
+{
+    struct program *prog = NULL;
+
+    prog = alloc_program();
+    TEST_ASSERT_NOT_NULL(prog);
+
+    uint32_t i, j, k;
+
+    for(i = 0; i < iterations; i++)
+    {
+        TEST_ASSERT(next_program(prog) == 0);
+        TEST_ASSERT(get_total_calls(prog) > 0);
+        TEST_ASSERT(get_total_calls(prog) <= NX_MAX_CALLS);
+
+        /* Arguments only refer to earlier calls returning something they accept. */
+        for(j = 0; j < get_total_calls(prog); j++)
+        {
+            const struct syscall_hot *hot = get_call_hot(prog, j);
+
+            for(k = 0; k < hot->total_args; k++)
+            {
+                uint8_t ref = prog->arg_ref[j][k];
+                if(ref == NO_REF)
+                    continue;
+
+                TEST_ASSERT(ref < j);
+                TEST_ASSERT(accepts_result(hot->arg_kind[k], get_call_hot(prog, ref)->return_kind) == 1);
+            }
+        }
+
+        /* Nothing was executed, so this only releases the arguments. */
+        cleanup_program(prog);
+    }
+
+    free_program(&prog);
+    TEST_ASSERT_NULL(prog);
+}
+
+static void test_execute_program(void)
+{
+    struct program *prog = NULL;
+
+    prog = alloc_program();
+    TEST_ASSERT_NOT_NULL(prog);
+
+    /* dup a pool descriptor and fstat the copy. */
+    TEST_ASSERT(init_test_case_for(prog->calls[0], "dup") == 0);
+    TEST_ASSERT(init_test_case_for(prog->calls[1], "fstat") == 0);
+    prog->total_calls = 2;
+
+    memset(prog->arg_ref, NO_REF, sizeof(prog->arg_ref));
+    prog->arg_ref[1][0] = 0;
+
+    link_program_call(prog, 0);
+    TEST_ASSERT(execute_program_call(prog, 0) == 0);
+    TEST_ASSERT(get_error(prog->calls[0]) == 0);
+
+    int64_t fd = get_return_value(prog->calls[0]);
+    TEST_ASSERT(fd > 2);
+
+    /* The stat buffer may be read only, so fstat can fail with EFAULT but
+       never with EBADF once it's handed the descriptor dup returned. */
+    link_program_call(prog, 1);
+    TEST_ASSERT(get_argument_array(prog->calls[1])[0] == (uint64_t)fd);
+    (void)execute_program_call(prog, 1);
+    TEST_ASSERT(get_error(prog->calls[1]) != EBADF);
+
+    /* The descriptor dup returned is closed with the program. */
+    cleanup_program(prog);
+    TEST_ASSERT(fcntl((int32_t)fd, F_GETFD) == -1);
+
+    free_program(&prog);
+}
+
+static void test_release_test_args(void)
+{
+    struct test_case *first = NULL;
+    struct test_case *second = NULL;
+
+    first = create_test_case_for("read");
+    TEST_ASSERT_NOT_NULL(first);
+
+    second = alloc_test_case();
+    TEST_ASSERT_NOT_NULL(second);
+
+    uint64_t buf = get_argument_array(first)[1];
+    uint32_t i;
+
+    /* Dropping a call of a program must not recycle the buffers the other calls hold. */
+    for(i = 0; i < 32; i++)
+    {
+        TEST_ASSERT(init_test_case_for(second, "read") == 0);
+        TEST_ASSERT(get_argument_array(second)[1] != buf);
+
+        release_test_args(second);
+        TEST_ASSERT(second->total_args == 0);
+    }
+
+    cleanup_test(first);
+    free_test_case(&first);
+    free_test_case(&second);
+}
+
+static void test_release_test_result(void)
+{
+    struct test_case *test = NULL;
+
+    test = create_test_case_for("dup");
+    TEST_ASSERT_NOT_NULL(test);
+
+    int32_t fd = dup(STDOUT_FILENO);
+    TEST_ASSERT(fd > 2);
+
+    /* A returned descriptor is closed, stdio never is. */
+    TEST_ASSERT(set_test_return(test, fd) == 0);
+    release_test_result(test);
+    TEST_ASSERT(fcntl(fd, F_GETFD) == -1);
+
+    TEST_ASSERT(set_test_return(test, STDOUT_FILENO) == 0);
+    release_test_result(test);
+    TEST_ASSERT(fcntl(STDOUT_FILENO, F_GETFD) != -1);
+
+    cleanup_test(test);
+    free_test_case(&test);
+}
+
+static void test_execute_test(void)
+{
+    uint64_t args[NX_ARG_SLOTS] = {0};
+
+    TEST_ASSERT(raw_syscall(SYS_getpid, args) == getpid());
+
+    /* Errors come back as -errno. */
+    args[0] = (uint64_t)-1;
+    TEST_ASSERT(raw_syscall(SYS_close, args) == -EBADF);
+
+    struct test_case *test = NULL;
+
+    test = create_test_case_for("getpid");
+    TEST_ASSERT_NOT_NULL(test);
+
+    TEST_ASSERT(execute_test(test) == 0);
+    TEST_ASSERT(get_return_value(test) == getpid());
+    TEST_ASSERT(get_error(test) == 0);
+
+    cleanup_test(test);
+    free_test_case(&test);
 }
 
 int main(void)
@@ -338,16 +1113,34 @@ int main(void)
     test_generate_ptr();
     test_generate_int();
     test_generate_pid();
+    test_generate_described();
     test_get_argument_array();
     test_get_total_args();
     test_get_table();
+    test_build_hot_table();
+    test_weighted_selection();
+    test_result_stats();
+    test_syscall_lanes();
+    test_race();
+    test_test_log();
+#ifdef LINUX
+    test_uring_batch();
+#endif
     test_pick_syscall();
     test_get_entry();
     test_find_entry();
+    test_get_argument_data();
     test_cleanup_test();
     test_generate_args();
     test_create_test_case_for();
     test_create_test_case();
+    test_init_test_case();
+    test_execute_test();
+    test_generate_program();
+    test_execute_program();
+    test_release_test_args();
+
+    test_release_test_result();
 
     return (0);
 }
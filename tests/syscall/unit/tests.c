@@ -82,6 +82,40 @@ static void test_create_syscall_child(void)
     return;
 }
 
+static void test_release_syscall_child(void)
+{
+    uint32_t total_children = 2;
+    struct syscall_child *child = NULL;
+    struct syscall_child *next = NULL;
+    struct children_state *children_state = NULL;
+
+    children_state = create_children_state(total_children);
+    TEST_ASSERT_NOT_NULL(children_state);
+    TEST_ASSERT(children_state->free_count == total_children);
+
+    set_children_state(children_state);
+
+    child = create_syscall_child();
+    TEST_ASSERT_NOT_NULL(child);
+    TEST_ASSERT(child->slot == 0);
+    TEST_ASSERT(children_state->free_count == 1);
+
+    /* Pretend the child started, then exited. */
+    set_child_pid(child, getpid());
+    atomic_add_uint32(&children_state->running_children, 1);
+    release_syscall_child(child);
+
+    TEST_ASSERT(atomic_load_int32(&child->pid) == EMPTY);
+    TEST_ASSERT(atomic_load_uint32(&children_state->running_children) == 0);
+    TEST_ASSERT(children_state->free_count == total_children);
+
+    /* The released slot should be handed out next. */
+    next = create_syscall_child();
+    TEST_ASSERT(next == child);
+
+    return;
+}
+
 static void test_set_children_state(void)
 {
     uint32_t total_children = 8;
@@ -200,7 +234,7 @@ static void test_get_child_with_pid(void)
 static void test_kill_all_children(void)
 {
     int32_t rtrn = 0;
-    uint32_t total_children = 2;
+    uint32_t total_children = 3;
     struct children_state *children_state = NULL;
 
     children_state = create_children_state(total_children);
@@ -228,14 +262,69 @@ static void test_kill_all_children(void)
     TEST_ASSERT(atomic_load_int32(&child_two->pid) > 0);
     TEST_ASSERT(children_state->running_children == 2);
 
+    /* The third slot is never started, if it's EMPTY pid was signaled
+       kill(0) would take this process down with the children. */
+    abandoned[0] = atomic_load_int32(&child_one->pid) + 1;
     kill_all_children();
 
     TEST_ASSERT(state->children[0]->pid == EMPTY);
     TEST_ASSERT(state->children[1]->pid == EMPTY);
+    TEST_ASSERT(state->children[2]->pid == EMPTY);
+    TEST_ASSERT(state->free_count == total_children);
+
+    /* Abandoned workers had their resources reclaimed too. */
+    TEST_ASSERT(abandoned[0] == 0);
+
+    return;
+}
+
+static void test_reap_abandoned_worker(void)
+{
+    TEST_ASSERT(pipe(status_pipe) == 0);
+    TEST_ASSERT(fcntl(status_pipe[0], F_SETFL, O_NONBLOCK) == 0);
+
+    /* The fork server reports an abandoned worker whose slot went to another one. */
+    abandoned[0] = 4242;
+    send_status(state->total_children, 0, 4242);
+
+    TEST_ASSERT(reap_fork_server_children() == 0);
+    TEST_ASSERT(abandoned[0] == 0);
+
+    (void)close(status_pipe[0]);
+    (void)close(status_pipe[1]);
+    status_pipe[0] = -1;
+    status_pipe[1] = -1;
+
+    return;
+}
+
+#ifdef LINUX
+
+static void test_close_leaked_descs(void)
+{
+    int32_t kept = dup(0);
+    TEST_ASSERT(kept > -1);
+
+    int32_t watermark = get_desc_watermark();
+    TEST_ASSERT(watermark > kept);
+
+    int32_t fds[2];
+    TEST_ASSERT(pipe(fds) == 0);
+
+    /* Only the descriptors opened after the watermark was taken are closed. */
+    close_leaked_descs(watermark);
+
+    TEST_ASSERT(fcntl(fds[0], F_GETFD) == -1);
+    TEST_ASSERT(fcntl(fds[1], F_GETFD) == -1);
+    TEST_ASSERT(fcntl(kept, F_GETFD) != -1);
+
+    (void)close(kept);
 
     return;
 }
 
+#endif
+
 static void setup_tests(void)
 {
   struct dependency_context *ctx = NULL;
@@ -288,6 +377,13 @@ static void setup_tests(void)
 
   add_dep(ctx, create_dependency(control, CONTROL));
 
+  struct memory_allocator *scratch = NULL;
+
+  scratch = get_arena_allocator(4096);
+  TEST_ASSERT_NOT_NULL(scratch);
+
+  add_dep(ctx, create_dependency(scratch, SCRATCH_ALLOCATOR));
+
   inject_syscall_deps(ctx);
 }
 
@@ -297,8 +393,13 @@ int main(void)
     test_set_children_state();
     test_create_children_state();
     test_create_syscall_child();
+    test_release_syscall_child();
     test_get_child_with_pid();
     test_kill_all_children();
+    test_reap_abandoned_worker();
+#ifdef LINUX
+    test_close_leaked_descs();
+#endif
     // test_setup_ctrlc_handler();
     return (0);
 }